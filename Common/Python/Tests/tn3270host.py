@@ -0,0 +1,90 @@
+#
+# Stand-in TN3270 host, shared by the tests and benchmarks in this directory.
+#
+# A Host accepts one connection from an emulator, negotiates TN3270 (not
+# TN3270E), and then sends and receives 3270 records. Tests subclass it or
+# drive it from a thread to play the part of the host application.
+
+import socket
+
+# Telnet constants.
+IAC, DO, WILL, SB, SE, EOR = 255, 253, 251, 250, 240, 239
+TTYPE, BINARY, EOROPT = 24, 0, 25
+
+# 3270 commands, WCCs, orders and field attributes.
+CMD_W, CMD_EW = 0xf1, 0xf5
+WCC_RESTORE = 0xc3
+SF, SBA, IC = 0x1d, 0x11, 0x13
+PROT, NUM = 0x20, 0x10
+
+# Buffer addresses and field attributes are sent as characters from this
+# table, six bits each.
+code_table = [0x40, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7,
+              0xC8, 0xC9, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
+              0x50, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7,
+              0xD8, 0xD9, 0x5A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F,
+              0x60, 0x61, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7,
+              0xE8, 0xE9, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+              0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7,
+              0xF8, 0xF9, 0x7A, 0x7B, 0x7C, 0x7D, 0x7E, 0x7F]
+
+def sba(row, col):
+    """Set Buffer Address order for an 80-column screen"""
+    addr = (row * 80) + col
+    return bytes([SBA, code_table[(addr >> 6) & 0x3f],
+        code_table[addr & 0x3f]])
+
+def sf(row, col, attr):
+    """Start Field order at a screen position"""
+    return sba(row, col) + bytes([SF, code_table[attr]])
+
+def text(s):
+    """Text in EBCDIC"""
+    return s.encode('cp037')
+
+def listener():
+    """A socket listening on a free local port"""
+    s = socket.socket()
+    s.bind(('127.0.0.1', 0))
+    s.listen(1)
+    return s
+
+class Host:
+    """One emulator connection"""
+    def __init__(self, listener):
+        self.listener = listener
+        self.conn = None
+        self.buf = b''
+
+    def accept(self):
+        """Wait for the emulator to connect, and negotiate TN3270"""
+        self.conn, _ = self.listener.accept()
+        self.conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.conn.sendall(bytes([IAC, DO, TTYPE, IAC, SB, TTYPE, 1, IAC, SE,
+            IAC, DO, EOROPT, IAC, WILL, EOROPT, IAC, DO, BINARY, IAC, WILL,
+            BINARY]))
+        # Wait for the terminal type and the option replies.
+        want = [bytes([IAC, WILL, TTYPE]), bytes([IAC, SB, TTYPE, 0]),
+                bytes([IAC, WILL, EOROPT]), bytes([IAC, DO, EOROPT]),
+                bytes([IAC, WILL, BINARY]), bytes([IAC, DO, BINARY])]
+        got = b''
+        while not all(w in got for w in want):
+            d = self.conn.recv(4096)
+            if not d:
+                raise EOFError('emulator closed the connection')
+            got += d
+
+    def send(self, record):
+        """Send a record"""
+        self.conn.sendall(record.replace(b'\xff', b'\xff\xff') +
+                bytes([IAC, EOR]))
+
+    def recv(self):
+        """Receive a record"""
+        while bytes([IAC, EOR]) not in self.buf:
+            d = self.conn.recv(262144)
+            if not d:
+                raise EOFError('emulator closed the connection')
+            self.buf += d
+        record, self.buf = self.buf.split(bytes([IAC, EOR]), 1)
+        return record.replace(b'\xff\xff', b'\xff')
@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+# Reader for the x3270 shared-memory screen mirror
+#
+# Copyright (c) 2020 Paul Mattes.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the names of Paul Mattes nor the names of his contributors
+#       may be used to endorse or promote products derived from this software
+#       without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+# EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+# OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+"""Reader for the x3270 shared-memory screen mirror
+
+   An emulator started with the screenMirror resource set (e.g.,
+   -set screenMirror=/dev/shm/s3270.screen) keeps a copy of its screen
+   buffer, cursor and OIA state in that file. This module reads consistent
+   snapshots of it without sending any commands to the emulator.
+   See include/mirror_shm.h for the layout.
+"""
+
+import collections
+import mmap
+import os
+import struct
+import time
+
+_magic = 0x33323730
+_version = 1
+_header = struct.Struct('=IIIIQIIIIiIIIII')
+_header_fields = ('magic', 'version', 'seq', 'header_size', 'generation',
+        'rows', 'cols', 'capacity', 'cell_size', 'cursor', 'kybdlock',
+        'cstate', 'flags', 'cells_offset', 'pid')
+_seq_offset = 8
+_cell = struct.Struct('=8BI')
+_max_tries = 1000
+
+# Header flags.
+MF_FORMATTED = 0x0001
+MF_3270 = 0x0002
+MF_NVT = 0x0004
+MF_SSCP = 0x0008
+MF_CONNECTED = 0x0010
+MF_ALTBUFFER = 0x0020
+MF_INSERT = 0x0040
+
+mirror_header = collections.namedtuple('mirror_header', _header_fields)
+mirror_cell = collections.namedtuple('mirror_cell',
+        ('fa', 'ec', 'cs', 'fg', 'bg', 'gr', 'ic', 'db', 'ucs4'))
+
+class MirrorException(Exception):
+    """x3270if screen mirror exception"""
+    def __init__(self, msg):
+        """Initialize an instance
+
+           Args:
+              msg (str): Message
+        """
+        self.msg = msg
+    def __str__(self):
+        return self.msg
+
+class screen_mirror:
+    """Read-only view of an emulator's screen mirror"""
+    def __init__(self, path):
+        """Initialize an instance
+
+           Args:
+              path (str): Mirror file name, the value of screenMirror
+           Raises:
+              MirrorException: Not a screen mirror
+        """
+        self._fd = -1
+        self._map = None
+        self._fd = os.open(path, os.O_RDONLY)
+        self._remap()
+        h = self._header()
+        if (h.magic != _magic or h.version != _version or
+                h.cell_size != _cell.size):
+            self.close()
+            raise MirrorException(path + ' is not a screen mirror')
+
+    def __del__(self):
+        self.close()
+
+    def close(self):
+        """Close the mirror"""
+        if (self._map != None):
+            self._map.close()
+            self._map = None
+        if (self._fd >= 0):
+            os.close(self._fd)
+            self._fd = -1
+
+    def _remap(self):
+        if (self._map != None):
+            self._map.close()
+        self._map = mmap.mmap(self._fd, 0, access=mmap.ACCESS_READ)
+
+    def _header(self):
+        return mirror_header._make(_header.unpack_from(self._map, 0))
+
+    def _seq(self):
+        return struct.unpack_from('=I', self._map, _seq_offset)[0]
+
+    def snapshot(self, cells=True):
+        """Take a consistent snapshot of the mirror
+
+           Args:
+              cells (bool): True to return the screen contents too
+           Returns:
+              (mirror_header, bytes): Header and raw cell data (None if
+                 cells is False); use cell() to decode it
+           Raises:
+              MirrorException: The emulator is updating the mirror too
+                 quickly to get a consistent copy
+        """
+        for _ in range(_max_tries):
+            seq = self._seq()
+            if (seq & 1):
+                time.sleep(0)
+                continue
+            h = self._header()
+            start = h.cells_offset
+            end = start + (h.rows * h.cols * _cell.size)
+            if (end > len(self._map)):
+                # The file has grown.
+                self._remap()
+                continue
+            data = self._map[start:end] if cells else None
+            if (self._seq() == seq):
+                return (h, data)
+        raise MirrorException('Cannot get a consistent snapshot')
+
+    def generation(self):
+        """Get the current generation number, to poll for changes cheaply
+
+           Returns:
+              int: Generation
+        """
+        return self.snapshot(cells=False)[0].generation
+
+    def cell(self, data, baddr):
+        """Decode one cell from a snapshot
+
+           Args:
+              data (bytes): Cell data from snapshot()
+              baddr (int): Buffer address
+           Returns:
+              mirror_cell: Cell contents
+        """
+        return mirror_cell._make(_cell.unpack_from(data, baddr * _cell.size))
+
+    def text(self, codec='cp037'):
+        """Get the screen as text, one string per row
+
+           Args:
+              codec (str): Python codec for the host code page
+           Returns:
+              (mirror_header, list of str): Header and screen rows
+        """
+        h, data = self.snapshot()
+        rows = []
+        for row in range(h.rows):
+            chars = []
+            for col in range(h.cols):
+                c = self.cell(data, (row * h.cols) + col)
+                if (c.fa != 0 or (c.ucs4 == 0 and c.ec == 0)):
+                    chars.append(' ')
+                elif (c.ucs4 != 0):
+                    chars.append(chr(c.ucs4))
+                else:
+                    chars.append(bytes([c.ec]).decode(codec, 'replace'))
+            rows.append(''.join(chars))
+        return (h, rows)
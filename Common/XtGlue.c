@@ -34,6 +34,8 @@
 #include "appres.h"
 #include "latin1.h"
 #include "lazya.h"
+#include "metrics.h"
+#include "mirror.h"
 #include "task.h"
 #include "trace.h"
 #include "utils.h"
@@ -831,7 +833,9 @@ process_some_events(bool block, bool *processed_any)
 		(nha == 1)? "": "s",
 		(int)tmo);
     }
+    metrics_wait_start();
     ret = WaitForMultipleObjects(nha, ha, FALSE, tmo);
+    metrics_wait_stop();
 #else /*][*/
     if (tp == NULL) {
 	vtrace("Waiting for %d event%s\n",
@@ -851,7 +855,9 @@ process_some_events(bool block, bool *processed_any)
 		(ne == 1)? "": "s",
 		sec, msec);
     }
+    metrics_wait_start();
     ns = select(FD_SETSIZE, &rfds, &wfds, &xfds, tp);
+    metrics_wait_stop();
 #endif /*[*/
 
     if (WAIT_BAD) {
@@ -952,9 +958,23 @@ process_events(bool block)
     bool any_this_time = false;
     bool done = false;
 
+    metrics_start(MH_EVENT_LOOP);
+
+    /* Bring the screen mirror up to date with the last pass. */
+    mirror_publish();
+
     /* Process events until no more are ready. */
     while (!done) {
 	if (run_tasks()) {
+	    if (task_pending()) {
+		/*
+		 * Some task queue used up its turn. Let pending I/O in before
+		 * it runs again.
+		 */
+		(void) process_some_events(false, &any_this_time);
+		lazya_flush();
+	    }
+	    metrics_stop(MH_EVENT_LOOP);
 	    return true;
 	}
 
@@ -971,5 +991,6 @@ process_events(bool block)
 	processed_any |= any_this_time;
     }
 
+    metrics_stop(MH_EVENT_LOOP);
     return processed_any;
 }
@@ -69,6 +69,7 @@
 #include "lazya.h"
 #include "login_macro.h"
 #include "min_version.h"
+#include "mirror.h"
 #include "model.h"
 #include "names.h"
 #include "nvt.h"
@@ -157,11 +158,16 @@ usage(const char *msg)
 static void
 dump_stats(void)
 {
+    unsigned long frames_sent, frames_coalesced;
+    bool pacing = screen_frame_stats(&frames_sent, &frames_coalesced);
+
     ui_vleaf(IndStats,
 	    AttrBytesReceived, lazyaf("%d", brcvd),
 	    AttrRecordsReceived, lazyaf("%d", rrcvd),
 	    AttrBytesSent, lazyaf("%d", bsent),
 	    AttrRecordsSent, lazyaf("%d", rsent),
+	    AttrFramesSent, pacing? lazyaf("%lu", frames_sent): NULL,
+	    AttrFramesCoalesced, pacing? lazyaf("%lu", frames_coalesced): NULL,
 	    NULL);
 }
 
@@ -442,6 +448,7 @@ main(int argc, char *argv[])
     xio_register();
     sio_glue_register();
     hio_register();
+    mirror_register();
     proxy_register();
     model_register();
     net_register();
@@ -573,7 +580,7 @@ POSSIBILITY OF SUCH DAMAGE.", cyear),
     /* Process events forever. */
     while (1) {
 	process_events(true);
-	screen_disp(false);
+	screen_disp_idle();
     }
 }
 
@@ -932,14 +939,19 @@ b3270_register(void)
     static opt_t b3270_opts[] = {
 	{ OptCallback, OPT_STRING,  false, ResCallback,
 	    aoffset(scripting.callback), NULL, "Callback address and port" },
+	{ OptJson,     OPT_BOOLEAN, true,  ResJson,      aoffset(b3270.json),
+	    NULL, "Use JSON instead of XML for the UI stream" },
 	{ OptUtf8,     OPT_BOOLEAN, true,  ResUtf8,      aoffset(utf8),
 	    NULL, "Force local codeset to be UTF-8" },
     };
     static res_t b3270_resources[] = {
 	{ ResCallback,		aoffset(scripting.callback), XRM_STRING },
+	{ ResFrameDrop,		aoffset(b3270.frame_drop), XRM_BOOLEAN },
+	{ ResFrameInterval,	aoffset(b3270.frame_interval), XRM_INT },
 	{ ResIdleCommand,aoffset(idle_command),     XRM_STRING },
 	{ ResIdleCommandEnabled,aoffset(idle_command_enabled),XRM_BOOLEAN },
 	{ ResIdleTimeout,aoffset(idle_timeout),     XRM_STRING },
+	{ ResJson,		aoffset(b3270.json), XRM_BOOLEAN },
 	{ ResUtf8,		aoffset(utf8),      XRM_BOOLEAN },
     };
     static xres_t b3270_xresources[] = {
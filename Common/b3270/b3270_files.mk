@@ -1,3 +1,3 @@
 # b3270-specific object files
 B3270_OBJECTS = async.o b3270.o ft.o password.o popups.o screen.o status.o \
-	ui_stream.o
+	ui_frame.o ui_json.o ui_stream.o
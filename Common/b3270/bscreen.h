@@ -31,3 +31,6 @@
  */
 
 void b3270_new_codepage(bool);
+void screen_disp_now(void);
+void screen_disp_idle(void);
+bool screen_frame_stats(unsigned long *sent, unsigned long *coalesced);
@@ -36,6 +36,7 @@
 
 #include "appres.h"
 #include "b3270proto.h"
+#include "bscreen.h"
 #include "ctlr.h"
 #include "ctlrc.h"
 #include "ui_stream.h"
@@ -80,8 +81,7 @@ typedef struct {
 } screen_t;
 
 /* Row-difference region. */
-typedef struct _rowdiff {
-    struct _rowdiff *next;
+typedef struct {
     int start_col;
     int width;
     enum { RD_ATTR, RD_TEXT } reason;
@@ -92,9 +92,28 @@ static int saved_cols = 0;
 static int last_rows = 0;
 static int last_cols = 0;
 static struct ea *saved_ea = NULL;
+static size_t saved_ea_size = 0;
 static screen_t *saved_s = NULL;
+static uint64_t *saved_hash = NULL;
 static bool saved_ea_is_empty = false;
 
+/*
+ * Rendered screens. The last screen sent and the one being rendered live in
+ * two preallocated planes that swap roles after each update. Each row also
+ * has a hash, so unchanged rows can be skipped without comparing them.
+ */
+static screen_t *planes[2];
+static uint64_t *row_hashes[2];
+static int plane_rows, plane_cols;
+static int cur_plane;		/* index of saved_s in planes[] */
+
+/* One row's worth of diffs, and the text of one diff. */
+static rowdiff_t *rowdiffs;
+
+/* One row's worth of translated EBCDIC, for render_screen(). */
+static ucs4_t *row_uc;
+static varbuf_t diff_text;
+
 static int sent_baddr = 0;
 static int saved_baddr = 0;
 
@@ -102,7 +121,37 @@ static struct ea zero_ea;
 
 static bool cursor_enabled = true;
 
-static void screen_disp_cond(bool always);
+/*
+ * Frame pacing. When enabled, screen updates are held back while the last
+ * one is younger than the frame interval, or while the UI isn't reading its
+ * output, and all of the changes made in the meantime go out as one frame.
+ */
+static struct timeval last_frame;	/* when the last frame was sent */
+static bool frame_pending;		/* a frame is being held back */
+static ioid_t frame_id = NULL_IOID;	/* frame interval timeout */
+static unsigned long held_generation;	/* screen_generation when held */
+static unsigned long frames_sent;
+static unsigned long frames_coalesced;
+
+/* Scrollbar thumb state, possibly held back with a frame. */
+static struct {
+    float top;
+    float shown;
+    int saved;
+    int screen;
+    int back;
+} thumb;
+static bool thumb_pending;
+
+/*
+ * Coalesced scrolls. Scrolls are counted here rather than sent right away, so
+ * a burst of NVT output that scrolls many lines produces a single scroll
+ * indication, followed by just the rows that are visible at the end.
+ */
+static int scroll_pending;		/* lines scrolled but not yet sent */
+static unsigned char scroll_fg, scroll_bg; /* colors for the new lines */
+
+static void screen_disp_cond(bool always, bool paced);
 
 /*
  * Compare two screen_t's for equality.
@@ -177,29 +226,88 @@ see_gr(u_short gr)
     return lazya(vb_consume(&r));
 }
 
+/*
+ * Hash one rendered row.
+ * Each cell is folded in as a single word, and each step is a bijection of
+ * the running hash, so a row that differs from another in just one cell
+ * always hashes differently.
+ */
+static uint64_t
+hash_row(const screen_t *r)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    int col;
+
+    for (col = 0; col < maxCOLS; col++) {
+	uint64_t w = (uint64_t)r[col].ccode |
+	    ((uint64_t)r[col].fg << 32) |
+	    ((uint64_t)r[col].bg << 40) |
+	    ((uint64_t)r[col].gr << 48);
+
+	h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+    }
+    return h;
+}
+
+/* Hash every row of a rendered screen. */
+static void
+hash_rows(const screen_t *s, uint64_t *hashes)
+{
+    int row;
+
+    for (row = 0; row < maxROWS; row++) {
+	hashes[row] = hash_row(s + (row * maxCOLS));
+    }
+}
+
+/* (Re-)allocate the render planes, if the maximum screen size changed. */
+static void
+alloc_planes(void)
+{
+    int i;
+
+    if (maxROWS == plane_rows && maxCOLS == plane_cols) {
+	return;
+    }
+    for (i = 0; i < 2; i++) {
+	Replace(planes[i],
+		(screen_t *)Malloc(maxROWS * maxCOLS * sizeof(screen_t)));
+	Replace(row_hashes[i], (uint64_t *)Malloc(maxROWS * sizeof(uint64_t)));
+    }
+    Replace(rowdiffs, (rowdiff_t *)Malloc(maxCOLS * sizeof(rowdiff_t)));
+    Replace(row_uc, (ucs4_t *)Malloc(maxCOLS * sizeof(ucs4_t)));
+    plane_rows = maxROWS;
+    plane_cols = maxCOLS;
+    saved_s = planes[cur_plane];
+    saved_hash = row_hashes[cur_plane];
+}
+
 /* Save empty screen state. */
 static void
 save_empty(void)
 {
     size_t se = ROWS * COLS * sizeof(struct ea);
-    size_t ss = maxROWS * maxCOLS * sizeof(screen_t);
     int i;
 
     /* Zero saved_ea. */
-    Replace(saved_ea, (struct ea *)Malloc(se));
+    if (se != saved_ea_size) {
+	Replace(saved_ea, (struct ea *)Malloc(se));
+	saved_ea_size = se;
+    }
     memset(saved_ea, 0, se);
     saved_rows = ROWS;
     saved_cols = COLS;
     saved_ea_is_empty = true;
 
     /* Erase saved_s. */
-    Replace(saved_s, (screen_t *)Malloc(ss));
-    memset(saved_s, 0, ss);
+    alloc_planes();
+    memset(saved_s, 0, maxROWS * maxCOLS * sizeof(screen_t));
     for (i = 0; i < maxROWS * maxCOLS; i++) {
 	saved_s[i].ccode = ' ';
 	saved_s[i].fg = mode.m3279? HOST_COLOR_BLUE: HOST_COLOR_NEUTRAL_WHITE;
 	saved_s[i].bg = HOST_COLOR_NEUTRAL_BLACK;
     }
+    hash_rows(saved_s, saved_hash);
 }
 
 /* Emit an erase indication. */
@@ -221,7 +329,7 @@ static void
 toggle_visibleControl(toggle_index_t ix _is_unused,
 	enum toggle_type tt _is_unused)
 {
-    screen_disp_cond(true);
+    screen_disp_cond(true, false);
 }       
 
 
@@ -267,7 +375,7 @@ screen_init(void)
 void
 b3270_new_codepage(bool unused _is_unused)
 {
-    screen_disp_cond(true);
+    screen_disp_cond(true, false);
 }
 
 /*
@@ -392,6 +500,11 @@ render_screen(struct ea *ea, screen_t *s)
 
 	uc = 0;
 
+	/* Translate each row in one pass. */
+	if (!(i % COLS)) {
+	    ebcdic_to_unicode_row(&ea[i], COLS, EUO_APL_CIRCLED, row_uc);
+	}
+
 	if (ea[i].fa) {
 	    uc = ' ';
 	    fa = ea[i].fa;
@@ -477,8 +590,7 @@ render_screen(struct ea *ea, screen_t *s)
 			break;
 		    }
 		    if (!order) {
-			uc = ebcdic_to_unicode(ea[i].ec, ea[i].cs,
-				EUO_APL_CIRCLED);
+			uc = row_uc[i % COLS];
 			if (is_apl_underlined(ea[i].cs, uc)) {
 			    uc = uncircle(uc);
 			    extra_underline = true;
@@ -575,13 +687,15 @@ render_screen(struct ea *ea, screen_t *s)
     }
 }
 
-/* Generate one row's worth of raw diffs. */
-static rowdiff_t *
+/*
+ * Generate one row's worth of raw diffs into rowdiffs[].
+ * Returns the number of diffs.
+ */
+static int
 generate_rowdiffs(screen_t *oldr, screen_t *newr)
 {
     int col;
-    rowdiff_t *diffs = NULL;
-    rowdiff_t *last_diff = NULL;
+    int n_diffs = 0;
 
     for (col = 0; col < maxCOLS; col++) {
 	rowdiff_t *d;
@@ -590,8 +704,7 @@ generate_rowdiffs(screen_t *oldr, screen_t *newr)
 	    continue;
 	}
 
-	d = (rowdiff_t *)Malloc(sizeof(rowdiff_t));
-	d->next = NULL;
+	d = &rowdiffs[n_diffs++];
 	d->start_col = col;
 	d->width = 1;
 
@@ -625,18 +738,12 @@ generate_rowdiffs(screen_t *oldr, screen_t *newr)
 		}
 	    }
 	}
-	if (last_diff != NULL) {
-	    last_diff->next = d;
-	} else {
-	    diffs = d;
-	}
-	last_diff = d;
-	
+
 	/* Skip over what we just generated. */
 	col += d->width - 1;
     }
 
-    return diffs;
+    return n_diffs;
 }
 
 /*
@@ -657,18 +764,22 @@ ea_equal_attrs_span(screen_t *oldr, screen_t *newr, rowdiff_t *d,
     return true;
 }
 
-/* Merge adjacent sets of diffs to minimize output. */
-static rowdiff_t *
-merge_adjacent(rowdiff_t *diffs, screen_t *oldr, screen_t *newr)
+/*
+ * Merge adjacent sets of diffs to minimize output.
+ * The diffs are compacted in place; returns the new number of diffs.
+ */
+static int
+merge_adjacent(int n_diffs, screen_t *oldr, screen_t *newr)
 {
-    rowdiff_t *d;
-    rowdiff_t *next;
+    rowdiff_t *d = rowdiffs;
+    int i;
 
-    for (d = diffs; d != NULL; d = next) {
-	next = d->next;
-	if (next == NULL) {
-	    break;
-	}
+    if (n_diffs == 0) {
+	return 0;
+    }
+
+    for (i = 1; i < n_diffs; i++) {
+	rowdiff_t *next = &rowdiffs[i];
 
 	/*
 	 * Merge two text diffs if they are joined by a span of RED_SPAN or
@@ -684,15 +795,9 @@ merge_adjacent(rowdiff_t *diffs, screen_t *oldr, screen_t *newr)
 		ea_equal_attrs(&newr[d->start_col], &newr[next->start_col]) &&
 		ea_equal_attrs_span(oldr, newr, d, next)) {
 
-	    rowdiff_t *nx;
-
 	    d->width = next->start_col + next->width - d->start_col;
-	    nx = next;
-	    d->next = next->next;
-	    Free(nx);
 
 	    /* Consider d again. */
-	    next = d;
 	    continue;
 	}
 
@@ -707,15 +812,9 @@ merge_adjacent(rowdiff_t *diffs, screen_t *oldr, screen_t *newr)
 		ea_equal_attrs(&oldr[d->start_col], &oldr[next->start_col]) &&
 		ea_equal_attrs(&newr[d->start_col], &newr[next->start_col])) {
 
-	    rowdiff_t *nx;
-
 	    d->width += next->width;
-	    nx = next;
-	    d->next = next->next;
-	    Free(nx);
 
 	    /* Consider d again. */
-	    next = d;
 	    continue;
 	}
 
@@ -730,37 +829,36 @@ merge_adjacent(rowdiff_t *diffs, screen_t *oldr, screen_t *newr)
 		ea_equal_attrs(&oldr[d->start_col], &oldr[next->start_col]) &&
 		ea_equal_attrs(&newr[d->start_col], &newr[next->start_col])) {
 
-	    rowdiff_t *nx;
-
 	    d->reason = RD_TEXT;
 	    d->width += next->width;
-	    nx = next;
-	    d->next = next->next;
-	    Free(nx);
 
 	    /* Consider d again. */
-	    next = d;
 	    continue;
 	}
+
+	/* No merge, move on. */
+	*++d = *next;
     }
 
-    return diffs;
+    return (int)(d - rowdiffs) + 1;
 }
 
 /* Emit encoded diffs. */
 static void
-emit_rowdiffs(screen_t *oldr, screen_t *newr, rowdiff_t *diffs)
+emit_rowdiffs(screen_t *oldr, screen_t *newr, int n_diffs)
 {
-    rowdiff_t *d;
+    int j;
 
-    for (d = diffs; d != NULL; d = d->next) {
+    for (j = 0; j < n_diffs; j++) {
+	rowdiff_t *d = &rowdiffs[j];
 	const char *args[13]; /* col, fg, bg, gr, text, count, NULL */
 	int aix = 0;
-	char *col_value;
+	char col_value[16];
+	char count_value[16];
 
 	args[aix++] = AttrColumn;
-	col_value = xs_buffer("%d", d->start_col + 1);
-	args[aix++] = col_value; /* will explicitly lazya below */
+	snprintf(col_value, sizeof(col_value), "%d", d->start_col + 1);
+	args[aix++] = col_value;
 	if (oldr[d->start_col].fg != newr[d->start_col].fg) {
 	    args[aix++] = AttrFg;
 	    args[aix++] = see_color(0xf0 | newr[d->start_col].fg);
@@ -776,12 +874,10 @@ emit_rowdiffs(screen_t *oldr, screen_t *newr, rowdiff_t *diffs)
 
 	if (d->reason == RD_TEXT) {
 	    int i;
-	    varbuf_t r;
-	    char *ccode_value;
 	    char utf8_buf[6];
 	    int utf8_len;
 
-	    vb_init(&r);
+	    vb_reset(&diff_text);
 	    for (i = 0; i < d->width; i++) {
 		if (newr[d->start_col + i].ccode == 0) {
 		    /* DBCS right, skip it. */
@@ -789,59 +885,44 @@ emit_rowdiffs(screen_t *oldr, screen_t *newr, rowdiff_t *diffs)
 		}
 		utf8_len = unicode_to_utf8(newr[d->start_col + i].ccode,
 			utf8_buf);
-		vb_appendf(&r, "%.*s", utf8_len, utf8_buf);
+		vb_append(&diff_text, utf8_buf, utf8_len);
 	    }
+	    vb_append(&diff_text, "", 0); /* make sure it is terminated */
 	    args[aix++] = AttrText;
-	    ccode_value = vb_consume(&r);
-	    args[aix++] = ccode_value;
-	    lazya(ccode_value);
+	    args[aix++] = vb_buf(&diff_text);
 	} else {
 	    args[aix++] = "count";
-	    args[aix++] = lazyaf("%d", d->width);
+	    snprintf(count_value, sizeof(count_value), "%d", d->width);
+	    args[aix++] = count_value;
 	}
 
 	args[aix++] = NULL;
 	ui_leaf((d->reason == RD_TEXT)? IndChar: IndAttr, args);
-	lazya(col_value);
     }
 }
 
-static rowdiff_t *
-free_rowdiffs(rowdiff_t *diffs)
-{
-    /* Free the diffs. */
-    while (diffs != NULL) {
-	rowdiff_t *next = diffs->next;
-	Free(diffs);
-	diffs = next;
-    }
-    return NULL;
-}
-
 /* Emit one row's worth of diffs. */
 static void
 emit_row(screen_t *oldr, screen_t *newr)
 {
-    rowdiff_t *diffs = NULL;
+    int n_diffs;
 
     /* Construct the sets of raw diffs. */
-    diffs = generate_rowdiffs(oldr, newr);
+    n_diffs = generate_rowdiffs(oldr, newr);
 
     /* Merge adjacent diffs where it makes sense. */
-    diffs = merge_adjacent(diffs, oldr, newr);
+    n_diffs = merge_adjacent(n_diffs, oldr, newr);
 
     /* Emit the diffs. */
-    emit_rowdiffs(oldr, newr, diffs);
-
-    /* Free the diffs. */
-    diffs = free_rowdiffs(diffs);
+    emit_rowdiffs(oldr, newr, n_diffs);
 }
 
 /*
  * Emit the diff between two screens.
  */
 static void
-emit_diff(screen_t *old, screen_t *new)
+emit_diff(screen_t *old, uint64_t *old_hash, screen_t *new,
+	uint64_t *new_hash)
 {
     int row;
 
@@ -849,10 +930,12 @@ emit_diff(screen_t *old, screen_t *new)
 
     for (row = 0; row < maxROWS; row++) {
 
-	if (memcmp(old + (row * maxCOLS), new + (row * maxCOLS),
-		sizeof(screen_t) * maxCOLS)) {
+	if (old_hash[row] != new_hash[row]) {
+	    char row_value[16];
+
+	    snprintf(row_value, sizeof(row_value), "%d", row + 1);
 	    ui_vpush("row",
-		    AttrRow, lazyaf("%d", row + 1),
+		    AttrRow, row_value,
 		    NULL);
 	    emit_row(&old[row * maxCOLS], &new[row * maxCOLS]);
 	    ui_pop();
@@ -862,6 +945,106 @@ emit_diff(screen_t *old, screen_t *new)
     ui_pop();
 }
 
+/* Check for frame pacing. */
+static bool
+frame_pacing(void)
+{
+    return appres.b3270.frame_interval > 0 || appres.b3270.frame_drop;
+}
+
+/* The frame interval has expired. */
+static void
+frame_timeout(ioid_t id _is_unused)
+{
+    frame_id = NULL_IOID;
+    screen_disp_cond(false, true);
+}
+
+/*
+ * Decide whether to hold back a frame, because the last one was sent too
+ * recently, or because the UI is not keeping up.
+ */
+static bool
+frame_hold(void)
+{
+    struct timeval now;
+    long elapsed;
+
+    if (appres.b3270.frame_drop && ui_output_blocked()) {
+	/* The main loop will try again when the output drains. */
+	return true;
+    }
+    if (appres.b3270.frame_interval <= 0) {
+	return false;
+    }
+    gettimeofday(&now, NULL);
+    elapsed = (now.tv_sec - last_frame.tv_sec) * 1000 +
+	(now.tv_usec - last_frame.tv_usec) / 1000;
+    if (elapsed >= 0 && elapsed < appres.b3270.frame_interval) {
+	if (frame_id == NULL_IOID) {
+	    frame_id = AddTimeOut(appres.b3270.frame_interval - elapsed,
+		    frame_timeout);
+	}
+	return true;
+    }
+    return false;
+}
+
+/* Tell the UI about the scrollbar thumb. */
+static void
+emit_thumb(void)
+{
+    thumb_pending = false;
+    ui_vleaf(IndThumb,
+	    AttrTop, lazyaf("%.5f", thumb.top),
+	    AttrShown, lazyaf("%.5f", thumb.shown),
+	    AttrSaved, lazyaf("%d", thumb.saved),
+	    AttrScreen, lazyaf("%d", thumb.screen),
+	    AttrBack, lazyaf("%d", thumb.back),
+	    NULL);
+}
+
+/* Note that a frame is being sent. */
+static void
+frame_sent(void)
+{
+    gettimeofday(&last_frame, NULL);
+    frame_pending = false;
+    if (frame_id != NULL_IOID) {
+	RemoveTimeOut(frame_id);
+	frame_id = NULL_IOID;
+    }
+    frames_sent++;
+    if (thumb_pending) {
+	emit_thumb();
+    }
+}
+
+/* Check for anything that needs to be sent to the UI. */
+static bool
+screen_dirty(void)
+{
+    return ROWS != last_rows || COLS != last_cols || scroll_pending ||
+	(cursor_enabled && sent_baddr != saved_baddr) ||
+	saved_rows != ROWS || saved_cols != COLS ||
+	memcmp(saved_ea, ea_buf, ROWS * COLS * sizeof(struct ea));
+}
+
+/**
+ * Return the frame counters.
+ *
+ * @param[out] sent		Number of frames sent
+ * @param[out] coalesced	Number of frames merged into later ones
+ * @returns true if frame pacing is enabled
+ */
+bool
+screen_frame_stats(unsigned long *sent, unsigned long *coalesced)
+{
+    *sent = frames_sent;
+    *coalesced = frames_coalesced;
+    return frame_pacing();
+}
+
 /*
  * Move the cursor.
  */
@@ -872,20 +1055,96 @@ cursor_move(int baddr)
     cursor_addr = baddr;
 }
 
+/* Send any coalesced scrolls, and scroll the saved screen to match. */
+static void
+flush_scroll(void)
+{
+    int n = scroll_pending;
+    int nr;
+    int i;
+
+    if (!n) {
+	return;
+    }
+    scroll_pending = 0;
+
+    /* Scroll saved_ea. */
+    if (!saved_ea_is_empty) {
+	nr = (n < saved_rows)? n: saved_rows;
+	memmove(saved_ea, saved_ea + (nr * saved_cols),
+		(saved_rows - nr) * saved_cols * sizeof(struct ea));
+	memset(saved_ea + (saved_rows - nr) * saved_cols, 0,
+		nr * saved_cols * sizeof(struct ea));
+	for (i = (saved_rows - nr) * saved_cols;
+		i < saved_rows * saved_cols;
+		i++) {
+	    saved_ea[i].fg = 0xf0 | scroll_fg;
+	    saved_ea[i].bg = 0xf0 | scroll_bg;
+	}
+    }
+
+    /* Scroll saved_s and its row hashes. */
+    nr = (n < maxROWS)? n: maxROWS;
+    memmove(saved_s, saved_s + (nr * maxCOLS),
+	    (maxROWS - nr) * maxCOLS * sizeof(screen_t));
+    memset(saved_s + (maxROWS - nr) * maxCOLS, 0,
+	    nr * maxCOLS * sizeof(screen_t));
+    for (i = (maxROWS - nr) * maxCOLS; i < maxROWS * maxCOLS; i++) {
+	saved_s[i].ccode = ' ';
+	saved_s[i].fg = scroll_fg & ~0xf0;
+	saved_s[i].bg = scroll_bg & ~0xf0;
+    }
+    memmove(saved_hash, saved_hash + nr, (maxROWS - nr) * sizeof(uint64_t));
+    for (i = maxROWS - nr; i < maxROWS; i++) {
+	saved_hash[i] = hash_row(saved_s + (i * maxCOLS));
+    }
+
+    /* Tell the UI. */
+    ui_vleaf(IndScroll,
+	    AttrFg, see_color(0xf0 | scroll_fg),
+	    AttrBg, see_color(0xf0 | scroll_bg),
+	    AttrCount, (n > 1)? lazyaf("%d", n): NULL,
+	    NULL);
+}
+
 /*
- * Display a changed screen, perhaps unconditionally.
+ * Display a changed screen, perhaps unconditionally, and perhaps subject to
+ * frame pacing.
  */
 static void
-screen_disp_cond(bool always)
+screen_disp_cond(bool always, bool paced)
 {
     bool sent_erase = false;
     size_t se = ROWS * COLS * sizeof(struct ea);
-    size_t ss = maxROWS * maxCOLS * sizeof(screen_t);
     bool empty;
     int i;
-    screen_t *s;
+    int next_plane;
     static bool xformatted = false;
 
+    /* Hold back the update or account for it, if pacing frames. */
+    if (!always && frame_pacing()) {
+	if (!screen_dirty() && !thumb_pending) {
+	    return;
+	}
+	if (paced && frame_hold()) {
+	    if (held_generation != screen_generation || !frame_pending) {
+		if (frame_pending) {
+		    frames_coalesced++;
+		}
+		held_generation = screen_generation;
+	    }
+	    frame_pending = true;
+	    return;
+	}
+	frame_sent();
+    }
+
+    /* Catch up on scrolling. */
+    flush_scroll();
+    if (thumb_pending) {
+	emit_thumb();
+    }
+
     /* Check for a size change. */
     if (ROWS != last_rows || COLS != last_cols) {
 	emit_erase(ROWS, COLS);
@@ -942,39 +1201,68 @@ screen_disp_cond(bool always)
 	xformatted = formatted;
     }
 
-    /* Render the new screen. */
-    s = Malloc(ss);
-    render_screen(ea_buf, s);
+    /* Render the new screen into the other plane. */
+    next_plane = !cur_plane;
+    render_screen(ea_buf, planes[next_plane]);
+    hash_rows(planes[next_plane], row_hashes[next_plane]);
 
     /* Tell them what the screen looks like now. */
-    emit_diff(saved_s, s);
+    emit_diff(saved_s, saved_hash, planes[next_plane],
+	    row_hashes[next_plane]);
 
     /* Save the screen for next time. */
-    Replace(saved_ea, Malloc(se));
     memcpy(saved_ea, ea_buf, se);
     saved_ea_is_empty = false;
-    Replace(saved_s, s);
+    cur_plane = next_plane;
+    saved_s = planes[cur_plane];
+    saved_hash = row_hashes[cur_plane];
     saved_rows = ROWS;
     saved_cols = COLS;
 }
 
 /*
  * Display a changed screen.
+ *
+ * While scrolls are being coalesced, this is deferred to the main loop,
+ * which calls screen_disp_idle(). ctlr_scroll() calls it before every scroll.
+ */
+void
+screen_disp(bool erasing)
+{
+    if (scroll_pending && !erasing) {
+	return;
+    }
+    screen_disp_cond(false, true);
+}
+
+/*
+ * Display a changed screen from the main loop, including any coalesced
+ * scrolls.
+ */
+void
+screen_disp_idle(void)
+{
+    screen_disp_cond(false, true);
+}
+
+/*
+ * Display a changed screen right now, ignoring frame pacing.
  */
 void
-screen_disp(bool erasing _is_unused)
+screen_disp_now(void)
 {
-    screen_disp_cond(false);
+    screen_disp_cond(false, false);
 }
 
 /*
  * Scroll the screen.
+ *
+ * The scroll is just counted; it is sent, along with any others that follow
+ * it, the next time the screen is displayed.
  */
 void
 screen_scroll(unsigned char fg, unsigned char bg)
 {
-    int i;
-
     if (!fg) {
 	fg = mode.m3279? HOST_COLOR_BLUE: HOST_COLOR_NEUTRAL_WHITE;
     }
@@ -982,34 +1270,13 @@ screen_scroll(unsigned char fg, unsigned char bg)
 	bg = HOST_COLOR_NEUTRAL_BLACK;
     }
 
-    /* Scroll saved_ea. */
-    if (!saved_ea_is_empty) {
-	memmove(saved_ea, saved_ea + COLS,
-		(ROWS - 1) * COLS * sizeof(struct ea));
-	memset(saved_ea + (ROWS - 1) * COLS, 0, COLS * sizeof(struct ea));
-	for (i = 0; i < COLS; i++) {
-	    saved_ea[((ROWS - 1) * COLS) + i].fg = 0xf0 | fg;
-	    saved_ea[((ROWS - 1) * COLS) + i].bg = 0xf0 | bg;
-	}
-    }
-
-    /* Scroll saved_s. */
-    memmove(saved_s, saved_s + COLS,
-	    (maxROWS - 1) * maxCOLS * sizeof(screen_t));
-    memset(saved_s + (maxROWS - 1) * maxCOLS, 0, maxCOLS * sizeof(screen_t));
-    for (i = 0; i < maxCOLS; i++) {
-	int j = ((maxROWS - 1) * maxCOLS) + i;
-
-	saved_s[j].ccode = ' ';
-	saved_s[j].fg = fg & ~0xf0;
-	saved_s[j].bg = bg & ~0xf0;
+    /* Scrolls with different colors for the new lines can't be combined. */
+    if (scroll_pending && (fg != scroll_fg || bg != scroll_bg)) {
+	flush_scroll();
     }
-
-    /* Tell the UI. */
-    ui_vleaf(IndScroll,
-	    AttrFg, see_color(0xf0 | fg),
-	    AttrBg, see_color(0xf0 | bg),
-	    NULL);
+    scroll_fg = fg;
+    scroll_bg = bg;
+    scroll_pending++;
 }
 
 /* Left-to-right swap support. */
@@ -1075,11 +1342,21 @@ screen_set_thumb(float top, float shown, int saved, int screen, int back)
     last_shown = shown;
     last_saved = saved;
     last_back = back;
-    ui_vleaf(IndThumb,
-	    AttrTop, lazyaf("%.5f", top),
-	    AttrShown, lazyaf("%.5f", shown),
-	    AttrSaved, lazyaf("%d", saved),
-	    AttrScreen, lazyaf("%d", screen),
-	    AttrBack, lazyaf("%d", back),
-	    NULL);
+    thumb.top = top;
+    thumb.shown = shown;
+    thumb.saved = saved;
+    thumb.screen = screen;
+    thumb.back = back;
+
+    /* If scrolls or frames are being held back, send it with them. */
+    if (scroll_pending) {
+	thumb_pending = true;
+	return;
+    }
+    if (frame_pacing() && frame_hold()) {
+	thumb_pending = true;
+	frame_pending = true;
+	return;
+    }
+    emit_thumb();
 }
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2020 Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	ui_frame.c
+ *		Parser for b3270 length-prefixed (framed) input.
+ *
+ * Framed input is an alternative to XML (or JSON) input, for user interfaces
+ * that send operations at a high rate. Each operation is one frame:
+ *
+ *   4 bytes	length of the rest of the frame, in network byte order
+ *   n bytes	NUL-terminated strings: the operation name, followed by
+ *		attribute name/value pairs
+ *
+ * For example, <run r-tag="1" actions="Enter()"/> is:
+ *
+ *   00 00 00 1c  run NUL r-tag NUL 1 NUL actions NUL Enter() NUL
+ *
+ * Because the first byte of a frame is always zero, framed input is
+ * recognized by the first byte of the stream. Strings are UTF-8 and are
+ * passed to the operation as-is, with no escapes to undo. A frame that is
+ * entirely within one read is dispatched in place, without copying; only a
+ * frame that is split across reads is accumulated in a buffer.
+ */
+
+#include "globals.h"
+
+#include "lazya.h"
+#include "varbuf.h"
+
+#include "ui_frame.h"
+
+#define FRAME_HDR	4		/* length prefix */
+#define FRAME_MAX	(1024 * 1024)	/* largest frame accepted */
+
+static varbuf_t partial;		/* frame split across reads */
+static const char **attrs;		/* attributes passed to op_fn */
+static unsigned max_attrs;		/* size of attrs[] */
+static int frame_number;		/* frames seen */
+static bool broken;			/* lost framing, ignore the rest */
+static ui_frame_op_t *op_fn;		/* operation callback */
+static ui_frame_error_t *error_fn;	/* framing error callback */
+
+/* Decode a frame length prefix. */
+static size_t
+frame_length(const char *buf)
+{
+    const unsigned char *b = (const unsigned char *)buf;
+
+    return ((size_t)b[0] << 24) | ((size_t)b[1] << 16) |
+	((size_t)b[2] << 8) | (size_t)b[3];
+}
+
+/* Check a frame length prefix. Returns false, after an error, if invalid. */
+static bool
+frame_length_ok(size_t len)
+{
+    if (len == 0 || len > FRAME_MAX) {
+	frame_number++;
+	broken = true;
+	(*error_fn)(lazyaf("invalid frame length %lu", (unsigned long)len),
+		true);
+	return false;
+    }
+    return true;
+}
+
+/* Dispatch one complete frame. */
+static void
+dispatch(const char *buf, size_t len)
+{
+    unsigned n_strings = 0;
+    unsigned i;
+    size_t j;
+
+    frame_number++;
+    if (buf[len - 1] != '\0') {
+	(*error_fn)("frame not NUL-terminated", false);
+	return;
+    }
+    for (j = 0; j < len; j++) {
+	if (buf[j] == '\0') {
+	    n_strings++;
+	}
+    }
+    if (!(n_strings % 2)) {
+	(*error_fn)("incomplete attribute in frame", false);
+	return;
+    }
+
+    /* The attributes, plus a NULL terminator, replace the operation name. */
+    if (n_strings > max_attrs) {
+	max_attrs = n_strings;
+	attrs = (const char **)Realloc((void *)attrs,
+		max_attrs * sizeof(const char *));
+    }
+    j = strlen(buf) + 1;
+    for (i = 0; i < n_strings - 1; i++) {
+	attrs[i] = buf + j;
+	j += strlen(buf + j) + 1;
+    }
+    attrs[n_strings - 1] = NULL;
+    (*op_fn)(buf, attrs);
+}
+
+/**
+ * Initialize the frame parser.
+ *
+ * @param[in] op	Function to call for each operation
+ * @param[in] error	Function to call for each framing error
+ */
+void
+ui_frame_init(ui_frame_op_t *op, ui_frame_error_t *error)
+{
+    op_fn = op;
+    error_fn = error;
+    vb_init(&partial);
+}
+
+/**
+ * Parse framed input.
+ *
+ * @param[in] buf	Input buffer
+ * @param[in] len	Length of input
+ */
+void
+ui_frame_parse(const char *buf, size_t len)
+{
+    while (len > 0 && !broken) {
+	size_t flen;
+	size_t n;
+
+	/* Dispatch complete frames straight from the input buffer. */
+	if (vb_len(&partial) == 0 && len >= FRAME_HDR) {
+	    flen = frame_length(buf);
+	    if (!frame_length_ok(flen)) {
+		return;
+	    }
+	    if (len >= FRAME_HDR + flen) {
+		dispatch(buf + FRAME_HDR, flen);
+		buf += FRAME_HDR + flen;
+		len -= FRAME_HDR + flen;
+		continue;
+	    }
+	}
+
+	/* Accumulate the length prefix. */
+	if (vb_len(&partial) < FRAME_HDR) {
+	    n = FRAME_HDR - vb_len(&partial);
+	    if (n > len) {
+		n = len;
+	    }
+	    vb_append(&partial, buf, n);
+	    buf += n;
+	    len -= n;
+	    if (vb_len(&partial) < FRAME_HDR) {
+		return;
+	    }
+	    if (!frame_length_ok(frame_length(vb_buf(&partial)))) {
+		return;
+	    }
+	}
+
+	/* Accumulate the rest of the frame. */
+	flen = frame_length(vb_buf(&partial));
+	n = FRAME_HDR + flen - vb_len(&partial);
+	if (n > len) {
+	    n = len;
+	}
+	vb_append(&partial, buf, n);
+	buf += n;
+	len -= n;
+	if (vb_len(&partial) == FRAME_HDR + flen) {
+	    dispatch(vb_buf(&partial) + FRAME_HDR, flen);
+	    vb_reset(&partial);
+	}
+    }
+}
+
+/**
+ * Check for a partially-received frame.
+ *
+ * @returns true if a frame is incomplete
+ */
+bool
+ui_frame_pending(void)
+{
+    return !broken && vb_len(&partial) > 0;
+}
+
+/**
+ * Return the number of the current frame, for error reporting.
+ *
+ * @returns frame number
+ */
+int
+ui_frame_number(void)
+{
+    return frame_number;
+}
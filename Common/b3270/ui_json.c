@@ -0,0 +1,470 @@
+/*
+ * Copyright (c) 2020 Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	ui_json.c
+ *		Streaming parser for b3270 JSON-mode input.
+ *
+ * In JSON mode, each operation is a JSON object with one member, whose name
+ * is the operation and whose value is an object holding its attributes, e.g.:
+ *
+ *   {"run":{"r-tag":"1","actions":"Connect(host)"}}
+ *
+ * This is the same model as the XML <run r-tag="1" actions="..."/>.
+ * Attribute values can be strings, numbers, true or false; null means the
+ * attribute is omitted. Nested objects and arrays are not valid.
+ *
+ * The parser is a byte-at-a-time state machine, so operations can be split
+ * across reads arbitrarily. Names and values are collected into a single
+ * reusable buffer, so after warm-up it does not allocate memory.
+ */
+
+#include "globals.h"
+
+#include "utf8.h"
+#include "varbuf.h"
+
+#include "ui_json.h"
+
+/* Parser states. */
+typedef enum {
+    JS_TOP,		/* expecting '{' */
+    JS_OP_NAME,		/* expecting operation name string */
+    JS_OP_COLON,	/* expecting ':' after operation name */
+    JS_ATTRS,		/* expecting '{' to start attributes */
+    JS_ATTR_NAME,	/* expecting attribute name or '}' */
+    JS_ATTR_NAME_NEXT,	/* expecting attribute name after ',' */
+    JS_ATTR_COLON,	/* expecting ':' after attribute name */
+    JS_VALUE,		/* expecting attribute value */
+    JS_LITERAL,		/* in a number or keyword */
+    JS_ATTR_NEXT,	/* expecting ',' or '}' after attribute value */
+    JS_OP_END,		/* expecting '}' to end operation */
+    JS_STRING,		/* in a string */
+    JS_STRING_ESC,	/* after '\' in a string */
+    JS_STRING_U,	/* in \uXXXX in a string */
+    JS_ERROR		/* syntax error, skipping to end of line */
+} json_state_t;
+
+static json_state_t state = JS_TOP;
+static json_state_t string_next;	/* state after a string ends */
+static varbuf_t tokens;			/* NUL-separated names and values */
+static size_t *offsets;			/* offsets of tokens */
+static unsigned n_offsets;		/* number of tokens */
+static unsigned max_offsets;		/* size of offsets[] */
+static unsigned u_digits;		/* \u digits seen */
+static ucs4_t u_value;			/* \u value */
+static ucs4_t u_high;			/* pending high surrogate */
+static const char **attrs;		/* attributes passed to op_fn */
+static unsigned max_attrs;		/* size of attrs[] */
+static int line = 1, column;		/* input position */
+static ui_json_op_t *op_fn;		/* operation callback */
+static ui_json_error_t *error_fn;	/* syntax error callback */
+
+/* Start a new token. */
+static void
+token_start(void)
+{
+    if (n_offsets >= max_offsets) {
+	max_offsets = max_offsets? (max_offsets * 2): 16;
+	offsets = (size_t *)Realloc(offsets, max_offsets * sizeof(size_t));
+    }
+    offsets[n_offsets++] = tokens.len;
+}
+
+/* End the current token. */
+static void
+token_end(void)
+{
+    vb_append(&tokens, "", 1);
+}
+
+/* Drop the current token, used for a null value. */
+static void
+token_drop(void)
+{
+    tokens.len = offsets[--n_offsets];
+}
+
+/* Append a Unicode character to the current token, in UTF-8. */
+static void
+token_ucs4(ucs4_t u)
+{
+    char mb[8];
+    int len = unicode_to_utf8(u, mb);
+
+    if (len > 0) {
+	vb_append(&tokens, mb, len);
+    }
+}
+
+/* Dispatch a complete operation and reset. */
+static void
+dispatch(void)
+{
+    unsigned i;
+
+    if (n_offsets > max_attrs) {
+	max_attrs = n_offsets;
+	attrs = (const char **)Realloc((void *)attrs,
+		max_attrs * sizeof(const char *));
+    }
+    for (i = 1; i < n_offsets; i++) {
+	attrs[i - 1] = tokens.buf + offsets[i];
+    }
+    attrs[n_offsets - 1] = NULL;
+    (*op_fn)(tokens.buf + offsets[0], attrs);
+    vb_reset(&tokens);
+    n_offsets = 0;
+}
+
+/* Reset after an error. */
+static void
+reset(void)
+{
+    vb_reset(&tokens);
+    n_offsets = 0;
+    u_high = 0;
+}
+
+/* Return the value of a hex digit. */
+static unsigned
+hex_value(char c)
+{
+    if (isdigit((unsigned char)c)) {
+	return c - '0';
+    }
+    return (tolower((unsigned char)c) - 'a') + 10;
+}
+
+/* Check for JSON white space. */
+static bool
+is_ws(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* Check for a character that can be part of a number or keyword. */
+static bool
+is_literal(char c)
+{
+    return isalnum((unsigned char)c) || c == '-' || c == '+' || c == '.';
+}
+
+/* Check a string against the JSON number grammar. */
+static bool
+is_number(const char *v)
+{
+    if (*v == '-') {
+	v++;
+    }
+    if (*v == '0') {
+	v++;
+    } else if (*v >= '1' && *v <= '9') {
+	while (isdigit((unsigned char)*v)) {
+	    v++;
+	}
+    } else {
+	return false;
+    }
+    if (*v == '.') {
+	if (!isdigit((unsigned char)*++v)) {
+	    return false;
+	}
+	while (isdigit((unsigned char)*v)) {
+	    v++;
+	}
+    }
+    if (*v == 'e' || *v == 'E') {
+	v++;
+	if (*v == '+' || *v == '-') {
+	    v++;
+	}
+	if (!isdigit((unsigned char)*v)) {
+	    return false;
+	}
+	while (isdigit((unsigned char)*v)) {
+	    v++;
+	}
+    }
+    return *v == '\0';
+}
+
+/* Finish a number or keyword value. Returns an error message or NULL. */
+static const char *
+literal_end(void)
+{
+    const char *v = tokens.buf + offsets[n_offsets - 1];
+
+    token_end();
+    if (!strcmp(v, "null")) {
+	token_drop();
+	token_drop();	/* and the attribute name */
+    } else if (strcmp(v, "true") && strcmp(v, "false") && !is_number(v)) {
+	return "invalid value";
+    }
+    return NULL;
+}
+
+/**
+ * Initialize the JSON parser.
+ *
+ * @param[in] op	Function to call for each operation
+ * @param[in] error	Function to call for each syntax error
+ */
+void
+ui_json_init(ui_json_op_t *op, ui_json_error_t *error)
+{
+    op_fn = op;
+    error_fn = error;
+    vb_init(&tokens);
+}
+
+/**
+ * Feed input to the JSON parser.
+ *
+ * @param[in] buf	Input
+ * @param[in] len	Length of input
+ * Syntax errors are reported through the error callback, and the rest of
+ * the line is skipped.
+ */
+void
+ui_json_parse(const char *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+	char c = buf[i];
+	const char *error = NULL;
+
+	if (c == '\n') {
+	    line++;
+	    column = 0;
+	} else {
+	    column++;
+	}
+
+	switch (state) {
+	case JS_TOP:
+	    if (c == '{') {
+		state = JS_OP_NAME;
+	    } else if (!is_ws(c)) {
+		error = "expected '{'";
+	    }
+	    break;
+	case JS_OP_NAME:
+	case JS_ATTR_NAME:
+	case JS_ATTR_NAME_NEXT:
+	    if (c == '"') {
+		token_start();
+		string_next = (state == JS_OP_NAME)? JS_OP_COLON: JS_ATTR_COLON;
+		state = JS_STRING;
+	    } else if (c == '}' && state == JS_ATTR_NAME) {
+		state = JS_OP_END;
+	    } else if (!is_ws(c)) {
+		error = "expected name";
+	    }
+	    break;
+	case JS_OP_COLON:
+	case JS_ATTR_COLON:
+	    if (c == ':') {
+		state = (state == JS_OP_COLON)? JS_ATTRS: JS_VALUE;
+	    } else if (!is_ws(c)) {
+		error = "expected ':'";
+	    }
+	    break;
+	case JS_ATTRS:
+	    if (c == '{') {
+		state = JS_ATTR_NAME;
+	    } else if (!is_ws(c)) {
+		error = "expected '{'";
+	    }
+	    break;
+	case JS_VALUE:
+	    if (c == '"') {
+		token_start();
+		string_next = JS_ATTR_NEXT;
+		state = JS_STRING;
+	    } else if (is_literal(c)) {
+		token_start();
+		vb_append(&tokens, &c, 1);
+		state = JS_LITERAL;
+	    } else if (!is_ws(c)) {
+		error = "expected value";
+	    }
+	    break;
+	case JS_LITERAL:
+	    if (is_literal(c)) {
+		vb_append(&tokens, &c, 1);
+		break;
+	    }
+	    if ((error = literal_end()) != NULL) {
+		break;
+	    }
+	    state = JS_ATTR_NEXT;
+	    /* fall through */
+	case JS_ATTR_NEXT:
+	    if (c == ',') {
+		state = JS_ATTR_NAME_NEXT;
+	    } else if (c == '}') {
+		state = JS_OP_END;
+	    } else if (!is_ws(c)) {
+		error = "expected ',' or '}'";
+	    }
+	    break;
+	case JS_OP_END:
+	    if (c == '}') {
+		state = JS_TOP;
+		dispatch();
+	    } else if (!is_ws(c)) {
+		error = "expected '}'";
+	    }
+	    break;
+	case JS_STRING:
+	    if (c == '"') {
+		token_end();
+		state = string_next;
+	    } else if (c == '\\') {
+		state = JS_STRING_ESC;
+	    } else if ((unsigned char)c < ' ') {
+		error = "control character in string";
+	    } else {
+		/* Copy the run up to the next quote or backslash at once. */
+		size_t j = i + 1;
+
+		while (j < len && buf[j] != '"' && buf[j] != '\\' &&
+			(unsigned char)buf[j] >= ' ') {
+		    j++;
+		}
+		vb_append(&tokens, buf + i, j - i);
+		column += (int)(j - i - 1);
+		i = j - 1;
+	    }
+	    break;
+	case JS_STRING_ESC:
+	    state = JS_STRING;
+	    switch (c) {
+	    case '"':
+	    case '\\':
+	    case '/':
+		vb_append(&tokens, &c, 1);
+		break;
+	    case 'b':
+		vb_append(&tokens, "\b", 1);
+		break;
+	    case 'f':
+		vb_append(&tokens, "\f", 1);
+		break;
+	    case 'n':
+		vb_append(&tokens, "\n", 1);
+		break;
+	    case 'r':
+		vb_append(&tokens, "\r", 1);
+		break;
+	    case 't':
+		vb_append(&tokens, "\t", 1);
+		break;
+	    case 'u':
+		u_digits = 0;
+		u_value = 0;
+		state = JS_STRING_U;
+		break;
+	    default:
+		error = "invalid escape";
+		break;
+	    }
+	    break;
+	case JS_STRING_U:
+	    if (!isxdigit((unsigned char)c)) {
+		error = "invalid \\u escape";
+		break;
+	    }
+	    u_value = (u_value << 4) | hex_value(c);
+	    if (++u_digits < 4) {
+		break;
+	    }
+	    state = JS_STRING;
+	    if (u_value >= 0xd800 && u_value <= 0xdbff) {
+		/* High surrogate, wait for the low one. */
+		u_high = u_value;
+	    } else if (u_value >= 0xdc00 && u_value <= 0xdfff && u_high) {
+		token_ucs4(0x10000 + ((u_high - 0xd800) << 10) +
+			(u_value - 0xdc00));
+		u_high = 0;
+	    } else if (u_value == 0) {
+		error = "NUL in string";
+	    } else {
+		token_ucs4(u_value);
+		u_high = 0;
+	    }
+	    break;
+	case JS_ERROR:
+	    if (c == '\n') {
+		state = JS_TOP;
+	    }
+	    break;
+	}
+
+	if (error != NULL) {
+	    reset();
+	    state = (c == '\n')? JS_TOP: JS_ERROR;
+	    (*error_fn)(error);
+	}
+    }
+}
+
+/**
+ * Check for a partially-parsed operation.
+ *
+ * @returns true if an operation is incomplete
+ */
+bool
+ui_json_pending(void)
+{
+    return state != JS_TOP && state != JS_ERROR;
+}
+
+/**
+ * Return the current input line.
+ *
+ * @returns line number
+ */
+int
+ui_json_line(void)
+{
+    return line;
+}
+
+/**
+ * Return the current input column.
+ *
+ * @returns column number
+ */
+int
+ui_json_column(void)
+{
+    return column;
+}
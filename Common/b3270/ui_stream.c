@@ -35,7 +35,11 @@
 #include "globals.h"
 
 #if !defined(_WIN32) /*[*/
+# include <sys/stat.h>
+# include <sys/socket.h>
+# include <limits.h>
 # include <unistd.h>
+# include <fcntl.h>
 # include <netinet/in.h>
 # include <sys/select.h>
 # include <arpa/inet.h>
@@ -49,6 +53,7 @@
 #include "b3270proto.h"
 #include "bind-opt.h"
 #include "b_password.h"
+#include "bscreen.h"
 #include "lazya.h"
 #include "popups.h"
 #include "resources.h"
@@ -56,12 +61,15 @@
 #include "task.h"
 #include "trace.h"
 #include "utils.h"
+#include "varbuf.h"
 #include "xio.h"
 
 #if defined(_WIN32) /*[*/
 # include "w3misc.h"
 #endif /*]*/
 
+#include "ui_frame.h"
+#include "ui_json.h"
 #include "ui_stream.h"
 
 #define BOM_SIZE	3
@@ -80,10 +88,15 @@ int peer_errno;
 typedef struct _ui_container {
     struct _ui_container *next;
     char *name;
+    bool children;	/* JSON: children have been generated */
 } ui_container_t;
 static ui_container_t *ui_container;
 static int ui_depth;
+static int ui_nattrs;	/* JSON: attributes generated for current object */
 
+static bool ui_json;	/* using JSON instead of XML */
+static bool ui_framed;	/* input is length-prefixed frames */
+static bool ui_input_started;	/* input framing has been checked */
 static XML_Parser parser;
 int input_nest = 0;
 
@@ -140,89 +153,370 @@ static tcb_t cb_ui = {
 
 static socket_t ui_socket = INVALID_SOCKET;
 
-/* Write to the UI socket. */
+/* Output buffering. */
+#define UI_OBUF_MAX	(1024 * 1024)	/* block when this much is queued */
+static varbuf_t ui_obuf;		/* output not yet written */
+static size_t ui_owritten;		/* bytes of ui_obuf already written */
+static size_t ui_otraced;		/* bytes of ui_obuf already traced */
+#if !defined(_WIN32) /*[*/
+static ioid_t ui_output_id = NULL_IOID;	/* waiting for output space */
+static enum {				/* how stdout is written: */
+    UO_BLOCKING,			/*  blocking (file or terminal) */
+    UO_SOCKET,				/*  MSG_DONTWAIT */
+    UO_PIPE				/*  PIPE_BUF at a time, when ready */
+} ui_stdout_type = UO_BLOCKING;
+# if !defined(PIPE_BUF) /*[*/
+#  define PIPE_BUF	512
+# endif /*]*/
+#endif /*]*/
+
+/* XML or JSON escapes, indexed by byte. NULL means copy it as-is. */
+static const char *xml_escapes[256];
+
+/* Set up the XML escape table. */
 static void
-uprintf(const char *fmt, ...)
+xml_escapes_init(void)
 {
-    va_list ap;
-    char *s;
-    static bool eol = true;
-    ssize_t nw;
+    static char numeric[3][8];
+    int c;
+
+    /*
+     * Everything printable, including all of UTF-8, is copied. XML 1.0
+     * understands tabs, newlines and carriage returns, and that's about it,
+     * so other control characters become spaces.
+     */
+    for (c = 0; c < ' '; c++) {
+	xml_escapes[c] = " ";
+    }
+    xml_escapes[0x7f] = " ";
+    sprintf(numeric[0], "&#%u;", 9);
+    sprintf(numeric[1], "&#%u;", 10);
+    sprintf(numeric[2], "&#%u;", 13);
+    xml_escapes[9] = numeric[0];
+    xml_escapes[10] = numeric[1];
+    xml_escapes[13] = numeric[2];
+    xml_escapes['<'] = "&lt;";
+    xml_escapes['>'] = "&gt;";
+    xml_escapes['"'] = "&quot;";
+    xml_escapes['&'] = "&amp;";
+    xml_escapes['\''] = "&apos;";
+}
+
+/* Set up the JSON escape table. */
+static void
+json_escapes_init(void)
+{
+    static char numeric[' '][8];
+    int c;
+
+    for (c = 0; c < ' '; c++) {
+	sprintf(numeric[c], "\\u%04x", c);
+	xml_escapes[c] = numeric[c];
+    }
+    xml_escapes['\b'] = "\\b";
+    xml_escapes['\f'] = "\\f";
+    xml_escapes['\n'] = "\\n";
+    xml_escapes['\r'] = "\\r";
+    xml_escapes['\t'] = "\\t";
+    xml_escapes['"'] = "\\\"";
+    xml_escapes['\\'] = "\\\\";
+}
+
+/* Trace the output that has been generated since the last call. */
+static void
+ui_trace_output(void)
+{
+    const char *s = ui_obuf.buf + ui_otraced;
+    const char *end = ui_obuf.buf + ui_obuf.len;
+
+    while (s < end) {
+	const char *nl = memchr(s, '\n', end - s);
+	size_t len = (nl != NULL)? (size_t)(nl + 1 - s): (size_t)(end - s);
+
+	vtrace("ui> %.*s", (int)len, s);
+	s += len;
+    }
+    ui_otraced = ui_obuf.len;
+}
+
+#if !defined(_WIN32) /*[*/
+/* Wait until the UI output can be written. */
+static void
+ui_wait_output(int fd)
+{
+    fd_set wfds;
+
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+    (void) select(fd + 1, NULL, &wfds, NULL, NULL);
+}
+
+static void ui_output(iosrc_t fd, ioid_t id);
+#endif /*]*/
+
+/*
+ * Write some UI output.
+ *
+ * b3270's own socket is non-blocking. An inherited stdout shares its file
+ * status flags with the parent, so they are left alone: a socket is written
+ * with MSG_DONTWAIT, and a pipe is written no more than PIPE_BUF bytes at a
+ * time, and only when select() says there is room, which cannot block.
+ * Returns what write() would, with EAGAIN if nothing can be written now.
+ */
+static ssize_t
+ui_write_some(const char *s, size_t len)
+{
+#if !defined(_WIN32) /*[*/
+    fd_set wfds;
+    struct timeval tv;
+#endif /*]*/
 
-    va_start(ap, fmt);
-    s = xs_vbuffer(fmt, ap);
-    va_end(ap);
     if (ui_socket != INVALID_SOCKET) {
-	nw = send(ui_socket, s, strlen(s), 0);
-    } else {
-	nw = write(fileno(stdout), s, strlen(s));
+	return send(ui_socket, s, len, 0);
     }
 
-    if (eol) {
-	vtrace("ui> ");
-	eol = false;
+#if !defined(_WIN32) /*[*/
+    switch (ui_stdout_type) {
+    case UO_BLOCKING:
+	break;
+    case UO_SOCKET:
+	return send(fileno(stdout), s, len, MSG_DONTWAIT);
+    case UO_PIPE:
+	FD_ZERO(&wfds);
+	FD_SET(fileno(stdout), &wfds);
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	if (select(fileno(stdout) + 1, NULL, &wfds, NULL, &tv) == 0) {
+	    errno = EAGAIN;
+	    return -1;
+	}
+	if (len > PIPE_BUF) {
+	    len = PIPE_BUF;
+	}
+	break;
     }
-    vtrace("%s", s);
-    if (strlen(s) > 0 && s[strlen(s) - 1] == '\n') {
-	eol = true;
+#endif /*]*/
+    return write(fileno(stdout), s, len);
+}
+
+/*
+ * Write queued output to the UI socket.
+ * If block is false and the socket is full, the rest is written when
+ * there is room for it.
+ */
+static void
+ui_write(bool block)
+{
+    static bool failed = false;
+
+    if (failed) {
+	vb_reset(&ui_obuf);
+	ui_owritten = ui_otraced = 0;
+	return;
     }
-    Free(s);
-    if (nw < 0) {
-	vtrace("UI write failure\n");
-	x3270_exit(1);
+
+    while (ui_owritten < ui_obuf.len) {
+	const char *s = ui_obuf.buf + ui_owritten;
+	size_t len = ui_obuf.len - ui_owritten;
+	ssize_t nw;
+
+	nw = ui_write_some(s, len);
+	if (nw < 0) {
+#if !defined(_WIN32) /*[*/
+	    int fd = (ui_socket != INVALID_SOCKET)? ui_socket: fileno(stdout);
+
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		if (block) {
+		    ui_wait_output(fd);
+		    continue;
+		}
+		if (ui_output_id == NULL_IOID) {
+		    ui_output_id = AddOutput(fd, ui_output);
+		}
+		return;
+	    }
+#endif /*]*/
+	    vtrace("UI write failure\n");
+	    failed = true;
+	    vb_reset(&ui_obuf);
+	    ui_owritten = ui_otraced = 0;
+	    x3270_exit(1);
+	    return;
+	}
+	ui_owritten += nw;
+    }
+
+    /* All caught up. */
+    vb_reset(&ui_obuf);
+    ui_owritten = ui_otraced = 0;
+#if !defined(_WIN32) /*[*/
+    if (ui_output_id != NULL_IOID) {
+	RemoveInput(ui_output_id);
+	ui_output_id = NULL_IOID;
+    }
+#endif /*]*/
+}
+
+#if !defined(_WIN32) /*[*/
+/* There is room to write more UI output. */
+static void
+ui_output(iosrc_t fd _is_unused, ioid_t id _is_unused)
+{
+    ui_write(false);
+}
+#endif /*]*/
+
+/*
+ * Send everything generated so far to the UI socket, in one write if
+ * possible. Called at the end of each top-level indication.
+ */
+static void
+ui_flush(void)
+{
+    bool block = (ui_obuf.len - ui_owritten > UI_OBUF_MAX);
+
+    ui_trace_output();
+#if !defined(_WIN32) /*[*/
+    if (ui_output_id != NULL_IOID && !block) {
+	/* Still waiting for room; the output callback will write it. */
+	return;
     }
+#endif /*]*/
+    ui_write(block);
+}
+
+/**
+ * Check for UI output waiting for the socket to drain.
+ *
+ * @returns true if output is backed up
+ */
+bool
+ui_output_blocked(void)
+{
+#if !defined(_WIN32) /*[*/
+    return ui_output_id != NULL_IOID;
+#else /*][*/
+    return false;
+#endif /*]*/
+}
+
+/* Add text to the UI output. */
+static void
+uputs(const char *s)
+{
+    vb_appends(&ui_obuf, s);
+}
+
+/* Add formatted text to the UI output. */
+static void
+uprintf(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vb_vappendf(&ui_obuf, fmt, ap);
+    va_end(ap);
 }
 
-/* Dump a string in HTML quoted format, if needed. */
+/* Add indentation for the current nesting level to the UI output. */
+static void
+uindent(void)
+{
+    static const char spaces[] = "                ";
+    int n = ui_depth;
+
+    while (n > 0) {
+	int len = (n < (int)sizeof(spaces) - 1)? n: (int)sizeof(spaces) - 1;
+
+	vb_append(&ui_obuf, spaces, len);
+	n -= len;
+    }
+}
+
+/* Dump a string in XML or JSON quoted format, if needed. */
 static void
 xml_safe(const char *value)
 {
-    char s;
+    const unsigned char *s = (const unsigned char *)value;
 
-    while ((s = *value++)) {
-	unsigned char c = s;
+    while (*s) {
+	const unsigned char *run = s;
 
-	if ((c & 0x80) && (c < 0x86 || c > 0x9f)) {
-	    /* UTF-8 upper. */
-	    uprintf("%c", c);
-	} else if (c >= ' ' && c != 0x7f) {
-	    /* Printable, but might need quoting. */
-	    switch (c) {
-	    case '<':
-		uprintf("&lt;");
-		break;
-	    case '>':
-		uprintf("&gt;");
-		break;
-	    case '"':
-		uprintf("&quot;");
-		break;
-	    case '&':
-		uprintf("&amp;");
-		break;
-	    case '\'':
-		uprintf("&apos;");
-		break;
-	    default:
-		uprintf("%c", c);
-		break;
+	/* Copy the longest run that needs no quoting. */
+	while (*s && xml_escapes[*s] == NULL) {
+	    s++;
+	}
+	if (s > run) {
+	    vb_append(&ui_obuf, (const char *)run, s - run);
+	}
+	if (*s) {
+	    uputs(xml_escapes[*s++]);
+	}
+    }
+}
+
+/* Add one attribute to the UI output. */
+static void
+uattr(const char *tag, const char *value)
+{
+    if (ui_json) {
+	uputs(ui_nattrs++? ",\"": "\"");
+	uputs(tag);
+	uputs("\":\"");
+    } else {
+	uputs(" ");
+	uputs(tag);
+	uputs("=\"");
+    }
+    xml_safe(value);
+    uputs("\"");
+}
+
+/*
+ * Start a GUI object.
+ * In JSON mode, an object is {"name":{"attr":"value",...}}, and a container
+ * adds a "children" array after its attributes. Objects inside the document
+ * element are not wrapped, so each indication is one line.
+ */
+static void
+ui_object_start(const char *name)
+{
+    if (ui_json) {
+	if (ui_depth > 1) {
+	    if (ui_container->children) {
+		uputs(",");
 	    }
+	    ui_container->children = true;
+	}
+	uputs("{\"");
+	uputs(name);
+	uputs("\":{");
+	ui_nattrs = 0;
+    } else {
+	uindent();
+	uputs("<");
+	uputs(name);
+    }
+}
+
+/* Finish a GUI object, flushing the output if it is at the top level. */
+static void
+ui_object_end(bool leaf)
+{
+    if (ui_json) {
+	if (leaf) {
+	    uputs((ui_depth <= 1)? "}}\n": "}}");
 	} else {
-	    /*
-	     * Not printable. XML 1.0 understands tabs, newlines and carriage
-	     * returns, and that's about it.
-	     */
-	    switch (c) {
-	    case 9:
-	    case 10:
-	    case 13:
-		uprintf("&#%u;", c);
-		break;
-	    default:
-		uprintf(" ");
-		break;
-	    }
+	    uputs(ui_nattrs? ",\"children\":[": "\"children\":[");
 	}
+    } else {
+	uputs(leaf? "/>\n": ">\n");
+    }
+    if (leaf && ui_depth <= 1) {
+	ui_flush();
     }
 }
 
@@ -236,15 +530,13 @@ ui_object(bool leaf, const char *name, const char *args[])
     const char *tag;
     int i = 0;
 
-    uprintf("%*s<%s", ui_depth, "", name);
+    ui_object_start(name);
     while ((tag = args[i++]) != NULL) {
 	const char *value = args[i++];
 
-	uprintf(" %s=\"", tag);
-	xml_safe(value);
-	uprintf("\"");
+	uattr(tag, value);
     }
-    uprintf("%s>\n", leaf? "/": "");
+    ui_object_end(leaf);
 }
 
 /*
@@ -256,17 +548,15 @@ ui_vobject(bool leaf, const char *name, va_list ap)
 {
     const char *tag;
 
-    uprintf("%*s<%s", ui_depth, "", name);
+    ui_object_start(name);
     while ((tag = va_arg(ap, const char *)) != NULL) {
 	const char *value = va_arg(ap, const char *);
 
 	if (value) {
-	    uprintf(" %s=\"", tag);
-	    xml_safe(value);
-	    uprintf("\"");
+	    uattr(tag, value);
 	}
     }
-    uprintf("%s>\n", leaf? "/": "");
+    ui_object_end(leaf);
 }
 
 /*
@@ -301,6 +591,7 @@ push_name(const char *name)
     g = Malloc(sizeof(ui_container_t) + strlen(name) + 1);
     g->name = (char *)(g + 1);
     strcpy(g->name, name);
+    g->children = false;
     g->next = ui_container;
     ui_container = g;
     ui_depth++;
@@ -346,9 +637,18 @@ ui_pop(void)
     ui_container_t *g = ui_container;
 
     ui_depth--;
-    uprintf("%*s</%s>\n", ui_depth, "", g->name);
+    if (!ui_json) {
+	uindent();
+	uprintf("</%s>\n", g->name);
+    } else if (g->next != NULL) {
+	/* The JSON document element has no representation. */
+	uputs((ui_depth <= 1)? "]}}\n": "]}}");
+    }
     ui_container = g->next;
     Free(g);
+    if (ui_depth <= 1) {
+	ui_flush();
+    }
 }
 
 /* Data callback. */
@@ -376,7 +676,7 @@ ui_action_done(task_cbh handle, bool success, bool abort)
      * Repaint the screen, so the effect of the action can be seen before
      * we indicate that the action is complete.
      */
-    screen_disp(false);
+    screen_disp_now();
 
     ui_vleaf(IndRunResult,
 	    AttrRTag, uia->tag,
@@ -391,6 +691,28 @@ ui_action_done(task_cbh handle, bool success, bool abort)
     return true;
 }
 
+/* Return the current input line, for error reporting. */
+static const char *
+ui_line(void)
+{
+    if (ui_framed) {
+	return lazyaf("%d", ui_frame_number());
+    }
+    return lazyaf("%d", ui_json? ui_json_line():
+	    (int)XML_GetCurrentLineNumber(parser));
+}
+
+/* Return the current input column, for error reporting. */
+static const char *
+ui_column(void)
+{
+    if (ui_framed) {
+	return "0";
+    }
+    return lazyaf("%d", ui_json? ui_json_column():
+	    (int)XML_GetCurrentColumnNumber(parser));
+}
+
 /* Emit a warning about an unknown attribute. */
 static void
 ui_unknown_attribute(const char *element, const char *attribute)
@@ -400,8 +722,8 @@ ui_unknown_attribute(const char *element, const char *attribute)
 	    AttrText, "unknown attribute",
 	    AttrElement, element,
 	    AttrAttribute, attribute,
-	    AttrLine, lazyaf("%d", XML_GetCurrentLineNumber(parser)),
-	    AttrColumn, lazyaf("%d", XML_GetCurrentColumnNumber(parser)),
+	    AttrLine, ui_line(),
+	    AttrColumn, ui_column(),
 	    NULL);
 }
 
@@ -414,8 +736,8 @@ ui_missing_attribute(const char *element, const char *attribute)
 	    AttrText, "missing attribute",
 	    AttrElement, element,
 	    AttrAttribute, attribute,
-	    AttrLine, lazyaf("%d", XML_GetCurrentLineNumber(parser)),
-	    AttrColumn, lazyaf("%d", XML_GetCurrentColumnNumber(parser)),
+	    AttrLine, ui_line(),
+	    AttrColumn, ui_column(),
 	    NULL);
 }
 
@@ -539,9 +861,8 @@ do_register(const char *cmd, const char **attrs)
 		    AttrFatal, ValFalse,
 		    AttrText, "invalid name",
 		    AttrElement, OperRegister,
-		    AttrLine, lazyaf("%d", XML_GetCurrentLineNumber(parser)),
-		    AttrColumn,
-			lazyaf("%d", XML_GetCurrentColumnNumber(parser)),
+		    AttrLine, ui_line(),
+		    AttrColumn, ui_column(),
 		    NULL);
 	    return;
 	}
@@ -593,17 +914,62 @@ do_passthru_complete(bool success, const char *cmd, const char **attrs)
     task_passthru_done(tag, success, text);
 }
 
+static void ui_operation(const char *name, const char **atts);
+
+/* Trace and process one framed operation. */
+static void
+frame_operation(const char *name, const char **atts)
+{
+    if (toggled(TRACING)) {
+	varbuf_t r;
+	int i;
+
+	vb_init(&r);
+	vb_appendf(&r, "ui< [frame %d] %s", ui_frame_number(), name);
+	for (i = 0; atts[i] != NULL; i += 2) {
+	    vb_appendf(&r, " %s=\"%s\"", atts[i], atts[i + 1]);
+	}
+	vtrace("%s\n", vb_buf(&r));
+	vb_free(&r);
+    }
+    ui_operation(name, atts);
+}
+
+/* Framing error handler. */
+static void
+frame_error(const char *why, bool fatal)
+{
+    ui_vleaf(IndUiError,
+	    AttrFatal, ValTrueFalse(fatal),
+	    AttrText, lazyaf("framing error: %s", why),
+	    AttrLine, ui_line(),
+	    AttrColumn, ui_column(),
+	    NULL);
+    if (fatal) {
+	fprintf(stderr, "Fatal UI framing error: %s\n", why);
+	x3270_exit(1);
+    }
+}
+
 /* UI input processor. */
 static void
 process_input(const char *buf, ssize_t nr)
 {
+    if (ui_framed) {
+	ui_frame_parse(buf, nr);
+	return;
+    }
+    if (ui_json) {
+	ui_json_parse(buf, nr);
+	return;
+    }
     if (XML_Parse(parser, buf, nr, 0) == 0) {
 	ui_vleaf(IndUiError,
 		AttrFatal, ValTrue,
 		AttrText, xs_buffer("XML parsing error: %s",
 		    XML_ErrorString(XML_GetErrorCode(parser))),
-		AttrLine, lazyaf("%d", XML_GetCurrentLineNumber(parser)),
-		AttrColumn, lazyaf("%d", XML_GetCurrentColumnNumber(parser)),
+		AttrLine, ui_line(),
+		AttrColumn, ui_column(),
 		NULL);
 	fprintf(stderr, "Fatal XML parsing error: %s\n",
 		XML_ErrorString(XML_GetErrorCode(parser)));
@@ -651,21 +1017,43 @@ ui_input(iosrc_t fd _is_unused, ioid_t id _is_unused)
     }
     if (nr == 0) {
 	vtrace("UI input EOF, exiting\n");
-	if (input_nest) {
+	if ((ui_framed && ui_frame_pending()) ||
+		(!ui_framed && ui_json && ui_json_pending())) {
+	    ui_vleaf(IndUiError,
+		    AttrFatal, ValFalse,
+		    AttrText, "incomplete operation",
+		    AttrLine, ui_line(),
+		    AttrColumn, ui_column(),
+		    NULL);
+	} else if (!ui_framed && input_nest) {
 	    ui_vleaf(IndUiError,
 		    AttrFatal, ValFalse,
 		    AttrText, "unclosed elements",
 		    AttrCount, lazyaf("%d", input_nest),
-		    AttrLine, lazyaf("%d", XML_GetCurrentLineNumber(parser)),
-		    AttrColumn,
-			lazyaf("%d", XML_GetCurrentColumnNumber(parser)),
+		    AttrLine, ui_line(),
+		    AttrColumn, ui_column(),
 		    NULL);
 	}
 	x3270_exit(0);
     }
 
-    /* Trace it, skipping any initial newline. */
-    {
+    /*
+     * A frame starts with the high-order byte of its length, which is always
+     * zero. Neither XML nor JSON input can start with a NUL, so that
+     * identifies framed input.
+     */
+    if (!ui_input_started) {
+	ui_input_started = true;
+	if (buf[0] == '\0') {
+	    vtrace("UI input is framed\n");
+	    ui_framed = true;
+	    ui_frame_init(frame_operation, frame_error);
+	    bom_count = BOM_SIZE;
+	}
+    }
+
+    /* Trace it, skipping any initial newline. Frames are traced as parsed. */
+    if (!ui_framed) {
 	int nrd = (int)nr;
 	char *bufd = buf;
 
@@ -766,6 +1154,8 @@ ui_exiting(bool ignored)
     while (ui_container) {
 	ui_pop();
     }
+    ui_trace_output();
+    ui_write(true);
 }
 
 /**
@@ -781,8 +1171,8 @@ xml_start(void *userData _is_unused, const XML_Char *name,
 		AttrFatal, ValFalse,
 		AttrText, "invalid nested element",
 		AttrElement, name,
-		AttrLine, lazyaf("%d", XML_GetCurrentLineNumber(parser)),
-		AttrColumn, lazyaf("%d", XML_GetCurrentColumnNumber(parser)),
+		AttrLine, ui_line(),
+		AttrColumn, ui_column(),
 		NULL);
 	return;
     }
@@ -795,9 +1185,8 @@ xml_start(void *userData _is_unused, const XML_Char *name,
 		    AttrFatal, ValTrue,
 		    AttrText, "unexpected document element (want " DocIn ")",
 		    AttrElement, name,
-		    AttrLine, lazyaf("%d", XML_GetCurrentLineNumber(parser)),
-		    AttrColumn,
-			lazyaf("%d", XML_GetCurrentColumnNumber(parser)),
+		    AttrLine, ui_line(),
+		    AttrColumn, ui_column(),
 		    NULL);
 	    fprintf(stderr, "UI document element error\n");
 	    x3270_exit(1);
@@ -808,6 +1197,15 @@ xml_start(void *userData _is_unused, const XML_Char *name,
 	return;
     }
 
+    ui_operation(name, atts);
+}
+
+/**
+ * Process one UI operation, from XML or JSON.
+ */
+static void
+ui_operation(const char *name, const char **atts)
+{
     if (!strcasecmp(name, OperRun)) {
 	do_run(name, atts);
     } else if (!strcasecmp(name, OperRegister)) {
@@ -821,8 +1219,8 @@ xml_start(void *userData _is_unused, const XML_Char *name,
 		AttrFatal, ValFalse,
 		AttrText, "unrecognized element",
 		AttrElement, name,
-		AttrLine, lazyaf("%d", XML_GetCurrentLineNumber(parser)),
-		AttrColumn, lazyaf("%d", XML_GetCurrentColumnNumber(parser)),
+		AttrLine, ui_line(),
+		AttrColumn, ui_column(),
 		NULL);
     }
 }
@@ -861,12 +1259,26 @@ xml_data(void *userData _is_unused, const XML_Char *s, int len)
     ui_vleaf(IndUiError,
 	    AttrFatal, ValFalse,
 	    AttrText, "ignoring plain text",
-	    AttrLine, lazyaf("%d", XML_GetCurrentLineNumber(parser)),
-	    AttrColumn, lazyaf("%d", XML_GetCurrentColumnNumber(parser)),
+	    AttrLine, ui_line(),
+	    AttrColumn, ui_column(),
 	    AttrCount, lazyaf("%d", len),
 	    NULL);
 }
 
+/**
+ * JSON syntax error handler.
+ */
+static void
+json_error(const char *why)
+{
+    ui_vleaf(IndUiError,
+	    AttrFatal, ValFalse,
+	    AttrText, lazyaf("JSON parsing error: %s", why),
+	    AttrLine, ui_line(),
+	    AttrColumn, ui_column(),
+	    NULL);
+}
+
 /**
  * Initialize the UI socket.
  *
@@ -905,13 +1317,18 @@ ui_io_init()
 	}
     }
 
-    /* Create the XML parser. */
-    parser = XML_ParserCreate("UTF-8");
-    if (parser == NULL) {
-	Error("Cannot create XML parser");
+    /* Create the XML or JSON parser. */
+    ui_json = appres.b3270.json;
+    if (ui_json) {
+	ui_json_init(ui_operation, json_error);
+    } else {
+	parser = XML_ParserCreate("UTF-8");
+	if (parser == NULL) {
+	    Error("Cannot create XML parser");
+	}
+	XML_SetElementHandler(parser, xml_start, xml_end);
+	XML_SetCharacterDataHandler(parser, xml_data);
     }
-    XML_SetElementHandler(parser, xml_start, xml_end);
-    XML_SetCharacterDataHandler(parser, xml_data);
 
 #if !defined(_WIN32) /*[*/
     AddInput((ui_socket != INVALID_SOCKET)? ui_socket: fileno(stdin), ui_input);
@@ -937,10 +1354,46 @@ ui_io_init()
     }
 #endif /*]*/
 
-    /* Start the XML stream. */
-    uprintf("%c%c%c<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n",
-	    0xef, 0xbb, 0xbf);
-    ui_vpush(DocOut, NULL);
+    /* Set up output. */
+    vb_init(&ui_obuf);
+    if (ui_json) {
+	json_escapes_init();
+    } else {
+	xml_escapes_init();
+    }
+#if !defined(_WIN32) /*[*/
+    /*
+     * Write to sockets and pipes without blocking, so a slow reader doesn't
+     * stall the emulator. Anything else (a file or a terminal) is written
+     * normally.
+     */
+    if (ui_socket != INVALID_SOCKET) {
+	fcntl(ui_socket, F_SETFL, fcntl(ui_socket, F_GETFL) | O_NONBLOCK);
+    } else {
+	struct stat st;
+
+	if (fstat(fileno(stdout), &st) == 0) {
+	    if (S_ISSOCK(st.st_mode)) {
+		ui_stdout_type = UO_SOCKET;
+	    } else if (S_ISFIFO(st.st_mode)) {
+		ui_stdout_type = UO_PIPE;
+	    }
+	}
+    }
+#endif /*]*/
+
+    /*
+     * Start the XML stream. A JSON stream is just a sequence of objects, one
+     * per line, so the document element is implicit.
+     */
+    if (ui_json) {
+	push_name(DocOut);
+    } else {
+	uprintf("%c%c%c<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n",
+		0xef, 0xbb, 0xbf);
+	ui_vpush(DocOut, NULL);
+	ui_flush();
+    }
 
     /* Set up a handler for exit. */
     register_schange_ordered(ST_EXITING, ui_exiting, ORDER_LAST);
@@ -46,18 +46,18 @@
 static char *alphabet64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 /*
- * Encode a string in base64.
+ * Encode a counted buffer in base64. The buffer may contain NULs.
  *
  * Returns a malloc'd buffer.
  */
 char *
-base64_encode(const char *s)
+base64_encode_buf(const char *s, size_t len)
 {
     /*
      * We need one output character for every 6 bits of input, plus up to two
      * padding characters, plus a terminaing NUL.
      */
-    size_t nmalloc = (((strlen(s) * BITS_PER_BYTE) + (BITS_PER_BASE64 - 1)) / BITS_PER_BASE64) + MAX_PAD + 1;
+    size_t nmalloc = (((len * BITS_PER_BYTE) + (BITS_PER_BASE64 - 1)) / BITS_PER_BASE64) + MAX_PAD + 1;
     char *ret = Malloc(nmalloc);
     char *op = ret;
     char c;
@@ -72,10 +72,12 @@ base64_encode(const char *s)
 
 	/* Get the next 3 octets. */
 	for (i = 0; i < BYTES_PER_BLOCK; i++) {
-	    if (!(c = *s++)) {
+	    if (len == 0) {
 		done = true;
 		break;
 	    }
+	    c = *s++;
+	    len--;
 	    accum = (accum << BITS_PER_BYTE) | (unsigned char)c;
 	    held_bits += BITS_PER_BYTE;
 	}
@@ -110,6 +112,17 @@ base64_encode(const char *s)
     return ret;
 }
 
+/*
+ * Encode a string in base64.
+ *
+ * Returns a malloc'd buffer.
+ */
+char *
+base64_encode(const char *s)
+{
+    return base64_encode_buf(s, strlen(s));
+}
+
 /*
  * Decode a base64 string.
  *
@@ -200,6 +213,15 @@ main(int argc, char *argv[])
 	assert (!strcmp(s[i], e));
     }
 
+    {
+	static const char nuls[] = { 'a', '\0', '\0', 'b', '\0', 'c' };
+	char *b = base64_encode_buf(nuls, sizeof(nuls));
+	char *e = base64_decode(b);
+
+	printf("(%u bytes with NULs) -> '%s'\n", (unsigned)sizeof(nuls), b);
+	assert(!memcmp(nuls, e, sizeof(nuls)));
+    }
+
     assert(base64_decode("a=b") == NULL);
     assert(base64_decode("a===") == NULL);
     assert(base64_decode("[") == NULL);
@@ -75,6 +75,7 @@
 #include "kybd.h"
 #include "lazya.h"
 #include "login_macro.h"
+#include "mirror.h"
 #include "model.h"
 #include "names.h"
 #include "nvt.h"
@@ -613,6 +614,7 @@ main(int argc, char *argv[])
     xio_register();
     sio_glue_register();
     hio_register();
+    mirror_register();
     proxy_register();
     model_register();
     net_register();
@@ -112,7 +112,7 @@ static tcb_t script_cb = {
 static tcb_t async_script_cb = {
     "child",
     IA_SCRIPT,
-    CB_NEW_TASKQ,
+    CB_NEW_TASKQ | CB_BULK,
     child_data,
     child_done,
     child_run,
@@ -129,7 +129,7 @@ static tcb_t async_script_cb = {
 static tcb_t child_cb = {
     "child",
     IA_SCRIPT,
-    CB_NEW_TASKQ,
+    CB_NEW_TASKQ | CB_BULK,
     child_data,
     child_done,
     child_run,
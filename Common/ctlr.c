@@ -56,6 +56,7 @@
 #include "host.h"
 #include "kybd.h"
 #include "lazya.h"
+#include "metrics.h"
 #include "popups.h"
 #include "screen.h"
 #include "scroll.h"
@@ -88,6 +89,7 @@ struct ea *ea_buf;		/* 3270 device buffer */
 struct ea *aea_buf;	/* alternate 3270 extended attribute buffer */
 bool formatted = false;	/* set in screen_disp */
 bool screen_changed = false;
+unsigned long screen_generation = 0;	/* bumped on every buffer change */
 int first_changed = -1;
 int last_changed = -1;
 unsigned char reply_mode = SF_SRM_FIELD;
@@ -132,9 +134,11 @@ static unsigned char code_table[64] = {
 
 #define ALL_CHANGED	{ \
 	screen_changed = true; \
+	screen_generation++; \
 	if (IN_NVT) { first_changed = 0; last_changed = ROWS*COLS; } }
 #define REGION_CHANGED(f, l)	{ \
 	screen_changed = true; \
+	screen_generation++; \
 	if (IN_NVT) { \
 	    if (first_changed == -1 || f < first_changed) first_changed = f; \
 	    if (last_changed == -1 || l > last_changed) last_changed = l; } }
@@ -2851,6 +2855,7 @@ mdt_set(int baddr)
     faddr = find_field_attribute(baddr);
     if (faddr >= 0 && !(ea_buf[faddr].fa & FA_MODIFY)) {
 	ea_buf[faddr].fa |= FA_MODIFY;
+	screen_generation++;
 	if (appres.modified_sel) {
 	    ALL_CHANGED;
 	}
@@ -2865,6 +2870,7 @@ mdt_clear(int baddr)
     faddr = find_field_attribute(baddr);
     if (faddr >= 0 && (ea_buf[faddr].fa & FA_MODIFY)) {
 	ea_buf[faddr].fa &= ~FA_MODIFY;
+	screen_generation++;
 	if (appres.modified_sel) {
 	    ALL_CHANGED;
 	}
@@ -2993,6 +2999,9 @@ ticking_stop(struct timeval *tp)
 
     cs = ((tp->tv_sec - t_start.tv_sec) * 1000000L) +
 	(tp->tv_usec - t_start.tv_usec);
+    if (!ticking_anyway) {
+	metrics_observe(MH_HOST_RESPONSE, &t_start, tp);
+    }
     vtrace("Host %s took %ld.%06lds to complete\n",
 	    ticking_anyway? "negotiation step": "operation",
 	    cs / 1000000L,
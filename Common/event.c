@@ -33,6 +33,7 @@
 #include "globals.h"
 
 #include "telnet.h"
+#include "metrics.h"
 #include "trace.h"
 #include "utils.h"
 
@@ -42,6 +43,7 @@ typedef struct st_callback {
     unsigned short order;
 } st_callback_t;
 llist_t st_callbacks[N_ST];
+unsigned long state_generation = 0;	/* bumped on every state change */
 
 static bool schange_initted = false;
 
@@ -123,6 +125,7 @@ st_changed(enum st tx, bool mode)
     struct st_callback *st;
 
     vtrace("st_changed(%s,%s)\n", st_name[tx], mode? "true": "false");
+    state_generation++;
     FOREACH_LLIST(&st_callbacks[tx], st, st_callback_t *) {
 	(*st->func)(mode);
     } FOREACH_LLIST_END(&st_callbacks[tx], st, st_callback_t *);
@@ -141,6 +144,8 @@ change_cstate(enum cstate new_cstate, const char *why)
 	    state_name[new_cstate], why);
 
     cstate = new_cstate;
+    state_generation++;
+    metrics_cstate(old_cstate, new_cstate);
 
     /* Handle connected/not connected separately. */
     if (cCONNECTED(old_cstate) != cCONNECTED(new_cstate) ||
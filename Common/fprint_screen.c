@@ -62,6 +62,7 @@ typedef struct {
     int spp;			/* Screens per page. */
     int screens;		/* Screen count this page. */
     FILE *file;			/* Stream to write to */
+    varbuf_t *vb;		/* Buffer to write to, if file is NULL */
     char *caption;		/* Caption with %T% expanded */
     char *printer_name;		/* Printer name (used by GDI) */
 } real_fps_t;
@@ -199,12 +200,56 @@ html_caption(const char *caption)
 }
 
 /*
- * Write a screen trace header to a stream.
+ * Output functions. These write to the stream, or append to the buffer.
+ * Each returns a negative value for a write error.
+ */
+static int printflike(2, 3)
+fps_printf(real_fps_t *fps, const char *format, ...)
+{
+    va_list ap;
+    int rv;
+
+    va_start(ap, format);
+    if (fps->file != NULL) {
+	rv = vfprintf(fps->file, format, ap);
+    } else {
+	vb_vappendf(fps->vb, format, ap);
+	rv = 0;
+    }
+    va_end(ap);
+    return rv;
+}
+
+static int
+fps_putc(int c, real_fps_t *fps)
+{
+    char cc = (char)c;
+
+    if (fps->file != NULL) {
+	return fputc(c, fps->file);
+    }
+    vb_append(fps->vb, &cc, 1);
+    return c & 0xff;
+}
+
+static int
+fps_write(real_fps_t *fps, const char *buf, size_t len)
+{
+    if (fps->file != NULL) {
+	return (fwrite(buf, len, 1, fps->file) == 1)? 0: -1;
+    }
+    vb_append(fps->vb, buf, len);
+    return 0;
+}
+
+/*
+ * Write a screen trace header to a stream or a buffer.
  * Returns the context to use with subsequent calls.
  */
-fps_status_t
-fprint_screen_start(FILE *f, ptype_t ptype, unsigned opts, const char *caption,
-	const char *printer_name, fps_t *fps_ret, void *wait_context)
+static fps_status_t
+fps_start(FILE *f, varbuf_t *vb, ptype_t ptype, unsigned opts,
+	const char *caption, const char *printer_name, fps_t *fps_ret,
+	void *wait_context)
 {
     real_fps_t *fps;
     int rv = FPS_STATUS_SUCCESS;
@@ -224,6 +269,7 @@ fprint_screen_start(FILE *f, ptype_t ptype, unsigned opts, const char *caption,
     fps->spp = 1;
     fps->screens = 0;
     fps->file = f;
+    fps->vb = vb;
 
     if (caption != NULL) {
 	char *xcaption;
@@ -273,7 +319,7 @@ fprint_screen_start(FILE *f, ptype_t ptype, unsigned opts, const char *caption,
 	    pt_nsize = 8;
 	}
 
-	if (fprintf(f, "{\\rtf1\\ansi\\ansicpg%u\\deff0\\deflang1033{"
+	if (fps_printf(fps, "{\\rtf1\\ansi\\ansicpg%u\\deff0\\deflang1033{"
 		    "\\fonttbl{\\f0\\fmodern\\fprq1\\fcharset0 %s;}}\n"
 		    "\\viewkind4\\uc1\\pard\\f0\\fs%d ",
 #if defined(_WIN32) /*[*/
@@ -287,7 +333,7 @@ fprint_screen_start(FILE *f, ptype_t ptype, unsigned opts, const char *caption,
 	if (rv == FPS_STATUS_SUCCESS && fps->caption != NULL) {
 	    char *hcaption = rtf_caption(fps->caption);
 
-	    if (fprintf(f, "%s\\par\\par\n", hcaption) < 0) {
+	    if (fps_printf(fps, "%s\\par\\par\n", hcaption) < 0) {
 		rv = FPS_STATUS_ERROR;
 	    }
 	    Free(hcaption);
@@ -304,7 +350,7 @@ fprint_screen_start(FILE *f, ptype_t ptype, unsigned opts, const char *caption,
 
 	/* Print the preamble. */
 	if (!(opts & FPS_NO_HEADER) &&
-		fprintf(f, "<html>\n"
+		fps_printf(fps, "<html>\n"
 		   "<head>\n"
 		   " <meta http-equiv=\"Content-Type\" "
 		     "content=\"text/html; charset=UTF-8\">\n"
@@ -313,7 +359,7 @@ fprint_screen_start(FILE *f, ptype_t ptype, unsigned opts, const char *caption,
 	    rv = FPS_STATUS_ERROR;
 	}
 	if (rv == FPS_STATUS_SUCCESS && hcaption) {
-	    if (fprintf(f, "<p>%s</p>\n", hcaption) < 0) {
+	    if (fps_printf(fps, "<p>%s</p>\n", hcaption) < 0) {
 		rv = FPS_STATUS_ERROR;
 	    }
 	    Free(hcaption);
@@ -322,7 +368,7 @@ fprint_screen_start(FILE *f, ptype_t ptype, unsigned opts, const char *caption,
     }
     case P_TEXT:
 	if (fps->caption != NULL) {
-	    if (fprintf(f, "%s\n\n", fps->caption) < 0) {
+	    if (fps_printf(fps, "%s\n\n", fps->caption) < 0) {
 		rv = FPS_STATUS_ERROR;
 	    }
 	}
@@ -373,11 +419,45 @@ fprint_screen_start(FILE *f, ptype_t ptype, unsigned opts, const char *caption,
     return rv;
 }
 
+/*
+ * Write a screen trace header to a stream.
+ * Returns the context to use with subsequent calls.
+ */
+fps_status_t
+fprint_screen_start(FILE *f, ptype_t ptype, unsigned opts, const char *caption,
+	const char *printer_name, fps_t *fps_ret, void *wait_context)
+{
+    return fps_start(f, NULL, ptype, opts, caption, printer_name, fps_ret,
+	    wait_context);
+}
+
 #define FAIL do { \
     rv = -1; \
     goto done; \
 } while(false)
 
+/*
+ * Write out the pending text for a row, translated to the local multi-byte
+ * encoding in one go.
+ * Returns 0 for success, -1 for a write error.
+ */
+static int
+flush_text(real_fps_t *fps, const ucs4_t *text, size_t *ntextp, char *mb,
+	size_t mb_len)
+{
+    size_t nmb;
+
+    if (*ntextp == 0) {
+	return 0;
+    }
+    nmb = unicode_to_multibyte_string(text, *ntextp, mb, mb_len);
+    *ntextp = 0;
+    if (nmb && fps_write(fps, mb, nmb) < 0) {
+	return -1;
+    }
+    return 0;
+}
+
 /*
  * Add a screen image to a stream.
  *
@@ -403,6 +483,11 @@ fprint_screen_body(fps_t ofps)
     gdi_header_t h;
 #endif /*]*/
     fps_status_t rv = FPS_STATUS_SUCCESS;
+    ucs4_t *text = NULL;
+    size_t ntext = 0;
+    char *text_mb = NULL;
+    ucs4_t *row_uc = NULL;
+    size_t text_mb_len = 0;
 
     /* Quick short-circuit. */
     if (fps == NULL || fps->broken) {
@@ -437,24 +522,24 @@ fprint_screen_body(fps_t ofps)
     case P_RTF:
 	if (fps->need_separator) {
 	    if (fps->screens < fps->spp) {
-		if (fprintf(fps->file, "\\par\n") < 0) {
+		if (fps_printf(fps, "\\par\n") < 0) {
 		    FAIL;
 		}
 	    } else {
-		if (fprintf(fps->file, "\n\\page\n") < 0) {
+		if (fps_printf(fps, "\n\\page\n") < 0) {
 		    FAIL;
 		}
 		fps->screens = 0;
 	    }
 	}
 	if (current_high) {
-	    if (fprintf(fps->file, "\\b ") < 0) {
+	    if (fps_printf(fps, "\\b ") < 0) {
 		FAIL;
 	    }
 	}
 	break;
     case P_HTML:
-	if (fprintf(fps->file, "  <table border=0>"
+	if (fps_printf(fps, "  <table border=0>"
 	       "<tr bgcolor=black><td>"
 	       "<pre><span style=\"color:%s;"
 				   "background:%s;"
@@ -470,17 +555,17 @@ fprint_screen_body(fps_t ofps)
     case P_TEXT:
 	if (fps->need_separator) {
 	    if ((fps->opts & FPS_FF_SEP) && fps->screens >= fps->spp) {
-		if (fputc('\f', fps->file) < 0) {
+		if (fps_putc('\f', fps) < 0) {
 		    FAIL;
 		}
 		fps->screens = 0;
 	    } else {
 		for (i = 0; i < COLS; i++) {
-		    if (fputc('=', fps->file) < 0) {
+		    if (fps_putc('=', fps) < 0) {
 			FAIL;
 		    }
 		}
-		if (fputc('\n', fps->file) < 0) {
+		if (fps_putc('\n', fps) < 0) {
 		    FAIL;
 		}
 	    }
@@ -512,15 +597,28 @@ fprint_screen_body(fps_t ofps)
 
     fps->need_separator = false;
 
+    /* EBCDIC is translated a row at a time. */
+    row_uc = (ucs4_t *)Malloc(COLS * sizeof(ucs4_t));
+
+    /* Text is output a row at a time. */
+    if (fps->ptype == P_TEXT) {
+	text = (ucs4_t *)Malloc(COLS * sizeof(ucs4_t));
+	text_mb_len = mb_max_len(COLS);
+	text_mb = Malloc(text_mb_len);
+    }
+
     for (i = 0; i < ROWS*COLS; i++) {
 	char mb[16];
 	int nmb;
 
 	uc = 0;
 
+	if (!(i % COLS)) {
+	    ebcdic_to_unicode_row(&ea_buf[i], COLS, EUO_NONE, row_uc);
+	}
 	if (i && !(i % COLS)) {
 	    if (fps->ptype == P_HTML) {
-		if (fputc('\n', fps->file) < 0) {
+		if (fps_putc('\n', fps) < 0) {
 		    FAIL;
 		}
 	    } else {
@@ -564,7 +662,7 @@ fprint_screen_body(fps_t ofps)
 	    switch (ctlr_dbcs_state(i)) {
 	    case DBCS_NONE:
 	    case DBCS_SB:
-		uc = ebcdic_to_unicode(ea_buf[i].ec, ea_buf[i].cs, EUO_NONE);
+		uc = row_uc[i % COLS];
 		if (uc == 0) {
 		    uc = ' ';
 		}
@@ -590,32 +688,34 @@ fprint_screen_body(fps_t ofps)
 	    ns++;
 	} else if (uc == 0x3000) {
 	    if (fps->ptype == P_HTML) {
-		if (fprintf(fps->file, "  ") < 0) {
+		if (fps_printf(fps, "  ") < 0) {
 		    FAIL;
 		}
 	    } else {
 		ns += 2;
 	    }
 	} else {
+	    if (nr && flush_text(fps, text, &ntext, text_mb,
+			text_mb_len) < 0) {
+		FAIL;
+	    }
 	    while (nr) {
 		if (fps->ptype == P_RTF)
-		    if (fprintf(fps->file, "\\par") < 0) {
+		    if (fps_printf(fps, "\\par") < 0) {
 			FAIL;
 		    }
-		if (fputc('\n', fps->file) < 0) {
+		if (fps_putc('\n', fps) < 0) {
 		    FAIL;
 		}
 		nr--;
 	    }
 	    while (ns) {
 		if (fps->ptype == P_RTF) {
-		    if (fprintf(fps->file, "\\~") < 0) {
+		    if (fps_printf(fps, "\\~") < 0) {
 			FAIL;
 		    }
 		} else {
-		    if (fputc(' ', fps->file) < 0) {
-			FAIL;
-		    }
+		    text[ntext++] = ' ';
 		}
 		ns--;
 	    }
@@ -629,11 +729,11 @@ fprint_screen_body(fps_t ofps)
 		}
 		if (high != current_high) {
 		    if (high) {
-			if (fprintf(fps->file, "\\b ") < 0) {
+			if (fps_printf(fps, "\\b ") < 0) {
 			    FAIL;
 			}
 		    } else {
-			if (fprintf(fps->file, "\\b0 ") < 0) {
+			if (fps_printf(fps, "\\b0 ") < 0) {
 			    FAIL;
 			}
 		    }
@@ -677,7 +777,7 @@ fprint_screen_body(fps_t ofps)
 		    bg_color != current_bg ||
 		    high != current_high ||
 		    fa_ital != current_ital) {
-		    if (fprintf(fps->file,
+		    if (fps_printf(fps,
 				"</span><span "
 				"style=\"color:%s;"
 				"background:%s;"
@@ -698,40 +798,40 @@ fprint_screen_body(fps_t ofps)
 	    any = true;
 	    if (fps->ptype == P_RTF) {
 		if (uc & ~0x7f) {
-		    if (fprintf(fps->file, "\\u%u?", uc) < 0) {
+		    if (fps_printf(fps, "\\u%u?", uc) < 0) {
 			FAIL;
 		    }
 		} else {
 		    nmb = unicode_to_multibyte(uc, mb, sizeof(mb));
 		    if (mb[0] == '\\' || mb[0] == '{' || mb[0] == '}') {
-			if (fprintf(fps->file, "\\%c", mb[0]) < 0) {
+			if (fps_printf(fps, "\\%c", mb[0]) < 0) {
 			    FAIL;
 			}
 		    } else if (mb[0] == '-') {
-			if (fprintf(fps->file, "\\_") < 0) {
+			if (fps_printf(fps, "\\_") < 0) {
 			    FAIL;
 			}
 		    } else if (mb[0] == ' ') {
-			if (fprintf(fps->file, "\\~") < 0) {
+			if (fps_printf(fps, "\\~") < 0) {
 			    FAIL;
 			}
 		    } else {
-			if (fputc(mb[0], fps->file) < 0) {
+			if (fps_putc(mb[0], fps) < 0) {
 			    FAIL;
 			}
 		    }
 		}
 	    } else if (fps->ptype == P_HTML) {
 		if (uc == '<') {
-		    if (fprintf(fps->file, "&lt;") < 0) {
+		    if (fps_printf(fps, "&lt;") < 0) {
 			FAIL;
 		    }
 		} else if (uc == '&') {
-		    if (fprintf(fps->file, "&amp;") < 0) {
+		    if (fps_printf(fps, "&amp;") < 0) {
 			FAIL;
 		    }
 		} else if (uc == '>') {
-		    if (fprintf(fps->file, "&gt;") < 0) {
+		    if (fps_printf(fps, "&gt;") < 0) {
 			FAIL;
 		    }
 		} else {
@@ -740,46 +840,46 @@ fprint_screen_body(fps_t ofps)
 			int k;
 
 			for (k = 0; k < nmb; k++) {
-			    if (fputc(mb[k], fps->file) < 0) {
+			    if (fps_putc(mb[k], fps) < 0) {
 				FAIL;
 			    }
 			}
 		    }
 		}
 	    } else {
-		nmb = unicode_to_multibyte(uc, mb, sizeof(mb));
-		if (fputs(mb, fps->file) < 0) {
-		    FAIL;
-		}
+		text[ntext++] = uc;
 	    }
 	}
     }
+    if (flush_text(fps, text, &ntext, text_mb, text_mb_len) < 0) {
+	FAIL;
+    }
 
     if (fps->ptype == P_HTML) {
-	if (fputc('\n', fps->file) < 0) {
+	if (fps_putc('\n', fps) < 0) {
 	    FAIL;
 	}
     } else {
 	nr++;
     }
     if (!any && !(fps->opts & FPS_EVEN_IF_EMPTY) && fps->ptype == P_TEXT) {
-	return FPS_STATUS_SUCCESS;
+	goto done;
     }
     while (nr) {
 	if (fps->ptype == P_RTF) {
-	    if (fprintf(fps->file, "\\par") < 0) {
+	    if (fps_printf(fps, "\\par") < 0) {
 		FAIL;
 	    }
 	}
 	if (fps->ptype == P_TEXT) {
-	    if (fputc('\n', fps->file) < 0) {
+	    if (fps_putc('\n', fps) < 0) {
 		FAIL;
 	    }
 	}
 	nr--;
     }
     if (fps->ptype == P_HTML) {
-	if (fprintf(fps->file, "%s</span></pre></td></tr>\n  </table>\n",
+	if (fps_printf(fps, "%s</span></pre></td></tr>\n  </table>\n",
 		    current_high? "</b>": "") < 0) {
 	    FAIL;
 	}
@@ -789,6 +889,9 @@ fprint_screen_body(fps_t ofps)
     rv = FPS_STATUS_SUCCESS_WRITTEN; /* wrote a screen */
 
 done:
+    Free(text);
+    Free(text_mb);
+    Free(row_uc);
     if (FPS_IS_ERROR(rv)) {
 	fps->broken = true;
     }
@@ -814,13 +917,13 @@ fprint_screen_done(fps_t *ofps)
     if (!fps->broken) {
 	switch (fps->ptype) {
 	case P_RTF:
-	    if (fprintf(fps->file, "\n}\n%c", 0) < 0) {
+	    if (fps_printf(fps, "\n}\n%c", 0) < 0) {
 		rv = FPS_STATUS_ERROR;
 	    }
 	    break;
 	case P_HTML:
 	    if (!(fps->opts & FPS_NO_HEADER) &&
-		    fprintf(fps->file, " </body>\n</html>\n") < 0) {
+		    fps_printf(fps, " </body>\n</html>\n") < 0) {
 		rv = FPS_STATUS_ERROR;
 	    }
 	    break;
@@ -847,6 +950,27 @@ fprint_screen_done(fps_t *ofps)
     return rv;
 }
 
+/*
+ * Write a header, screen image, and trailer, given an open context.
+ */
+static fps_status_t
+fps_complete(fps_t fps)
+{
+    fps_status_t srv;
+    fps_status_t srv_body;
+
+    srv_body = fprint_screen_body(fps);
+    if (FPS_IS_ERROR(srv_body)) {
+	fprint_screen_done(&fps);
+	return srv_body;
+    }
+    srv = fprint_screen_done(&fps);
+    if (FPS_IS_ERROR(srv)) {
+	return srv;
+    }
+    return srv_body;
+}
+
 /*
  * Write a header, screen image, and trailer to a file.
  */
@@ -856,21 +980,30 @@ fprint_screen(FILE *f, ptype_t ptype, unsigned opts, const char *caption,
 {
     fps_t fps;
     fps_status_t srv;
-    fps_status_t srv_body;
 
     srv = fprint_screen_start(f, ptype, opts, caption, printer_name, &fps,
 	    wait_context);
     if (FPS_IS_ERROR(srv) || srv == FPS_STATUS_WAIT) {
 	return srv;
     }
-    srv_body = fprint_screen_body(fps);
-    if (FPS_IS_ERROR(srv_body)) {
-	fprint_screen_done(&fps);
-	return srv_body;
-    }
-    srv = fprint_screen_done(&fps);
+    return fps_complete(fps);
+}
+
+/*
+ * Write a header, screen image, and trailer to a buffer, which must already
+ * be initialized.
+ */
+fps_status_t
+fprint_screen_vb(struct varbuf *vb, ptype_t ptype, unsigned opts,
+	const char *caption)
+{
+    fps_t fps;
+    fps_status_t srv;
+
+    assert(ptype != P_GDI);
+    srv = fps_start(NULL, vb, ptype, opts, caption, NULL, &fps, NULL);
     if (FPS_IS_ERROR(srv)) {
 	return srv;
     }
-    return srv_body;
+    return fps_complete(fps);
 }
@@ -40,6 +40,7 @@
 
 #include "appres.h"
 #include "actions.h"
+#include "ft_conv.h"
 #include "ft_cut.h"
 #include "ft_dft.h"
 #include "ft_private.h" /* must precede ft_gui.h */
@@ -755,6 +756,7 @@ ft_go(ft_conf_t *p, enum iaction cause)
     fts.is_cut = false;
     fts.last_dbcs = false;
     fts.dbcs_state = FT_DBCS_NONE;
+    ft_conv_init();
 
     ft_state = FT_AWAIT_ACK;
     ft_cause = cause;
@@ -1176,6 +1178,19 @@ ft_ebcdic_to_multibyte(ebc_t ebc, char mb[], size_t mb_len)
     return rc;
 }
 
+size_t
+ft_ebcdic_to_multibyte_string(const unsigned char *ebc, size_t ebc_len,
+	char mb[], size_t mb_len)
+{
+    int local_cp = appres.local_cp;
+    size_t rc;
+
+    appres.local_cp = ftc->windows_codepage;
+    rc = ebcdic_to_multibyte_string(ebc, ebc_len, mb, mb_len);
+    appres.local_cp = local_cp;
+    return rc;
+}
+
 int
 ft_unicode_to_multibyte(ucs4_t ucs4, char *mb, size_t mb_len)
 {
@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2020 Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	ft_conv.c
+ *		ASCII-mode file transfer data conversion, shared by DFT and CUT
+ *		transfers.
+ *
+ * The host uses a fixed EBCDIC-to-ASCII translation table, which was derived
+ * empirically into i_ft2asc/i_asc2ft. Data is translated by inverting that
+ * table and applying the local code page. The translation of each byte
+ * depends only on the transfer options, so it is computed once when the
+ * transfer starts; only DBCS and multi-byte characters need the general
+ * code. Runs of printable ASCII that translate to themselves are copied
+ * eight bytes at a time.
+ */
+
+#include "globals.h"
+
+#include "3270ds.h"
+#include "ft_conv.h"
+#include "ft_private.h"
+#include "unicodec.h"
+#include "ft.h"
+
+/* Host-to-local translation of each byte. */
+typedef struct {
+    unsigned char len;	/* length of the translation, or TL_SLOW */
+    char bytes[7];	/* translation */
+} to_local_t;
+#define TL_SLOW		0xff
+static to_local_t to_local[256];
+static bool to_local_copy;	/* printable ASCII translates to itself */
+
+/* Local-to-host translation of each byte, or TH_SLOW. */
+#define TH_SLOW		(-1)
+static short to_host[256];
+static bool to_host_copy;	/* printable ASCII translates to itself */
+
+/* Local file input buffer. */
+#define INBUF_SIZE	8192
+#define MB_MAX		16	/* longest multi-byte character */
+static struct {
+    unsigned char buf[INBUF_SIZE];
+    size_t pos;
+    size_t len;
+    bool eof;
+} in;
+
+/* Tests for eight bytes of printable ASCII (0x20 through 0x7e). */
+#define LOW_BITS	0x0101010101010101ULL
+#define HIGH_BITS	0x8080808080808080ULL
+#define ALL_PRINTABLE(w) \
+    (!(((((w) - 0x20 * LOW_BITS) & ~(w)) | ((w) + LOW_BITS) | (w)) & \
+       HIGH_BITS))
+
+/*
+ * Translate one byte from the host to local multi-byte, following the DBCS
+ * state in fts.
+ * Returns the number of bytes stored.
+ */
+static size_t
+to_local_char(unsigned char c, char *ob, size_t ob_len)
+{
+    size_t nx;
+
+    /* Strip CR's and ^Z's. */
+    if (ftc->cr_flag && (c == '\r' || c == 0x1a)) {
+	return 0;
+    }
+
+    if (!ftc->remap_flag) {
+	if (!ob_len) {
+	    return 0;
+	}
+	*ob = c;
+	return 1;
+    }
+
+    /*
+     * Convert to local multi-byte.
+     * We do that by inverting the host's EBCDIC-to-ASCII map, getting back
+     * to EBCDIC, and converting to multi-byte from there.
+     */
+    switch (fts.dbcs_state) {
+    case FT_DBCS_NONE:
+	if (c == EBC_so) {
+	    fts.dbcs_state = FT_DBCS_SO;
+	    return 0;
+	}
+	/* fall through to non-DBCS case below */
+	break;
+    case FT_DBCS_SO:
+	if (c == EBC_si) {
+	    fts.dbcs_state = FT_DBCS_NONE;
+	} else {
+	    fts.dbcs_byte1 = i_asc2ft[c];
+	    fts.dbcs_state = FT_DBCS_LEFT;
+	}
+	return 0;
+    case FT_DBCS_LEFT:
+	if (c == EBC_si) {
+	    fts.dbcs_state = FT_DBCS_NONE;
+	    return 0;
+	}
+	nx = ft_ebcdic_to_multibyte((fts.dbcs_byte1 << 8) | i_asc2ft[c], ob,
+		ob_len);
+	if (nx && (ob[nx - 1] == '\0')) {
+	    nx--;
+	}
+	fts.dbcs_state = FT_DBCS_SO;
+	return nx;
+    }
+
+    if (c < 0x20 || (c >= 0x80 && c < 0xa0 && c != 0x9f)) {
+	/*
+	 * Control code, treat it as Unicode.
+	 *
+	 * Note that IND$FILE and the VM 'TYPE' command think that EBCDIC
+	 * X'E1' is a control code; IND$FILE maps it onto ASCII 0x9f.  So we
+	 * skip it explicitly and treat it as printable here.
+	 */
+	nx = ft_unicode_to_multibyte(c, ob, ob_len);
+    } else if (c == 0xff) {
+	/* IND$FILE maps X'FF' to 0xff. We want U+009F. */
+	nx = ft_unicode_to_multibyte(0x9f, ob, ob_len);
+    } else {
+	/* Displayable character, remap. */
+	nx = ft_ebcdic_to_multibyte(i_asc2ft[c], ob, ob_len);
+    }
+    if (nx && (ob[nx - 1] == '\0')) {
+	nx--;
+    }
+    return nx;
+}
+
+/*
+ * Translate one character from the local file to the host.
+ * Returns the number of bytes stored in 'ob', and the number of bytes of
+ * input used in '*consumed'. If there is no room for the translation, returns
+ * 0 and sets '*consumed' to 0.
+ */
+static size_t
+to_host_char(const unsigned char *buf, size_t len, unsigned char *ob,
+	size_t ob_len, size_t *consumed)
+{
+    unsigned char xb[3];
+    size_t nx = 0;
+    bool dbcs = false;
+    int nc = 1;
+    ucs4_t u;
+    ebc_t e;
+
+    *consumed = 0;
+    if (ftc->remap_flag) {
+	enum me_fail error = ME_NONE;
+
+	u = ft_multibyte_to_unicode((const char *)buf, len, &nc, &error);
+	if (error == ME_SHORT) {
+	    /* Incomplete character at the end of the file. */
+	    *consumed = len;
+	    return 0;
+	}
+	if (error == ME_INVALID) {
+	    u = '?';
+	    nc = 1;
+	} else if (nc <= 0) {
+	    /* mbtowc() counts a NUL as zero bytes. */
+	    nc = 1;
+	}
+    } else {
+	u = *buf;
+    }
+
+    if (ftc->cr_flag && !fts.last_cr && u == '\n') {
+	/* Expand NL to CR/LF. */
+	if (fts.last_dbcs) {
+	    xb[nx++] = EBC_si;
+	}
+	xb[nx++] = '\r';
+	xb[nx++] = '\n';
+    } else if (!ftc->remap_flag) {
+	xb[nx++] = u;
+    } else {
+	/*
+	 * Translate, inverting the host's fixed EBCDIC-to-ASCII conversion
+	 * table and applying the host code page.
+	 * Control codes are treated as Unicode and mapped directly.
+	 *
+	 * DBCS is a guess at this point, assuming that SO and SI are
+	 * unmodified by IND$FILE.
+	 */
+	if (u < 0x20 || (u >= 0x80 && u < 0x9f)) {
+	    e = i_asc2ft[u];
+	} else if (u == 0x9f) {
+	    e = 0xff;
+	} else {
+	    e = unicode_to_ebcdic(u);
+	}
+	if (e & 0xff00) {
+	    if (!fts.last_dbcs) {
+		xb[nx++] = EBC_so;
+	    }
+	    xb[nx++] = i_ft2asc[(e >> 8) & 0xff];
+	    xb[nx++] = i_ft2asc[e & 0xff];
+	    dbcs = true;
+	} else {
+	    if (fts.last_dbcs) {
+		xb[nx++] = EBC_si;
+	    }
+	    /* CUT sends NULs specially; DFT sends a '?'. */
+	    xb[nx++] = (e || (!u && fts.is_cut))? i_ft2asc[e]: '?';
+	}
+    }
+
+    if (nx > ob_len) {
+	return 0;
+    }
+    memcpy(ob, xb, nx);
+    fts.last_cr = (u == '\r');
+    fts.last_dbcs = dbcs;
+    *consumed = nc;
+    return nx;
+}
+
+/*
+ * Set up the conversion tables for a new transfer. Called from ft_go() once
+ * the transfer options are known.
+ */
+void
+ft_conv_init(void)
+{
+    int c;
+
+    to_local_copy = true;
+    to_host_copy = true;
+    for (c = 0; c < 256; c++) {
+	char mb[MB_MAX];
+	unsigned char hb[3];
+	size_t nx;
+	size_t consumed;
+
+	/* Host to local. SO changes the state, so it cannot be tabulated. */
+	if (ftc->remap_flag && c == EBC_so) {
+	    to_local[c].len = TL_SLOW;
+	} else {
+	    nx = to_local_char(c, mb, sizeof(mb));
+	    if (nx > sizeof(to_local[c].bytes)) {
+		to_local[c].len = TL_SLOW;
+	    } else {
+		to_local[c].len = (unsigned char)nx;
+		memcpy(to_local[c].bytes, mb, nx);
+	    }
+	}
+	if (c >= 0x20 && c < 0x7f &&
+		(to_local[c].len != 1 || to_local[c].bytes[0] != c)) {
+	    to_local_copy = false;
+	}
+
+	/*
+	 * Local to host. Bytes that start multi-byte characters, translate
+	 * to DBCS, expand NL or depend on the protocol are left to the
+	 * general code.
+	 */
+	hb[0] = c;
+	fts.last_cr = false;
+	fts.last_dbcs = false;
+	if (c == '\0' || (ftc->cr_flag && c == '\n')) {
+	    to_host[c] = TH_SLOW;
+	} else {
+	    nx = to_host_char(hb, 1, hb, sizeof(hb), &consumed);
+	    to_host[c] = (nx == 1 && !fts.last_dbcs)? hb[0]: TH_SLOW;
+	}
+	if (c >= 0x20 && c < 0x7f && to_host[c] != c) {
+	    to_host_copy = false;
+	}
+    }
+    fts.last_cr = false;
+    fts.last_dbcs = false;
+
+    in.pos = 0;
+    in.len = 0;
+    in.eof = false;
+}
+
+/*
+ * Translate data from the host for the local file.
+ * Returns the number of bytes stored in 'ob'. Stops early if 'ob' fills up.
+ */
+size_t
+ft_conv_to_local(const unsigned char *buf, size_t len, char *ob,
+	size_t ob_len)
+{
+    char *ob0 = ob;
+
+    while (len && ob_len) {
+	const to_local_t *x;
+	size_t nx;
+
+	/* Copy printable ASCII eight bytes at a time. */
+	if (to_local_copy && fts.dbcs_state == FT_DBCS_NONE) {
+	    while (len >= 8 && ob_len >= 8) {
+		uint64_t w;
+
+		memcpy(&w, buf, sizeof(w));
+		if (!ALL_PRINTABLE(w)) {
+		    break;
+		}
+		memcpy(ob, buf, sizeof(w));
+		buf += 8;
+		len -= 8;
+		ob += 8;
+		ob_len -= 8;
+	    }
+	    if (!len || !ob_len) {
+		break;
+	    }
+	}
+
+	x = &to_local[*buf];
+	if (fts.dbcs_state == FT_DBCS_NONE && x->len != TL_SLOW) {
+	    if (x->len > ob_len) {
+		break;
+	    }
+	    memcpy(ob, x->bytes, x->len);
+	    nx = x->len;
+	} else {
+	    nx = to_local_char(*buf, ob, ob_len);
+	}
+	buf++;
+	len--;
+	ob += nx;
+	ob_len -= nx;
+    }
+
+    return ob - ob0;
+}
+
+/*
+ * Read data from the local file and translate it for the host.
+ * Returns the number of bytes stored in 'ob', and the number of bytes read
+ * from the file in '*nread'. Stops before a character that does not fit.
+ * Returns (size_t)-1 at the end of the file.
+ */
+size_t
+ft_conv_read(unsigned char *ob, size_t ob_len, size_t *nread)
+{
+    size_t n = 0;
+
+    *nread = 0;
+    while (n < ob_len) {
+	size_t avail = in.len - in.pos;
+	size_t consumed;
+	size_t nx;
+	int t;
+
+	/* Keep at least one whole character buffered. */
+	if (avail < MB_MAX && !in.eof) {
+	    size_t nr;
+
+	    memmove(in.buf, in.buf + in.pos, avail);
+	    in.pos = 0;
+	    in.len = avail;
+	    nr = fread(in.buf + in.len, 1, sizeof(in.buf) - in.len,
+		    fts.local_file);
+	    if (nr == 0) {
+		/* The caller checks for errors. */
+		in.eof = true;
+	    }
+	    in.len += nr;
+	    avail = in.len;
+	}
+	if (!avail) {
+	    if (fts.last_dbcs) {
+		ob[n++] = EBC_si;
+		fts.last_dbcs = false;
+	    }
+	    break;
+	}
+
+	/* Copy printable ASCII eight bytes at a time. */
+	if (to_host_copy && !fts.last_dbcs) {
+	    const unsigned char *p = in.buf + in.pos;
+	    size_t run = 0;
+
+	    while (avail - run >= 8 && ob_len - n - run >= 8) {
+		uint64_t w;
+
+		memcpy(&w, p + run, sizeof(w));
+		if (!ALL_PRINTABLE(w)) {
+		    break;
+		}
+		run += 8;
+	    }
+	    if (run) {
+		memcpy(ob + n, p, run);
+		n += run;
+		in.pos += run;
+		*nread += run;
+		fts.last_cr = false;
+		continue;
+	    }
+	}
+
+	t = to_host[in.buf[in.pos]];
+	if (t != TH_SLOW && !fts.last_dbcs) {
+	    fts.last_cr = (in.buf[in.pos] == '\r');
+	    ob[n++] = t;
+	    in.pos++;
+	    (*nread)++;
+	    continue;
+	}
+
+	nx = to_host_char(in.buf + in.pos, avail, ob + n, ob_len - n,
+		&consumed);
+	if (!consumed) {
+	    break;
+	}
+	n += nx;
+	in.pos += consumed;
+	*nread += consumed;
+    }
+
+    if (!n && in.eof && in.pos == in.len) {
+	return (size_t)-1;
+    }
+    return n;
+}
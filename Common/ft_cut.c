@@ -39,6 +39,7 @@
 
 #include "actions.h"
 #include "ctlrc.h"
+#include "ft_conv.h"
 #include "ft_cut.h"
 #include "ft_cut_ds.h"
 #include "ft_private.h"
@@ -128,6 +129,7 @@ static int xlate_getc(void);
 
 /*
  * Convert a buffer for uploading (host->local).
+ * The buffer is decoded to the host's ASCII in place, then translated.
  * Returns the length of the converted data.
  * If there is a conversion error, calls cut_abort() and returns -1.
  */
@@ -135,11 +137,10 @@ static int
 upload_convert(unsigned char *buf, int len, unsigned char *obuf,
 	size_t obuf_len)
 {
-    unsigned char *ob0 = obuf;
-    unsigned char *ob = ob0;
-    size_t nx;
+    unsigned char *hb = buf;
+    size_t nh = 0;
 
-    while (len-- && obuf_len) {
+    while (len--) {
 	unsigned char c = *buf++;
 	char *ixp;
 	size_t ix;
@@ -186,80 +187,18 @@ upload_convert(unsigned char *buf, int len, unsigned char *obuf,
 	}
 
 	/* Map it. */
-	c = conv[quadrant].xlate[ix];
-	if (ftc->ascii_flag && ftc->cr_flag && (c == '\r' || c == 0x1a)) {
-	    continue;
-	}
-	if (!(ftc->ascii_flag && ftc->remap_flag)) {
-	    /* No further translation necessary. */
-	    *ob++ = c;
-	    obuf_len--;
-	    continue;
-	}
-
-	/*
-	 * Convert to local multi-byte.
-	 * We do that by inverting the host's EBCDIC-to-ASCII map,
-	 * getting back to EBCDIC, and converting to multi-byte from
-	 * there.
-	 */
-	switch (fts.dbcs_state) {
-	case FT_DBCS_NONE:
-	    if (c == EBC_so) {
-		fts.dbcs_state = FT_DBCS_SO;
-		continue;
-	    }
-	    /* fall through to non-DBCS case below */
-	    break;
-	case FT_DBCS_SO:
-	    if (c == EBC_si) {
-		fts.dbcs_state = FT_DBCS_NONE;
-	    } else {
-		fts.dbcs_byte1 = i_asc2ft[c];
-		fts.dbcs_state = FT_DBCS_LEFT;
-	    }
-	    continue;
-	case FT_DBCS_LEFT:
-	    if (c == EBC_si) {
-		fts.dbcs_state = FT_DBCS_NONE;
-		continue;
-	    }
-	    nx = ft_ebcdic_to_multibyte((fts.dbcs_byte1 << 8) | i_asc2ft[c],
-		    (char *)ob, obuf_len);
-	    if (nx && (ob[nx - 1] == '\0')) {
-		nx--;
-	    }
-	    ob += nx;
-	    obuf_len -= nx;
-	    fts.dbcs_state = FT_DBCS_SO;
-	    continue;
-	}
-
-	if (c < 0x20 || ((c >= 0x80 && c < 0xa0 && c != 0x9f))) {
-	    /*
-	     * Control code, treat it as Unicode.
-	     *
-	     * Note that IND$FILE and the VM 'TYPE' command think
-	     * that EBCDIC X'E1' is a control code; IND$FILE maps
-	     * it onto ASCII 0x9f.  So we skip it explicitly and
-	     * treat it as printable here.
-	     */
-	    nx = ft_unicode_to_multibyte(c, (char *)ob, obuf_len);
-	} else if (c == 0xff) {
-	    nx = ft_unicode_to_multibyte(0x9f, (char *)ob, obuf_len);
-	} else {
-	    /* Displayable character, remap. */
-	    c = i_asc2ft[c];
-	    nx = ft_ebcdic_to_multibyte(c, (char *)ob, obuf_len);
-	}
-	if (nx && (ob[nx - 1] == '\0')) {
-	    nx--;
-	}
-	ob += nx;
-	obuf_len -= nx;
+	hb[nh++] = conv[quadrant].xlate[ix];
     }
 
-    return (int)(ob - ob0);
+    /* Translate it. */
+    if (ftc->ascii_flag) {
+	return (int)ft_conv_to_local(hb, nh, (char *)obuf, obuf_len);
+    }
+    if (nh > obuf_len) {
+	nh = obuf_len;
+    }
+    memcpy(obuf, hb, nh);
+    return (int)nh;
 }
 
 /*
@@ -303,82 +242,30 @@ store_download(unsigned char c, unsigned char *ob)
     return 0;
 }
 
-/* Convert a buffer for downloading (local->host). */
+/*
+ * Encode a buffer for downloading (local->host). The data has already been
+ * translated to the host's ASCII.
+ */
 static size_t
 download_convert(unsigned const char *buf, unsigned len, unsigned char *xobuf)
 {
     unsigned char *ob0 = xobuf;
     unsigned char *ob = ob0;
 
-    while (len) {
-	unsigned char c = *buf;
-	int consumed;
-	enum me_fail error;
-	ebc_t e;
-	ucs4_t u;
+    while (len--) {
+	unsigned char c = *buf++;
 
 	/* Handle nulls separately. */
 	if (!c) {
-	    if (fts.last_dbcs) {
-		ob += store_download(EBC_si, ob);
-		fts.last_dbcs = false;
-	    }
 	    if (quadrant != OTHER_2) {
 		quadrant = OTHER_2;
 		*ob++ = conv[quadrant].selector;
 	    }
 	    *ob++ = XLATE_NULL;
-	    buf++;
-	    len--;
-	    continue;
-	}
-
-	if (!(ftc->ascii_flag && ftc->remap_flag)) {
-	    ob += store_download(c, ob);
-	    buf++;
-	    len--;
 	    continue;
 	}
 
-	/*
-	 * Translate.
-	 *
-	 * The host uses a fixed EBCDIC-to-ASCII translation table,
-	 * which was derived empirically into i_ft2asc/i_asc2ft.
-	 * Invert that so that when the host applies its conversion,
-	 * it gets the right EBCDIC code.
-	 *
-	 * DBCS is a guess at this point, assuming that SO and SI
-	 * are unmodified by IND$FILE.
-	 */
-	u = ft_multibyte_to_unicode((const char *)buf, len, &consumed, &error);
-	if (u < 0x20 || ((u >= 0x80 && u < 0x9f))) {
-	    e = i_asc2ft[u];
-	} else if (u == 0x9f) {
-	    e = 0xff;
-	} else {
-	    e = unicode_to_ebcdic(u);
-	}
-	if (e & 0xff00) {
-	    if (!fts.last_dbcs) {
-		ob += store_download(EBC_so, ob);
-	    }
-	    ob += store_download(i_ft2asc[(e >> 8) & 0xff], ob);
-	    ob += store_download(i_ft2asc[e & 0xff], ob);
-	    fts.last_dbcs = true;
-	} else {
-	    if (fts.last_dbcs) {
-		ob += store_download(EBC_si, ob);
-		fts.last_dbcs = false;
-	    }
-	    if (e == 0) {
-		ob += store_download('?', ob);
-	    } else {
-		ob += store_download(i_ft2asc[e], ob);
-	    }
-	}
-	buf += consumed;
-	len -= consumed;
+	ob += store_download(c, ob);
     }
 
     return ob - ob0;
@@ -452,19 +339,14 @@ cut_control_code(void)
 	    buf = saved_errmsg;
 	    saved_errmsg = NULL;
 	} else {
-	    size_t mb_len = 161;
+	    unsigned char ebc[80];
+	    size_t mb_len = mb_max_len(80);
 
-	    bp = buf = Malloc(mb_len);
+	    buf = Malloc(mb_len);
 	    for (i = 0; i < 80; i++) {
-		size_t xlen;
-
-		xlen = ft_ebcdic_to_multibyte(ea_buf[O_CC_MESSAGE + i].ec, bp,
-			mb_len);
-		if (xlen) {
-		    bp += xlen - 1;
-		    mb_len -= xlen - 1;
-		}
+		ebc[i] = ea_buf[O_CC_MESSAGE + i].ec;
 	    }
+	    bp = buf + ft_ebcdic_to_multibyte_string(ebc, 80, buf, mb_len);
 	    *bp-- = '\0';
 	    while (bp >= buf && *bp == ' ') {
 		*bp-- = '\0';
@@ -683,13 +565,8 @@ static int
 xlate_getc(void)
 {
     int r;
-    int c;
-    unsigned char cbuf[32];
+    unsigned char cbuf[XLATE_NBUF / 2];
     size_t nc;
-    int consumed;
-    enum me_fail error;
-    char mb[16];
-    int mb_len = 0;
 
     /* If there is a data buffered, return it. */
     if (xlate_buffered) {
@@ -699,62 +576,34 @@ xlate_getc(void)
 	return r;
     }
 
-    if (ftc->ascii_flag) {
-	/*
-	 * Get the next (possibly multi-byte) character from the file.
-	 */
-	do {
-	    c = fgetc(fts.local_file);
+    /* Read and encode until there is something to return. */
+    do {
+	if (ftc->ascii_flag) {
+	    size_t nread;
+
+	    /* Get the next few translated characters from the file. */
+	    nc = ft_conv_read(cbuf, sizeof(cbuf), &nread);
+	    if (nc == (size_t)-1) {
+		return EOF;
+	    }
+	    fts.length += nread;
+	} else {
+	    /* Binary, just read it. */
+	    int c = fgetc(fts.local_file);
+
 	    if (c == EOF) {
-		if (fts.last_dbcs) {
-		    fts.last_dbcs = false;
-		    return EBC_si;
-		}
 		return c;
 	    }
+	    cbuf[0] = c;
+	    nc = 1;
 	    fts.length++;
-	    mb[mb_len++] = c;
-	    error = ME_NONE;
-	    ft_multibyte_to_unicode(mb, mb_len, &consumed, &error);
-	    if (error == ME_INVALID) {
-		mb[0] = '?';
-		mb_len = 1;
-		error = ME_NONE;
-	    }
-	} while (error == ME_SHORT);
-
-	/* Expand it. */
-	if (ftc->ascii_flag && ftc->cr_flag &&
-	    !fts.last_cr && c == '\n') {
-	    nc = download_convert((unsigned const char *)"\r", 1, cbuf);
-	} else {
-	    nc = 0;
-	    fts.last_cr = (c == '\r');
 	}
+	nc = download_convert(cbuf, (unsigned)nc, xlate_buf);
+    } while (nc == 0);
 
-    } else {
-	/* Binary, just read it. */
-	c = fgetc(fts.local_file);
-	if (c == EOF)
-		return c;
-	mb[0] = c;
-	mb_len = 1;
-	nc = 0;
-	fts.length++;
-    }
-
-    /* Convert it. */
-    nc += download_convert((unsigned char *)mb, mb_len, &cbuf[nc]);
-
-    /* Return it and buffer what's left. */
-    r = cbuf[0];
-    if (nc > 1) {
-	size_t i;
-
-	for (i = 1; i < nc; i++) {
-	    xlate_buf[xlate_buffered++] = cbuf[i];
-	}
-	xlate_buf_ix = 0;
-    }
+    /* Return the first byte and buffer what's left. */
+    r = xlate_buf[0];
+    xlate_buffered = (int)nc - 1;
+    xlate_buf_ix = 1;
     return r;
 }
@@ -39,6 +39,7 @@
 #include "ft_dft_ds.h"
 
 #include "kybd.h"
+#include "ft_conv.h"
 #include "ft_dft.h"
 #include "ft_private.h"
 #include "unicodec.h"
@@ -53,8 +54,6 @@
 #define OPEN_MSG	"FT:MSG"	/* Open request for message */
 #define END_TRANSFER	"TRANS03"	/* Message for xfer complete */
 
-#define DFT_MAX_UNGETC	32
-
 /* Typedefs. */
 struct data_buffer {
     char sf_length[2];		/* SF length = 0x0023 */
@@ -66,6 +65,20 @@ struct data_buffer {
     char data[256];		/* The actual data */
 };
 
+/*
+ * An upload record, framed and ready to send. There are two: the one last
+ * sent, kept in case the host asks for it again, and the next one, read
+ * ahead while the host is busy with the last.
+ */
+typedef struct {
+    unsigned char *buf;		/* the record, starting with the AID */
+    size_t len;			/* length of the record */
+    size_t max;			/* allocated size of buf */
+    size_t data_len;		/* bytes of file data in it, 0 for EOF */
+    unsigned long recnum;	/* record number */
+    char *error;		/* read error message, or NULL */
+} dft_record_t;
+
 /* Globals. */
 
 /* Statics. */
@@ -73,11 +86,11 @@ static bool message_flag = false;	/* Open Request for msg received */
 static int dft_eof;
 static unsigned long recnum;
 static char *abort_string = NULL;
-static unsigned char *dft_savebuf = NULL;
-static size_t dft_savebuf_len = 0;
-static size_t dft_savebuf_max = 0;
-static unsigned char dft_ungetc_cache[DFT_MAX_UNGETC];
-static size_t dft_ungetc_count = 0;
+static dft_record_t dft_rec[2];
+static int dft_sent = -1;		/* index of the record last sent */
+static bool dft_ahead = false;		/* true if the next record is read */
+static char *dft_conv_buf = NULL;	/* download conversion buffer */
+static size_t dft_conv_max = 0;		/* its size */
 
 static void dft_abort(const char *s, unsigned short code);
 static void dft_close_request(void);
@@ -176,7 +189,8 @@ dft_open_request(unsigned short len, unsigned char *cp)
     }
     dft_eof = false;
     recnum = 1;
-    dft_ungetc_count = 0;
+    dft_sent = -1;
+    dft_ahead = false;
 
     /* Acknowledge the Open. */
     trace_ds("> WriteStructuredField FileTransferData OpenAck\n");
@@ -286,104 +300,21 @@ dft_data_insert(struct data_buffer *data_bufr)
 
 	/* Write the data out to the file. */
 	if (ftc->ascii_flag && (ftc->remap_flag || ftc->cr_flag)) {
-	    size_t obuf_len = 4 * my_length;
-	    char *ob0 = Malloc(obuf_len);
-	    char *ob = ob0;
-	    unsigned char *s = (unsigned char *)data_bufr->data;
-	    unsigned len = my_length;
 	    size_t nx;
 
-	    /* Copy and convert data_bufr->data to ob0. */
-	    while (len-- && obuf_len) {
-		unsigned char c = *s++;
-
-		/* Strip CR's and ^Z's. */
-		if (ftc->cr_flag && ((c == '\r' || c == 0x1a))) {
-		    continue;
-		}
-
-		if (!ftc->remap_flag) {
-		    *ob++ = c;
-		    obuf_len--;
-		    continue;
-		}
-
-		/*
-		 * Convert to local multi-byte.
-		 * We do that by inverting the host's
-		 * EBCDIC-to-ASCII map, getting back to
-		 * EBCDIC, and converting to multi-byte
-		 * from there.
-		 */
-
-		switch (fts.dbcs_state) {
-		case FT_DBCS_NONE:
-		    if (c == EBC_so) {
-			fts.dbcs_state = FT_DBCS_SO;
-			continue;
-		    }
-		    /*
-		     * fall through to non-DBCS case below
-		     */
-		    break;
-		case FT_DBCS_SO:
-		    if (c == EBC_si) {
-			fts.dbcs_state = FT_DBCS_NONE;
-		    } else {
-			fts.dbcs_byte1 = i_asc2ft[c];
-			fts.dbcs_state = FT_DBCS_LEFT;
-		    }
-		    continue;
-		case FT_DBCS_LEFT:
-		    if (c == EBC_si) {
-			fts.dbcs_state = FT_DBCS_NONE;
-			continue;
-		    }
-		    nx = ft_ebcdic_to_multibyte(
-			    (fts.dbcs_byte1 << 8) | i_asc2ft[c],
-			    (char *)ob, obuf_len);
-		    if (nx && (ob[nx - 1] == '\0')) {
-			nx--;
-		    }
-		    ob += nx;
-		    obuf_len -= nx;
-		    fts.dbcs_state = FT_DBCS_SO;
-		    continue;
-		}
-
-		if (c < 0x20 || (c >= 0x80 && c < 0xa0 && c != 0x9f)) {
-		    /*
-		     * Control code, treat it as Unicode.
-		     *
-		     * Note that IND$FILE and the VM 'TYPE'
-		     * command think that EBCDIC X'E1' is
-		     * a control code; IND$FILE maps it
-		     * onto ASCII 0x9f.  So we skip it
-		     * explicitly and treat it as printable
-		     * here.
-		     */
-		    nx = ft_unicode_to_multibyte(c, ob, obuf_len);
-		} else if (c == 0xff) {
-		    /* IND$FILE maps X'FF' to 0xff. We want U+009F. */
-		    nx = ft_unicode_to_multibyte(0x9f, ob, obuf_len);
-		} else {
-		    /* Displayable character, remap. */
-		    c = i_asc2ft[c];
-		    nx = ft_ebcdic_to_multibyte(c, (char *)ob, obuf_len);
-		}
-		if (nx && (ob[nx - 1] == '\0')) {
-		    nx--;
-		}
-		ob += nx;
-		obuf_len -= nx;
+	    /* Convert data_bufr->data to dft_conv_buf. */
+	    if (dft_conv_max < 4 * (size_t)my_length) {
+		dft_conv_max = 4 * (size_t)my_length;
+		Replace(dft_conv_buf, Malloc(dft_conv_max));
 	    }
+	    nx = ft_conv_to_local((unsigned char *)data_bufr->data, my_length,
+		    dft_conv_buf, dft_conv_max);
 
 	    /* Write the result to the file. */
-	    if (ob - ob0) {
-		rv = fwrite(ob0, ob - ob0, (size_t)1, fts.local_file);
-		fts.length += ob - ob0;
+	    if (nx) {
+		rv = fwrite(dft_conv_buf, nx, (size_t)1, fts.local_file);
+		fts.length += nx;
 	    }
-	    Free(ob0);
 	} else {
 	    /* Write the buffer to the file directly. */
 	    rv = fwrite((char *)data_bufr->data, my_length, (size_t)1,
@@ -418,178 +349,42 @@ dft_set_cur_req(void)
     /* Currently doesn't do anything. */
 }
 
-/* Store a byte inthe input buffer or ungetc cache. */
-static void
-store_inbyte(unsigned char c, unsigned char **bufptr, size_t *numbytes)
-{
-    if (*numbytes) {
-	*(*bufptr) = c;
-	(*bufptr)++;
-	(*numbytes)--;
-    } else {
-	dft_ungetc_cache[dft_ungetc_count++] = c;
-    }
-}
-
 /*
- * Read a character from a local file in ASCII mode.
- * Stores the data in 'bufptr' and returns the number of bytes stored.
- * Returns -1 for EOF.
+ * Read the next upload record from the local file and frame it.
+ *
+ * @param[in,out] rec	Record to fill in
  */
-static size_t
-dft_ascii_read(unsigned char *bufptr, size_t numbytes)
-{
-    char inbuf[16];
-    int in_ix = 0;
-    int c;
-    enum me_fail error;
-    ebc_t e;
-    int consumed;
-    ucs4_t u;
-
-    /* Belt-n-suspenders. */
-    if (!numbytes) {
-	return 0;
-    }
-
-    /* Return data from the ungetc cache first. */
-    if (dft_ungetc_count) {
-	size_t nm = dft_ungetc_count;
-
-	if (nm > numbytes) {
-	    nm = numbytes;
-	}
-	memcpy(bufptr, dft_ungetc_cache, nm);
-	if (dft_ungetc_count > nm) {
-	    memmove(dft_ungetc_cache, &dft_ungetc_cache[nm],
-		    dft_ungetc_count - nm);
-	}
-	dft_ungetc_count -= nm;
-	return nm;
-    }
-
-    if (ftc->remap_flag) {
-	/* Read bytes until we have a legal multibyte sequence. */
-	do {
-	    int consumed;
-
-	    c = fgetc(fts.local_file);
-	    if (c == EOF) {
-		if (fts.last_dbcs) {
-		    *bufptr = EBC_si;
-		    fts.last_dbcs = false;
-		    return 1;
-		}
-		return -1;
-	    }
-	    error = ME_NONE;
-	    inbuf[in_ix++] = c;
-	    ft_multibyte_to_unicode(inbuf, in_ix, &consumed, &error);
-	    if (error == ME_INVALID) {
-		inbuf[0] = '?';
-		in_ix = 1;
-		error = ME_NONE;
-	    }
-	} while (error == ME_SHORT);
-    } else {
-	/* Get a byte from the file. */
-	c = fgetc(fts.local_file);
-	if (c == EOF) {
-	    return -1;
-	}
-    }
-
-    /* Expand NL to CR/LF. */
-    if (ftc->cr_flag && !fts.last_cr && c == '\n') {
-	if (fts.last_dbcs) {
-	    *bufptr = EBC_si;
-	    dft_ungetc_cache[0] = '\r';
-	    dft_ungetc_cache[1] = '\n';
-	    dft_ungetc_count = 2;
-	    fts.last_dbcs = false;
-	    return 1;
-	} else {
-	    *bufptr = '\r';
-	    dft_ungetc_cache[0] = '\n';
-	    dft_ungetc_count = 1;
-	}
-	return 1;
-    }
-    fts.last_cr = (c == '\r');
-
-    /* The no-remap case is pretty simple. */
-    if (!ftc->remap_flag) {
-	*bufptr = c;
-	return 1;
-    }
-
-    /*
-     * Translate, inverting the host's fixed EBCDIC-to-ASCII conversion
-     * table and applying the host code page.
-     * Control codes are treated as Unicode and mapped directly.
-     * We also handle DBCS here.
-     */
-    u = ft_multibyte_to_unicode(inbuf, in_ix, &consumed, &error);
-    if (u < 0x20 || ((u >= 0x80 && u < 0x9f))) {
-	e = i_asc2ft[u];
-    } else if (u == 0x9f) {
-	e = 0xff;
-    } else {
-	e = unicode_to_ebcdic(u);
-    }
-    if (e & 0xff00) {
-	unsigned char *bp0 = bufptr;
-
-	if (!fts.last_dbcs) {
-	    store_inbyte(EBC_so, &bufptr, &numbytes);
-	}
-	store_inbyte(i_ft2asc[(e >> 8) & 0xff], &bufptr, &numbytes);
-	store_inbyte(i_ft2asc[e & 0xff],        &bufptr, &numbytes);
-	fts.last_dbcs = true;
-	return bufptr - bp0;
-    } else {
-	unsigned char nc = e? i_ft2asc[e]: '?';
-
-	if (fts.last_dbcs) {
-	    *bufptr = EBC_si;
-	    dft_ungetc_cache[0] = nc;
-	    dft_ungetc_count = 1;
-	    fts.last_dbcs = false;
-	} else {
-	    *bufptr = nc;
-	}
-	return 1;
-    }
-}
-
-/* Process a Get request. */
 static void
-dft_get_request(void)
+dft_read_record(dft_record_t *rec)
 {
     size_t numbytes;
     size_t numread;
     size_t total_read = 0;
     unsigned char *bufptr;
 
-    trace_ds(" Get\n");
-
-    if (!message_flag && ft_state == FT_ABORT_WAIT) {
-	dft_abort(get_message("ftUserCancel"), TR_GET_REQ);
-	return;
+    Replace(rec->error, NULL);
+    if (rec->max < (size_t)ftc->dft_buffersize) {
+	rec->max = ftc->dft_buffersize;
+	Replace(rec->buf, (unsigned char *)Malloc(rec->max));
     }
 
     /* Read a buffer's worth. */
-    space3270out(ftc->dft_buffersize);
     numbytes = ftc->dft_buffersize - 27; /* always read 5 bytes less than we're
 				            allowed */
-    bufptr = obuf + 17;
+    bufptr = rec->buf + 17;
     while (!dft_eof && numbytes) {
 	if (ftc->ascii_flag && (ftc->remap_flag || ftc->cr_flag)) {
-	    numread = dft_ascii_read(bufptr, numbytes);
+	    size_t nread;
+
+	    numread = ft_conv_read(bufptr, numbytes, &nread);
 	    if (numread == (size_t)-1) {
 		dft_eof = true;
 		break;
 	    }
+	    if (numread == 0) {
+		/* The next character does not fit. */
+		break;
+	    }
 	    bufptr += numread;
 	    numbytes -= numread;
 	    total_read += numread;
@@ -613,59 +408,92 @@ dft_get_request(void)
 
     /* Check for read error. */
     if (ferror(fts.local_file)) {
-	char *buf;
-
-	buf = xs_buffer("read(%s): %s", ftc->local_filename, strerror(errno));
-	dft_abort(buf, TR_GET_REQ);
-	Free(buf);
+	rec->error = xs_buffer("read(%s): %s", ftc->local_filename,
+		strerror(errno));
 	return;
     }
 
     /* Set up SF header for Data or EOF. */
-    obptr = obuf;
-    *obptr++ = AID_SF;
-    obptr += 2;	/* skip SF length for now */
-    *obptr++ = SF_TRANSFER_DATA;
+    bufptr = rec->buf;
+    *bufptr++ = AID_SF;
+    bufptr += 2;	/* skip SF length for now */
+    *bufptr++ = SF_TRANSFER_DATA;
 
+    rec->data_len = total_read;
     if (total_read) {
-	trace_ds("> WriteStructuredField FileTransferData Data(rec=%lu) %d "
-		"bytes\n", recnum, (int)total_read);
-	SET16(obptr, TR_GET_REPLY);
-	SET16(obptr, TR_RECNUM_HDR);
-	SET32(obptr, recnum);
+	rec->recnum = recnum;
+	SET16(bufptr, TR_GET_REPLY);
+	SET16(bufptr, TR_RECNUM_HDR);
+	SET32(bufptr, recnum);
 	recnum++;
-	SET16(obptr, TR_NOT_COMPRESSED);
-	*obptr++ = TR_BEGIN_DATA;
-	SET16(obptr, total_read + 5);
-	obptr += total_read;
-
-	fts.length += total_read;
+	SET16(bufptr, TR_NOT_COMPRESSED);
+	*bufptr++ = TR_BEGIN_DATA;
+	SET16(bufptr, total_read + 5);
+	bufptr += total_read;
     } else {
-	trace_ds("> WriteStructuredField FileTransferData EOF\n");
-	*obptr++ = HIGH8(TR_GET_REQ);
-	*obptr++ = TR_ERROR_REPLY;
-	SET16(obptr, TR_ERROR_HDR);
-	SET16(obptr, TR_ERR_EOF);
+	*bufptr++ = HIGH8(TR_GET_REQ);
+	*bufptr++ = TR_ERROR_REPLY;
+	SET16(bufptr, TR_ERROR_HDR);
+	SET16(bufptr, TR_ERR_EOF);
 
 	dft_eof = true;
     }
+    rec->len = bufptr - rec->buf;
 
     /* Set the SF length. */
-    bufptr = obuf + 1;
-    SET16(bufptr, obptr - (obuf + 1));
-
-    /* Save the data. */
-    dft_savebuf_len = obptr - obuf;
-    if (dft_savebuf_len > dft_savebuf_max) {
-	dft_savebuf_max = dft_savebuf_len;
-	Replace(dft_savebuf, (unsigned char *)Malloc(dft_savebuf_max));
+    bufptr = rec->buf + 1;
+    SET16(bufptr, rec->len - 1);
+}
+
+/* Process a Get request. */
+static void
+dft_get_request(void)
+{
+    int next = (dft_sent == 0)? 1: 0;
+    dft_record_t *rec = &dft_rec[next];
+
+    trace_ds(" Get\n");
+
+    if (!message_flag && ft_state == FT_ABORT_WAIT) {
+	dft_abort(get_message("ftUserCancel"), TR_GET_REQ);
+	return;
     }
-    memcpy(dft_savebuf, obuf, dft_savebuf_len);
-    aid = AID_SF;
 
-    /* Write the data. */
-    net_output();
+    /* Use the record read ahead, or read one now. */
+    if (!dft_ahead) {
+	dft_read_record(rec);
+    }
+    dft_ahead = false;
+    if (rec->error != NULL) {
+	dft_abort(rec->error, TR_GET_REQ);
+	return;
+    }
+
+    if (rec->data_len) {
+	trace_ds("> WriteStructuredField FileTransferData Data(rec=%lu) %d "
+		"bytes\n", rec->recnum, (int)rec->data_len);
+	fts.length += rec->data_len;
+    } else {
+	trace_ds("> WriteStructuredField FileTransferData EOF\n");
+    }
+
+    /*
+     * Send the record straight from its buffer, which doubles as the copy
+     * to resend if it is asked for again.
+     */
+    dft_sent = next;
+    aid = AID_SF;
+    net_output_buf(rec->buf, rec->len);
     ft_update_length();
+
+    /*
+     * Read the next record while the host deals with this one, so the disk
+     * is not waited for when it asks.
+     */
+    if (rec->data_len && ft_state != FT_ABORT_WAIT) {
+	dft_read_record(&dft_rec[1 - next]);
+	dft_ahead = true;
+    }
 }
 
 /* Process a Close request. */
@@ -714,13 +542,9 @@ dft_abort(const char *s, unsigned short code)
 void
 dft_read_modified(void)
 {
-    if (dft_savebuf_len) {
+    if (dft_sent >= 0) {
 	trace_ds("> WriteStructuredField FileTransferData\n");
-	obptr = obuf;
-	space3270out(dft_savebuf_len);
-	memcpy(obptr, dft_savebuf, dft_savebuf_len);
-	obptr += dft_savebuf_len;
-	net_output();
+	net_output_buf(dft_rec[dft_sent].buf, dft_rec[dft_sent].len);
     }
 }
 
@@ -1077,6 +1077,7 @@ static res_t base_resources[] = {
     { ResQrBgColor,	aoffset(qr_bg_color),	XRM_BOOLEAN },
     { ResQuit,		aoffset(linemode.quit),	XRM_STRING },
     { ResRprnt,		aoffset(linemode.rprnt),	XRM_STRING },
+    { ResScreenMirror,aoffset(screen_mirror),	XRM_STRING },
     { ResScreenTraceFile,aoffset(screentrace.file),XRM_STRING },
     { ResScreenTraceTarget,aoffset(screentrace.target),XRM_STRING },
     { ResScreenTraceType,aoffset(screentrace.type),XRM_STRING },
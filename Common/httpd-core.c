@@ -34,6 +34,10 @@
 
 #include <errno.h>
 #include <limits.h>
+#if defined(HAVE_LIBZ) && defined(HAVE_ZLIB_H) /*[*/
+# define HTTPD_ZLIB	1
+# include <zlib.h>
+#endif /*]*/
 
 #include "appres.h"
 #include "asprintf.h"
@@ -46,6 +50,8 @@
 #include "httpd-io.h"
 
 #define DIRLIST_NLEN	14
+#define COMPRESS_MIN	1024	/* smallest response body worth compressing */
+#define PIPELINE_BATCH	8	/* most pipelined requests handled at once */
 
 /* Typedefs */
 typedef enum {		/* Print mode: */
@@ -66,6 +72,7 @@ typedef enum {		/* Error type: */
 typedef enum {		/* Supported verbs: */
     VERB_GET,		/*  GET */
     VERB_HEAD,		/*  HEAD */
+    VERB_POST,		/*  POST */
     VERB_OTHER		/*  anything else */
 } verb_t;
 
@@ -94,7 +101,14 @@ typedef struct {
     char *fields_start;	/* start of fields */
     field_t *fields;	/* field values */
     char *location;	/* real location for 301 errors */
+    const char *allow;	/* allowed methods for 405 errors */
+    char *etag;		/* entity tag for the response */
+    bool tagged;	/* does the response body carry the tag? */
     struct _httpd_reg *async_node; /* asynchronous event node */
+#define MAX_HTTPD_BODY	65536
+    varbuf_t body;	/* POST request body */
+    size_t body_needed;	/* bytes of the body still to come */
+    char *body_uri;	/* decoded URI, kept while the body arrives */
     size_t it_offset;	/* input trace offset */
     size_t ot_offset;	/* output trace offset */
 } request_t;
@@ -105,6 +119,7 @@ typedef struct {
     void *mhandle;	/* the handle from the main procedure */
     bool cr;		/* last character seen was a CR */
     unsigned long seq;	/* connection sequence number, for tracing */
+    varbuf_t held;	/* pipelined input, held during an async request */
 
     /* Per-request state */
     request_t request;
@@ -135,6 +150,7 @@ typedef struct _httpd_reg {
 	} fixed_binary;		/* fixed binary */
 	reg_dyn_t *dyn;		/* dynamic output */
     } u;
+    reg_etag_t *etag;		/* entity tag, for conditional requests */
 } httpd_reg_t;
 
 /* Globals */
@@ -143,6 +159,19 @@ typedef struct _httpd_reg {
 static httpd_reg_t *httpd_reg;
 static unsigned long httpd_seq = 0;
 
+#if defined(HTTPD_ZLIB) /*[*/
+typedef enum {		/* Content encoding: */
+    CE_GZIP,		/*  gzip */
+    CE_DEFLATE,		/*  deflate (zlib format) */
+    CE_NONE		/*  none */
+} content_encoding_t;
+static const char *ce_name[] = { "gzip", "deflate" };
+static z_stream zstream[CE_NONE];
+static bool zstream_init[CE_NONE];
+#endif /*]*/
+
+static const char *lookup_field(const char *name, field_t *f);
+
 /* Code */
 
 /**
@@ -160,12 +189,20 @@ status_text(int status_code)
 	return "OK";
     case 301:
 	return "Moved Permanently";
+    case 304:
+	return "Not Modified";
     case 400:
 	return "Bad Request";
     case 404:
 	return "Not Found";
+    case 405:
+	return "Method Not Allowed";
     case 409:
 	return "Conflict";
+    case 411:
+	return "Length Required";
+    case 413:
+	return "Payload Too Large";
     case 500:
 	return "Internal Server Error";
     case 501:
@@ -360,9 +397,207 @@ httpd_content_len(httpd_t *h, size_t len)
     httpd_send(h, cl, strlen(cl));
 }
 
+#if defined(HTTPD_ZLIB) /*[*/
+/**
+ * Parse a q-value (RFC 9110 section 12.4.2) by hand, so the locale's decimal
+ * point does not matter.
+ *
+ * @param[in] s		Text after "q="
+ *
+ * @return Value in thousandths, or 0 if it is malformed
+ */
+static int
+parse_qvalue(const char *s)
+{
+    int v;
+    int scale = 100;
+
+    if (*s != '0' && *s != '1') {
+	return 0;
+    }
+    v = (*s++ - '0') * 1000;
+    if (*s == '.') {
+	s++;
+	while (scale > 0 && isdigit((unsigned char)*s)) {
+	    v += (*s++ - '0') * scale;
+	    scale /= 10;
+	}
+    }
+    if (*s != '\0' && *s != ',' && *s != ';' && *s != ' ' && *s != '\t') {
+	return 0;
+    }
+    return (v > 1000)? 0: v;
+}
+
+/**
+ * Choose a content encoding from the client's Accept-Encoding field.
+ *
+ * gzip is preferred to deflate if the client likes them equally.
+ *
+ * @param[in] r		Request
+ *
+ * @return Content encoding
+ */
+static content_encoding_t
+httpd_accept_encoding(request_t *r)
+{
+    const char *ae = lookup_field("Accept-Encoding", r->fields);
+    int q[CE_NONE] = { -1, -1 };
+    int star = 0;
+    content_encoding_t ce;
+
+    if (ae == NULL) {
+	return CE_NONE;
+    }
+
+    while (*ae) {
+	const char *name;
+	size_t nlen;
+	int qv = 1000;
+
+	/* Isolate the coding name. */
+	while (*ae == ' ' || *ae == '\t' || *ae == ',') {
+	    ae++;
+	}
+	name = ae;
+	while (*ae && *ae != ',' && *ae != ';' && *ae != ' ' &&
+		*ae != '\t') {
+	    ae++;
+	}
+	nlen = ae - name;
+
+	/* Look for a q-value. */
+	while (*ae && *ae != ',') {
+	    if (*ae == ';') {
+		ae++;
+		while (*ae == ' ' || *ae == '\t') {
+		    ae++;
+		}
+		if ((*ae == 'q' || *ae == 'Q') && *(ae + 1) == '=') {
+		    qv = parse_qvalue(ae + 2);
+		}
+	    } else {
+		ae++;
+	    }
+	}
+
+	if ((nlen == 4 && !strncasecmp(name, "gzip", nlen)) ||
+		(nlen == 6 && !strncasecmp(name, "x-gzip", nlen))) {
+	    q[CE_GZIP] = qv;
+	} else if (nlen == 7 && !strncasecmp(name, "deflate", nlen)) {
+	    q[CE_DEFLATE] = qv;
+	} else if (nlen == 1 && *name == '*') {
+	    star = qv;
+	}
+    }
+
+    /* Codings not named explicitly take the value of '*'. */
+    for (ce = CE_GZIP; ce < CE_NONE; ce++) {
+	if (q[ce] < 0) {
+	    q[ce] = star;
+	}
+    }
+    if (q[CE_GZIP] > 0 && q[CE_GZIP] >= q[CE_DEFLATE]) {
+	return CE_GZIP;
+    }
+    if (q[CE_DEFLATE] > 0) {
+	return CE_DEFLATE;
+    }
+    return CE_NONE;
+}
+
+/**
+ * Compress a response body.
+ *
+ * The compressor for each encoding is kept and reset between responses,
+ * so its tables are only allocated once.
+ *
+ * @param[in] ce	Content encoding
+ * @param[in] buf	Body
+ * @param[in] len	Length of body
+ * @param[out] out	Returned compressed body
+ *
+ * @return true for success
+ */
+static bool
+httpd_compress(content_encoding_t ce, const char *buf, size_t len,
+	varbuf_t *out)
+{
+    z_stream *zs = &zstream[ce];
+    char obuf[16384];
+    int zrv;
+
+    if (!zstream_init[ce]) {
+	if (deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+		    (ce == CE_GZIP)? MAX_WBITS + 16: MAX_WBITS, 8,
+		    Z_DEFAULT_STRATEGY) != Z_OK) {
+	    vtrace("httpd: deflateInit2 failed: %s\n",
+		    zs->msg? zs->msg: "?");
+	    return false;
+	}
+	zstream_init[ce] = true;
+    }
+
+    zs->next_in = (Bytef *)buf;
+    zs->avail_in = (uInt)len;
+    do {
+	zs->next_out = (Bytef *)obuf;
+	zs->avail_out = sizeof(obuf);
+	zrv = deflate(zs, Z_FINISH);
+	if (zrv != Z_OK && zrv != Z_STREAM_END) {
+	    vtrace("httpd: deflate failed: %s\n", zs->msg? zs->msg: "?");
+	    deflateReset(zs);
+	    vb_reset(out);
+	    return false;
+	}
+	vb_append(out, obuf, sizeof(obuf) - zs->avail_out);
+    } while (zrv != Z_STREAM_END);
+    deflateReset(zs);
+    return true;
+}
+#endif /*]*/
+
+/**
+ * Send the Vary field for a response that may be compressed, so caches
+ * keep the compressed and uncompressed versions apart.
+ *
+ * @param[in,out] h	State
+ */
+static void
+httpd_vary(httpd_t *h)
+{
+#if defined(HTTPD_ZLIB) /*[*/
+    httpd_print(h, HP_SEND, "Vary: Accept-Encoding\n");
+#endif /*]*/
+}
+
+/**
+ * Form the entity tag for a compressed body.
+ *
+ * A strong tag has to differ between content codings, so the coding name is
+ * added to the tag of the uncompressed body.
+ *
+ * @param[in] etag	Tag of the uncompressed body, including quotes
+ * @param[in] coding	Content coding
+ *
+ * @return Tag, which the caller must free
+ */
+static char *
+etag_coded(const char *etag, const char *coding)
+{
+    size_t len = strlen(etag);
+
+    if (len < 2 || etag[len - 1] != '"') {
+	return xs_buffer("%s", etag);
+    }
+    return xs_buffer("%.*s-%s\"", (int)(len - 1), etag, coding);
+}
+
 /**
  * Dump the buffered http_print() data.
  *
+ * If the body is big enough and the client accepts it, it is compressed.
+ *
  * @param[in,out] h	State
  */
 typedef enum { DUMP_WITH_LENGTH, DUMP_WITHOUT_LENGTH } dump_t;
@@ -370,7 +605,43 @@ static void
 httpd_print_dump(httpd_t *h, dump_t type)
 {
     request_t *r = &h->request;
+    bool tagged = type == DUMP_WITH_LENGTH && r->tagged;
 
+    if (type == DUMP_WITH_LENGTH) {
+	httpd_vary(h);
+	r->tagged = false;
+    }
+
+#if defined(HTTPD_ZLIB) /*[*/
+    if (type == DUMP_WITH_LENGTH && vb_len(&r->print_buf) >= COMPRESS_MIN) {
+	content_encoding_t ce = httpd_accept_encoding(r);
+	varbuf_t z;
+
+	vb_init(&z);
+	if (ce != CE_NONE &&
+		httpd_compress(ce, vb_buf(&r->print_buf),
+		    vb_len(&r->print_buf), &z) &&
+		vb_len(&z) < vb_len(&r->print_buf)) {
+	    if (tagged) {
+		char *etag = etag_coded(r->etag, ce_name[ce]);
+
+		httpd_print(h, HP_SEND, "ETag: %s\n", etag);
+		Free(etag);
+	    }
+	    httpd_print(h, HP_SEND, "Content-Encoding: %s\n", ce_name[ce]);
+	    httpd_content_len(h, vb_len(&z));
+	    httpd_send(h, vb_buf(&z), vb_len(&z));
+	    vb_free(&z);
+	    vb_reset(&r->print_buf);
+	    return;
+	}
+	vb_free(&z);
+    }
+#endif /*]*/
+
+    if (tagged) {
+	httpd_print(h, HP_SEND, "ETag: %s\n", r->etag);
+    }
     if (type == DUMP_WITH_LENGTH) {
 	httpd_content_len(h, vb_len(&r->print_buf));
     }
@@ -417,7 +688,12 @@ httpd_reinit_request(request_t *r)
     free_fields(&r->fields);
     r->fields_start = NULL;
     free_fields(&r->queries);
+    Replace(r->etag, NULL);
+    r->tagged = false;
     vb_reset(&r->print_buf);
+    vb_reset(&r->body);
+    r->body_needed = 0;
+    Replace(r->body_uri, NULL);
     r->verb = VERB_OTHER;
     r->it_offset = 0;
     r->ot_offset = 0;
@@ -446,8 +722,9 @@ httpd_init_request(request_t *r)
 static void
 httpd_free_request(request_t *r)
 {
-    /* Free the print buffer. */
+    /* Free the print and body buffers. */
     vb_free(&r->print_buf);
+    vb_free(&r->body);
 
     /* Reinitialize everthing. */
     httpd_reinit_request(r);
@@ -500,6 +777,9 @@ httpd_http_header(httpd_t *h, int status_code, bool do_close,
     if (status_code == 301 && r->location != NULL) {
 	httpd_print(h, HP_BUFFER, "Location: %s\n", r->location);
     }
+    if (status_code == 405 && r->allow != NULL) {
+	httpd_print(h, HP_BUFFER, "Allow: %s\n", r->allow);
+    }
     httpd_print(h, HP_BUFFER, "Content-Type: %s\n", content_type);
 
     /* Now write it. */
@@ -716,7 +996,7 @@ httpd_digest_request_line(httpd_t *h)
     };
     static const char *supported_verbs[] = {
 	/* Must use same order as the http_verb enumeration. */
-	"GET", "HEAD", NULL
+	"GET", "HEAD", "POST", NULL
     };
     static char http_token[] = "HTTP/";
 #   define HTTP_TOKEN_SIZE (sizeof(http_token) - 1)
@@ -997,6 +1277,94 @@ httpd_register_dyn(const char *path, const char *desc, content_t content_type,
     return reg;
 }
 
+/**
+ * Check an If-None-Match field against an entity tag.
+ *
+ * @param[in] inm	If-None-Match value
+ * @param[in] etag	Entity tag, including quotes
+ *
+ * @return true if the tag matches
+ */
+static bool
+etag_match(const char *inm, const char *etag)
+{
+    size_t elen = strlen(etag);
+
+    while (*inm) {
+	size_t len;
+
+	while (*inm == ',' || isspace((unsigned char)*inm)) {
+	    inm++;
+	}
+	if (*inm == '*') {
+	    return true;
+	}
+
+	/* Weak comparison is fine for a GET. */
+	if (!strncmp(inm, "W/", 2)) {
+	    inm += 2;
+	}
+	len = strcspn(inm, ",");
+	while (len && isspace((unsigned char)inm[len - 1])) {
+	    len--;
+	}
+	if (len == elen && !strncmp(inm, etag, len)) {
+	    return true;
+	}
+	inm += strcspn(inm, ",");
+    }
+    return false;
+}
+
+/**
+ * Reply to a conditional request with 304 Not Modified.
+ *
+ * @param[in,out] h	State
+ * @param[in] reg	Registry entry
+ *
+ * @return httpd_status_t
+ */
+static httpd_status_t
+httpd_not_modified(httpd_t *h, httpd_reg_t *reg)
+{
+    request_t *r = &h->request;
+
+    r->async_node = NULL;
+    httpd_http_header(h, 304, !r->persistent, reg->content_str);
+    httpd_vary(h);
+    httpd_print(h, HP_SEND, "ETag: %s\n", r->etag);
+    httpd_print(h, HP_SEND, "Cache-Control: no-cache\n");
+    httpd_print(h, HP_SEND, "\n");
+
+    if (!r->persistent) {
+	return HS_SUCCESS_CLOSE;
+    } else {
+	httpd_reinit_request(r);
+	return HS_SUCCESS_OPEN;
+    }
+}
+
+/**
+ * Reject a request with a verb the object does not support.
+ *
+ * @param[in,out] h	State
+ * @param[in] allow	Methods the object does support
+ *
+ * @return httpd_status_t
+ */
+static httpd_status_t
+httpd_not_allowed(httpd_t *h, const char *allow)
+{
+    request_t *r = &h->request;
+    httpd_status_t rv;
+
+    r->allow = allow;
+    rv = httpd_error(h, ERRMODE_NONFATAL, CT_HTML, 405,
+	    "That method is not allowed for this object.");
+    r->allow = NULL;
+    return rv;
+}
+
 /**
  * Reply to a successful URI lookup.
  *
@@ -1012,6 +1380,12 @@ httpd_reply(httpd_t *h, httpd_reg_t *reg, const char *uri)
     request_t *r = &h->request;
     const char *nonterm;
 
+    /* Objects take either POST or GET and HEAD, never both. */
+    if ((r->verb == VERB_POST) != !!(reg->flags & HF_POST)) {
+	return httpd_not_allowed(h,
+		(reg->flags & HF_POST)? "POST": "GET, HEAD");
+    }
+
     switch (reg->type) {
     case OR_DYN_TERM:
     case OR_DYN_NONTERM:
@@ -1027,6 +1401,41 @@ httpd_reply(httpd_t *h, httpd_reg_t *reg, const char *uri)
 	if (*nonterm == '/') {
 	    nonterm++;
 	}
+
+	/*
+	 * If the node can tag its response, and the client already has a
+	 * response with the same tag, don't bother generating it.
+	 */
+	if (reg->etag != NULL &&
+		(r->verb == VERB_GET || r->verb == VERB_HEAD)) {
+	    const char *etag = (*reg->etag)(nonterm);
+
+	    if (etag != NULL) {
+		const char *inm = lookup_field("If-None-Match", r->fields);
+
+		r->etag = NewString(etag);
+		if (inm != NULL && etag_match(inm, etag)) {
+		    return httpd_not_modified(h, reg);
+		}
+#if defined(HTTPD_ZLIB) /*[*/
+		/* The client may have the compressed version. */
+		if (inm != NULL) {
+		    content_encoding_t ce = httpd_accept_encoding(r);
+
+		    if (ce != CE_NONE) {
+			char *coded = etag_coded(etag, ce_name[ce]);
+
+			if (etag_match(inm, coded)) {
+			    Replace(r->etag, coded);
+			    return httpd_not_modified(h, reg);
+			}
+			Free(coded);
+		    }
+		}
+#endif /*]*/
+	    }
+	}
+
 	return (*reg->u.dyn)(nonterm, h);
     default:
 	break;
@@ -1037,6 +1446,7 @@ httpd_reply(httpd_t *h, httpd_reg_t *reg, const char *uri)
 
     switch (r->verb) {
     case VERB_GET:
+    case VERB_POST:
     case VERB_OTHER:
 	/* Generate the body. */
 	if (reg->content_type == CT_HTML) {
@@ -1074,6 +1484,9 @@ httpd_reply(httpd_t *h, httpd_reg_t *reg, const char *uri)
 	}
 	break;
     case VERB_HEAD:
+	if (reg->type != OR_FIXED_BINARY) {
+	    httpd_vary(h);
+	}
 	httpd_print(h, HP_SEND, "\n");
 	break;
     }
@@ -1102,10 +1515,15 @@ httpd_dirlist(httpd_t *h, const char *uri)
     char *q_uri;
     httpd_reg_t *reg;
 
+    if (r->verb == VERB_POST) {
+	return httpd_not_allowed(h, "GET, HEAD");
+    }
+
     httpd_http_header(h, 200, !r->persistent, "text/html; charset=iso8859-1");
 
     switch (r->verb) {
     case VERB_GET:
+    case VERB_POST:
     case VERB_OTHER:
 	/* Generate the body. */
 	q_uri = html_quote(uri);
@@ -1161,6 +1579,7 @@ httpd_dirlist(httpd_t *h, const char *uri)
 	httpd_print_dump(h, DUMP_WITH_LENGTH);
 	break;
     case VERB_HEAD:
+	httpd_vary(h);
 	httpd_print(h, HP_SEND, "\n");
 	break;
     }
@@ -1653,6 +2072,35 @@ httpd_digest_request(httpd_t *h)
 	parse_queries(h, r->query);
     }
 
+    /* A POST request has a body, which must be read first. */
+    if (r->verb == VERB_POST) {
+	const char *content_length = lookup_field("Content-Length", r->fields);
+	size_t nl;
+	unsigned long n;
+
+	if (content_length == NULL) {
+	    Free(cand_uri);
+	    return httpd_error(h, ERRMODE_FATAL, CT_HTML, 411,
+		    "Missing Content-Length.");
+	}
+	if (!httpd_parse_number(content_length, &nl, &n) ||
+		content_length[nl] != '\0') {
+	    Free(cand_uri);
+	    return httpd_error(h, ERRMODE_FATAL, CT_HTML, 400,
+		    "Invalid Content-Length.");
+	}
+	if (n > MAX_HTTPD_BODY) {
+	    Free(cand_uri);
+	    return httpd_error(h, ERRMODE_FATAL, CT_HTML, 413,
+		    "The request body is too big.");
+	}
+	if (n > 0) {
+	    r->body_needed = n;
+	    r->body_uri = cand_uri;
+	    return HS_CONTINUE;
+	}
+    }
+
     /*
      * Now we have a URI in what seems like valid form.
      * Search the registry for a match.
@@ -1663,72 +2111,46 @@ httpd_digest_request(httpd_t *h)
 }
 
 /**
- * Process a byte of incoming HTTP data.
+ * Process the end of a line of incoming HTTP data.
  *
  * @param[in,out] h	State
- * @param[in] c		Next input character
  *
  * @return httpd_status_t
  */
-static int
-httpd_input_char(httpd_t *h, char c)
+static httpd_status_t
+httpd_input_eol(httpd_t *h)
 {
     request_t *r = &h->request;
 
-    /*
-     * CRLF processing. We translate CRs into Newlines, and ignore LFs
-     * after CRs.
-     */
-    if (h->cr) {
-	h->cr = false;
-
-	/* CR followed by LF. Ignore the LF. */
-	if (c == '\n') {
-	    return HS_CONTINUE;
-	}
-    }
-    if (c == '\r') {
-	h->cr = true;
-
-	/* Treat CRs as Newline characters. */
-	c = '\n';
-    }
-
-    /* If there's no room to store the character, we're done. */
+    /* If there's no room to store the newline, we're done. */
     if (r->nr >= MAX_HTTPD_REQUEST) {
 	return httpd_error(h,
 		r->saw_first? ERRMODE_FATAL: ERRMODE_NON_HTTP,
 		CT_HTML, 400, "The request is too big.");
     }
 
-    /* Store the character. */
-    r->request_buf[r->nr++] = c;
+    /* Store it. */
+    r->request_buf[r->nr++] = '\n';
 
-    /* Check for a newline. */
-    if (c == '\n') {
-	if (r->rll == 0) {
-	    /* Empty line: digest the entire request. */
-	    if (!r->saw_first) {
-		return httpd_error(h, ERRMODE_FATAL, CT_HTML, 400,
-			"Missing request.");
-	    }
-	    r->request_buf[r->nr] = '\0';
-	    return httpd_digest_request(h);
-	} else {
-	    /* Beginning of new line; set the length to 0. */
-	    r->rll = 0;
-
-	    /* If this is the first line, validate it. */
-	    if (!r->saw_first) {
-		r->request_buf[r->nr - 1] = '\0';
-		r->fields_start = &r->request_buf[r->nr];
-		r->saw_first = true;
-		return httpd_digest_request_line(h);
-	    }
+    if (r->rll == 0) {
+	/* Empty line: digest the entire request. */
+	if (!r->saw_first) {
+	    return httpd_error(h, ERRMODE_FATAL, CT_HTML, 400,
+		    "Missing request.");
 	}
-    } else {
-	/* Non-newline character: increment the line length. */
-	r->rll++;
+	r->request_buf[r->nr] = '\0';
+	return httpd_digest_request(h);
+    }
+
+    /* Beginning of new line; set the length to 0. */
+    r->rll = 0;
+
+    /* If this is the first line, validate it. */
+    if (!r->saw_first) {
+	r->request_buf[r->nr - 1] = '\0';
+	r->fields_start = &r->request_buf[r->nr];
+	r->saw_first = true;
+	return httpd_digest_request_line(h);
     }
 
     /* Not done yet. */
@@ -1906,6 +2328,28 @@ httpd_set_alias(void *nhandle, const char *text)
     }
 }
 
+/**
+ * Register an entity tag function for a dynamic node.
+ *
+ * The function is called with the same URI fragment as the node's callback.
+ * If it returns a (quoted) tag, the tag is sent with the response, and a
+ * request with a matching If-None-Match field gets a 304 response without
+ * the node's callback being called at all. If it returns NULL, the response
+ * is not cacheable.
+ *
+ * @param[in] nhandle	Node handle returned from httpd_register_xxx()
+ * @param[in] etag	Entity tag function
+ */
+void
+httpd_set_etag(void *nhandle, reg_etag_t *etag)
+{
+    httpd_reg_t *reg = nhandle;
+
+    if (reg) {
+	reg->etag = etag;
+    }
+}
+
 /**
  * Initialize a new connection.
  *
@@ -1931,45 +2375,107 @@ httpd_new(void *mhandle, const char *client_name)
 }
 
 /**
- * Process incoming HTTP data.
+ * Parse incoming HTTP data.
  *
- * Called with data read from the HTTP socket.
- *
- * @param[in] dhandle	handle returned by httpd_new
+ * @param[in,out] h	State
  * @param[in] data	data buffer
  * @param[in] len	length of data in buffer
  *
  * @return httpd_status_t
  */
-httpd_status_t
-httpd_input(void *dhandle, const char *data, size_t len)
+static httpd_status_t
+httpd_parse(httpd_t *h, const char *data, size_t len)
 {
-    httpd_t *h = (httpd_t *)dhandle;
     request_t *r = &h->request;
     size_t i;
     httpd_status_t rv = HS_CONTINUE;
+    int done = 0;
 
-    httpd_data_trace(h, "<", data, len, &r->it_offset);
+    /*
+     * Process a line at a time. CRs are translated to newlines, and LFs
+     * after CRs are ignored.
+     */
+    i = 0;
+    while (i < len) {
+	const char *cr, *lf, *eol;
+	size_t n;
 
-    /* Process a byte at a time, skipping CRs. */
-    for (i = 0; i < len; i++) {
-	switch ((rv = httpd_input_char(h, data[i]))) {
+	/* CR followed by LF. Ignore the LF. */
+	if (h->cr) {
+	    h->cr = false;
+	    if (data[i] == '\n') {
+		i++;
+		continue;
+	    }
+	}
+
+	if (r->body_needed) {
+	    /* Collect the body of a POST request. */
+	    n = len - i;
+	    if (n > r->body_needed) {
+		n = r->body_needed;
+	    }
+	    vb_append(&r->body, data + i, n);
+	    r->body_needed -= n;
+	    i += n;
+	    if (r->body_needed) {
+		break;
+	    }
+	    rv = httpd_lookup_uri(h, r->body_uri);
+	    Replace(r->body_uri, NULL);
+	} else {
+	    /* Find the end of the line, and store the text before it. */
+	    cr = memchr(data + i, '\r', len - i);
+	    lf = memchr(data + i, '\n', (cr? (size_t)(cr - data): len) - i);
+	    eol = (lf != NULL)? lf: cr;
+	    n = ((eol != NULL)? (size_t)(eol - data): len) - i;
+	    if (n) {
+		if (r->nr + n > MAX_HTTPD_REQUEST) {
+		    return httpd_error(h,
+			    r->saw_first? ERRMODE_FATAL: ERRMODE_NON_HTTP,
+			    CT_HTML, 400, "The request is too big.");
+		}
+		memcpy(r->request_buf + r->nr, data + i, n);
+		r->nr += n;
+		r->rll += (int)n;
+		i += n;
+	    }
+	    if (eol == NULL) {
+		break;
+	    }
+	    h->cr = (*eol == '\r');
+	    i++;
+	    rv = httpd_input_eol(h);
+	}
+
+	switch (rv) {
 	case HS_CONTINUE:
 	    /* Keep parsing. */
 	    continue;
 	case HS_SUCCESS_OPEN:
-	    httpd_reinit_request(r);
-	    return rv;
+	    /* Request succeeded; go on to any request after it. */
 	case HS_ERROR_OPEN:
 	    /* Request failed, but keep the socket open. */
 	    httpd_reinit_request(r);
-	    /* fall through */
+	    if (++done >= PIPELINE_BATCH && i < len) {
+		/* Let something else run before doing any more. */
+		vb_append(&h->held, data + i, len - i);
+		return rv;
+	    }
+	    continue;
 	case HS_ERROR_CLOSE:
 	    /* Request failed, close the socket. */
 	case HS_SUCCESS_CLOSE:
 	    /* Request succeeded, close the socket. */
 	case HS_PENDING:
-	    /* Request pending, hold off further input. */
+	    /*
+	     * Request pending, hold off further input. Any requests after it
+	     * are processed when it completes.
+	     */
+	    vb_append(&h->held, data + i, len - i);
+	    return rv;
+	case HS_STREAM:
+	    /* Response is a stream, no further requests. */
 	    return rv;
 	}
     }
@@ -1978,6 +2484,63 @@ httpd_input(void *dhandle, const char *data, size_t len)
     return rv;
 }
 
+/**
+ * Process incoming HTTP data.
+ *
+ * Called with data read from the HTTP socket.
+ *
+ * @param[in] dhandle	handle returned by httpd_new
+ * @param[in] data	data buffer
+ * @param[in] len	length of data in buffer
+ *
+ * @return httpd_status_t
+ */
+httpd_status_t
+httpd_input(void *dhandle, const char *data, size_t len)
+{
+    httpd_t *h = (httpd_t *)dhandle;
+
+    httpd_data_trace(h, "<", data, len, &h->request.it_offset);
+    return httpd_parse(h, data, len);
+}
+
+/**
+ * Check for held input: requests that arrived behind an asynchronous
+ * request, or behind a batch of pipelined requests.
+ *
+ * @param[in] dhandle	handle returned by httpd_new
+ *
+ * @return true if there is held input
+ */
+bool
+httpd_held(void *dhandle)
+{
+    httpd_t *h = (httpd_t *)dhandle;
+
+    return vb_len(&h->held) > 0;
+}
+
+/**
+ * Process held input.
+ *
+ * @param[in] dhandle	handle returned by httpd_new
+ *
+ * @return httpd_status_t
+ */
+httpd_status_t
+httpd_input_held(void *dhandle)
+{
+    httpd_t *h = (httpd_t *)dhandle;
+    varbuf_t held = h->held;
+    httpd_status_t rv;
+
+    /* The input was traced when it arrived. */
+    vb_init(&h->held);
+    rv = httpd_parse(h, vb_buf(&held), vb_len(&held));
+    vb_free(&held);
+    return rv;
+}
+
 /**
  * Close the HTTPD connection.
  *
@@ -1993,6 +2556,7 @@ httpd_close(void *dhandle, const char *why)
 
     /* Wipe the existing request state. */
     httpd_free_request(&h->request);
+    vb_free(&h->held);
 
     /* Free it. */
     memset(h, 0, sizeof(*h));
@@ -2021,6 +2585,58 @@ httpd_mhandle(void *dhandle)
  * Functions called by methods.
  *****************************************************************************/
 
+/**
+ * Send the header for a successful dynamic HTTP response.
+ *
+ * @param[in,out] h	State
+ *
+ * @return Registered node
+ */
+static httpd_reg_t *
+httpd_dyn_header(httpd_t *h)
+{
+    request_t *r = &h->request;
+    httpd_reg_t *reg = r->async_node;
+
+    /* Un-mark the node. */
+    r->async_node = NULL;
+
+    /* Generate the output. */
+    httpd_http_header(h, 200, !r->persistent, reg->content_str);
+    if (r->etag != NULL) {
+	/* A body gets the tag when its content coding is known. */
+	if (r->verb == VERB_HEAD) {
+	    httpd_print(h, HP_SEND, "ETag: %s\n", r->etag);
+	} else {
+	    r->tagged = true;
+	}
+	httpd_print(h, HP_SEND, "Cache-Control: no-cache\n");
+    } else {
+	httpd_print(h, HP_SEND, "Cache-Control: no-store\n");
+    }
+    return reg;
+}
+
+/**
+ * Finish a successful dynamic HTTP response.
+ *
+ * @param[in,out] h	State
+ *
+ * @return httpd_status_t (HS_SUCCESS_OPEN or HS_SUCCESS_CLOSE).
+ */
+static httpd_status_t
+httpd_dyn_done(httpd_t *h)
+{
+    request_t *r = &h->request;
+
+    if (!r->persistent) {
+	return HS_SUCCESS_CLOSE;
+    } else {
+	httpd_reinit_request(r);
+	return HS_SUCCESS_OPEN;
+    }
+}
+
 /**
  * Successfully complete a dynamic HTTP request.
  *
@@ -2037,19 +2653,12 @@ httpd_status_t
 httpd_dyn_complete(void *dhandle, const char *format, ...)
 {
     httpd_t *h = (httpd_t *)dhandle;
-    request_t *r = &h->request;
-    httpd_reg_t *reg = r->async_node;
+    httpd_reg_t *reg = httpd_dyn_header(h);
     va_list ap;
 
-    /* Un-mark the node. */
-    r->async_node = NULL;
-
-    /* Generate the output. */
-    httpd_http_header(h, 200, !r->persistent, reg->content_str);
-    httpd_print(h, HP_SEND, "Cache-Control: no-store\n");
-
-    switch (r->verb) {
+    switch (h->request.verb) {
     case VERB_GET:
+    case VERB_POST:
     case VERB_OTHER:
 	/* Generate the body. */
 	if (reg->content_type == CT_HTML) {
@@ -2071,17 +2680,45 @@ httpd_dyn_complete(void *dhandle, const char *format, ...)
 	httpd_print_dump(h, DUMP_WITH_LENGTH);
 	break;
     case VERB_HEAD:
+	httpd_vary(h);
 	httpd_print(h, HP_SEND, "\n");
 	break;
     }
 
-    /* Return status. */
-    if (!r->persistent) {
-	return HS_SUCCESS_CLOSE;
-    } else {
-	httpd_reinit_request(r);
-	return HS_SUCCESS_OPEN;
+    return httpd_dyn_done(h);
+}
+
+/**
+ * Successfully complete a dynamic HTTP request with a body that is sent
+ * as-is, without newline expansion.
+ *
+ * @param[in] dhandle	handle returned by httpd_new
+ * @param[in] buf	Body
+ * @param[in] len	Length of body
+ *
+ * @return httpd_status_t, suitable for return from completion function
+ *  (HS_SUCCESS_OPEN or HS_SUCCESS_CLOSE).
+ */
+httpd_status_t
+httpd_dyn_complete_buf(void *dhandle, const char *buf, size_t len)
+{
+    httpd_t *h = (httpd_t *)dhandle;
+
+    (void) httpd_dyn_header(h);
+    switch (h->request.verb) {
+    case VERB_GET:
+    case VERB_POST:
+    case VERB_OTHER:
+	vb_append(&h->request.print_buf, buf, len);
+	httpd_print_dump(h, DUMP_WITH_LENGTH);
+	break;
+    case VERB_HEAD:
+	httpd_vary(h);
+	httpd_print(h, HP_SEND, "\n");
+	break;
     }
+
+    return httpd_dyn_done(h);
 }
 
 /**
@@ -2118,6 +2755,54 @@ httpd_dyn_error(void *dhandle, content_t content_type, int status_code,
     return rv;
 }
 
+/**
+ * Start a streaming response to a dynamic HTTP request.
+ *
+ * Writes the response header, without a Content-Length. The body is written
+ * later with httpd_stream_send(), and ends when the connection is closed.
+ *
+ * @param[in] dhandle	Connection handle
+ *
+ * @return httpd_status_t, suitable for return from the node callback
+ *  (HS_STREAM, or HS_SUCCESS_CLOSE for a HEAD request).
+ */
+httpd_status_t
+httpd_dyn_stream(void *dhandle)
+{
+    httpd_t *h = (httpd_t *)dhandle;
+    request_t *r = &h->request;
+    httpd_reg_t *reg = r->async_node;
+
+    /* Un-mark the node. */
+    r->async_node = NULL;
+
+    /* Generate the header. */
+    httpd_http_header(h, 200, true, reg->content_str);
+    httpd_print(h, HP_SEND, "Cache-Control: no-store\n");
+    httpd_print(h, HP_SEND, "\n");
+
+    if (r->verb == VERB_HEAD) {
+	return HS_SUCCESS_CLOSE;
+    }
+    return HS_STREAM;
+}
+
+/**
+ * Send part of the body of a streaming response.
+ *
+ * @param[in] dhandle	Connection handle
+ * @param[in] buf	Data buffer
+ * @param[in] len	Data buffer length
+ */
+void
+httpd_stream_send(void *dhandle, const char *buf, size_t len)
+{
+    httpd_t *h = (httpd_t *)dhandle;
+
+    httpd_data_trace(h, ">", buf, len, &h->request.ot_offset);
+    hio_stream_send(h->mhandle, buf, len);
+}
+
 /**
  * Quote text to pass transparently through to HTML.
  *
@@ -2155,6 +2840,41 @@ html_quote(const char *text)
     return vb_consume(&r);
 }
 
+/**
+ * Quote text to pass transparently through to a JSON string.
+ *
+ * @param[in] text	Text to expand
+ *
+ * @return Expanded text, needs to be freed afterward
+ */
+char *
+json_quote(const char *text)
+{
+    varbuf_t r;
+    char c;
+
+    vb_init(&r);
+
+    while ((c = *text++)) {
+	switch (c) {
+	case '"':
+	    vb_appends(&r, "\\\"");
+	    break;
+	case '\\':
+	    vb_appends(&r, "\\\\");
+	    break;
+	default:
+	    if ((unsigned char)c < ' ') {
+		vb_appendf(&r, "\\u%04x", c);
+	    } else {
+		vb_append(&r, &c, 1);
+	    }
+	    break;
+	}
+    }
+    return vb_consume(&r);
+}
+
 /**
  * Quote a URI. Uses percent encoding.
  *
@@ -2203,3 +2923,25 @@ httpd_fetch_query(void *dhandle, const char *name)
     return NULL;
 
 }
+
+/**
+ * Fetch the body of the current request.
+ *
+ * @param[in] dhandle	Connection handle
+ * @param[out] len	Returned length of the body
+ *
+ * @return Body, or NULL if the request is not a POST
+ */
+const char *
+httpd_fetch_body(void *dhandle, size_t *len)
+{
+    httpd_t *h = dhandle;
+    request_t *r = &h->request;
+
+    if (r->verb != VERB_POST) {
+	*len = 0;
+	return NULL;
+    }
+    *len = vb_len(&r->body);
+    return vb_buf(&r->body);
+}
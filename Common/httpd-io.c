@@ -35,6 +35,7 @@
 #if !defined(_WIN32) /*[*/
 # include <unistd.h>
 # include <netinet/in.h>
+# include <netinet/tcp.h>
 # include <sys/select.h>
 # include <arpa/inet.h>
 #endif /*]*/
@@ -80,8 +81,10 @@ static hio_listener_t *global_listener = NULL;
 static llist_t listeners = LLIST_INIT(listeners);
 
 #define N_SESSIONS	32
-typedef struct {
+typedef struct session {
     llist_t link;	/* list linkage */
+    struct session *hash_next; /* hash chain linkage */
+    iosrc_t src;	/* input source, the hash key */
     socket_t s;		/* socket */
 #if defined(_WIN32) /*[*/
     HANDLE event;
@@ -90,6 +93,7 @@ typedef struct {
     int idle;
     ioid_t ioid;	/* AddInput ID */
     ioid_t toid;	/* AddTimeOut ID */
+    ioid_t hoid;	/* AddTimeOut ID for held input */
 
     struct {		/* pending command state: */
 	sendto_callback_t *callback; /* callback function */
@@ -97,10 +101,39 @@ typedef struct {
 	varbuf_t result; /* accumulated result data */
 	bool done;	/* is the command done? */
     } pending;
+    struct {		/* response output state: */
+	varbuf_t buf;	/* data the socket has not accepted yet */
+	ioid_t oid;	/* AddOutput ID, while there is unsent data */
+	bool waiting;	/* input is stopped until the data is sent */
+	const char *close_why; /* close reason, once the data is sent */
+    } output;
+    struct {		/* streaming response state: */
+	bool active;	/* is the response a stream? */
+	void *context;	/* node context */
+	hio_stream_closed_t *closed; /* node close callback */
+    } stream;
     hio_listener_t *listener;
 } session_t;
 llist_t sessions = LLIST_INIT(sessions);
 
+/* Sessions hashed by input source, for fast lookup on input and output. */
+#define SESSION_HASH_SIZE	64
+#if !defined(_WIN32) /*[*/
+# define SESSION_HASH(src)	((unsigned)(src) % SESSION_HASH_SIZE)
+#else /*][*/
+# define SESSION_HASH(src)	\
+    ((unsigned)((uintptr_t)(src) >> 2) % SESSION_HASH_SIZE)
+#endif /*]*/
+static session_t *session_hash[SESSION_HASH_SIZE];
+
+#define RECV_BUFSIZE	16384
+
+void hio_socket_input(iosrc_t fd, ioid_t id);
+static void hio_held_input(ioid_t id);
+#if !defined(_WIN32) /*[*/
+static void hio_socket_output(iosrc_t fd, ioid_t id);
+#endif /*]*/
+
 /**
  * Return the text for the most recent socket error.
  *
@@ -116,6 +149,62 @@ socket_errtext(void)
 #endif /*]*/
 }
 
+/**
+ * Add a session to the hash table.
+ *
+ * @param[in] session	Session
+ */
+static void
+session_hash_add(session_t *session)
+{
+    unsigned h = SESSION_HASH(session->src);
+
+    session->hash_next = session_hash[h];
+    session_hash[h] = session;
+}
+
+/**
+ * Remove a session from the hash table.
+ *
+ * @param[in] session	Session
+ */
+static void
+session_hash_remove(session_t *session)
+{
+    session_t **sp;
+
+    for (sp = &session_hash[SESSION_HASH(session->src)];
+	 *sp != NULL;
+	 sp = &(*sp)->hash_next) {
+	if (*sp == session) {
+	    *sp = session->hash_next;
+	    break;
+	}
+    }
+}
+
+/**
+ * Find the session for an input source.
+ *
+ * @param[in] src	Input source
+ *
+ * @return Session, or NULL
+ */
+static session_t *
+session_lookup(iosrc_t src)
+{
+    session_t *session;
+
+    for (session = session_hash[SESSION_HASH(src)];
+	 session != NULL;
+	 session = session->hash_next) {
+	if (session->src == src) {
+	    return session;
+	}
+    }
+    return NULL;
+}
+
 /**
  * Close the session associated with a particular socket.
  * Called from the HTTPD logic when a fatal error or EOF occurs.
@@ -132,15 +221,26 @@ hio_socket_close(session_t *session)
     if (session->toid != NULL_IOID) {
 	RemoveTimeOut(session->toid);
     }
+    if (session->hoid != NULL_IOID) {
+	RemoveTimeOut(session->hoid);
+    }
 #if defined(_WIN32) /*[*/
     CloseHandle(session->event);
 #endif /*]*/
+    if (session->output.oid != NULL_IOID) {
+	RemoveInput(session->output.oid);
+    }
+    vb_free(&session->output.buf);
+    if (session->stream.active) {
+	(*session->stream.closed)(session->stream.context);
+    }
     vb_free(&session->pending.result);
+    session_hash_remove(session);
     llist_unlink(&session->link);
-    Free(session);
     if (session->listener != NULL) {
 	session->listener->n_sessions--;
     }
+    Free(session);
 }
 
 /**
@@ -170,32 +270,255 @@ hio_timeout(ioid_t id)
 }
 
 /**
- * New inbound data for an httpd connection.
+ * Send as much pending output as the socket will accept.
+ *
+ * Sockets are non-blocking, so a client that is slow to read cannot stall
+ * the emulator. Whatever is left over is sent when the socket is ready for
+ * it.
+ *
+ * @param[in,out] session	Session
+ *
+ * @return true if everything has been sent
+ */
+static bool
+hio_flush(session_t *session)
+{
+    ssize_t nw;
+#if !defined(_WIN32) /*[*/
+    varbuf_t rest;
+#endif /*]*/
+
+    if (vb_len(&session->output.buf) == 0) {
+	return true;
+    }
+
+    nw = send(session->s, vb_buf(&session->output.buf),
+	    (int)vb_len(&session->output.buf), 0);
+    if (nw < 0) {
+	if (socket_errno() != SE_EWOULDBLOCK) {
+	    /* The input side will notice that the client is gone. */
+	    vtrace("http send error: %s\n", socket_errtext());
+	    vb_reset(&session->output.buf);
+	    return true;
+	}
+	nw = 0;
+    }
+    if ((size_t)nw == vb_len(&session->output.buf)) {
+	vb_reset(&session->output.buf);
+	return true;
+    }
+
+#if !defined(_WIN32) /*[*/
+    vb_init(&rest);
+    vb_append(&rest, vb_buf(&session->output.buf) + nw,
+	    vb_len(&session->output.buf) - nw);
+    vb_free(&session->output.buf);
+    session->output.buf = rest;
+    if (session->output.oid == NULL_IOID) {
+	session->output.oid = AddOutput(session->s, hio_socket_output);
+    }
+    return false;
+#else /*][*/
+    /* There are no output events to wait for. */
+    vtrace("http send: %u bytes dropped\n",
+	    (unsigned)(vb_len(&session->output.buf) - nw));
+    vb_reset(&session->output.buf);
+    return true;
+#endif /*]*/
+}
+
+/**
+ * Close a session once its output has been sent.
+ *
+ * @param[in,out] session	Session
+ * @param[in] why		Reason (for debug)
+ */
+static void
+hio_finish(session_t *session, const char *why)
+{
+    if (hio_flush(session)) {
+	httpd_close(session->dhandle, why);
+	hio_socket_close(session);
+	return;
+    }
+
+    /* Stop everything but output, and give the client a while to read it. */
+    session->output.close_why = why;
+    if (session->ioid != NULL_IOID) {
+	RemoveInput(session->ioid);
+	session->ioid = NULL_IOID;
+    }
+    if (session->hoid != NULL_IOID) {
+	RemoveTimeOut(session->hoid);
+	session->hoid = NULL_IOID;
+    }
+    if (session->toid == NULL_IOID) {
+	session->toid = AddTimeOut(IDLE_MAX * 1000, hio_timeout);
+    }
+}
+
+/**
+ * Get ready for the next request on a session.
+ *
+ * Input is not read while a response is still being sent. Requests that
+ * were pipelined behind the last one are processed from a timeout, so other
+ * sessions and the keyboard get a turn first.
+ *
+ * @param[in,out] session	Session
+ */
+static void
+hio_resume(session_t *session)
+{
+    if (!hio_flush(session)) {
+	/* Wait for the client to catch up. */
+	session->output.waiting = true;
+	if (session->ioid != NULL_IOID) {
+	    RemoveInput(session->ioid);
+	    session->ioid = NULL_IOID;
+	}
+    } else if (httpd_held(session->dhandle)) {
+	/* Process the next request first. */
+	if (session->ioid != NULL_IOID) {
+	    RemoveInput(session->ioid);
+	    session->ioid = NULL_IOID;
+	}
+	if (session->hoid == NULL_IOID) {
+	    session->hoid = AddTimeOut(1, hio_held_input);
+	}
+    } else if (session->ioid == NULL_IOID) {
+	/* Allow more input. */
+	session->ioid = AddInput(session->src, hio_socket_input);
+    }
+
+    /*
+     * Set a timeout for more input to arrive. We didn't set this timeout
+     * as soon as the last input arrived, because it might have taken us a
+     * long time to proces the last request.
+     */
+    if (session->toid == NULL_IOID) {
+	session->toid = AddTimeOut(IDLE_MAX * 1000, hio_timeout);
+    }
+}
+
+#if !defined(_WIN32) /*[*/
+/**
+ * Output is possible on a session with unsent data.
  *
  * @param[in] fd	socket file descriptor
  * @param[in] id	I/O ID
  */
-void
-hio_socket_input(iosrc_t fd, ioid_t id)
+static void
+hio_socket_output(iosrc_t fd, ioid_t id)
+{
+    session_t *session;
+
+    session = session_lookup(fd);
+    if (session == NULL || session->output.oid != id) {
+	vtrace("httpd mystery output\n");
+	return;
+    }
+
+    if (!hio_flush(session)) {
+	return;
+    }
+    RemoveInput(session->output.oid);
+    session->output.oid = NULL_IOID;
+
+    if (session->output.close_why != NULL) {
+	httpd_close(session->dhandle, session->output.close_why);
+	hio_socket_close(session);
+    } else if (session->output.waiting) {
+	session->output.waiting = false;
+	hio_resume(session);
+    }
+}
+#endif /*]*/
+
+/**
+ * Act on the status of processing input.
+ *
+ * @param[in] session	Session
+ * @param[in] rv	Status returned by httpd_input or httpd_input_held
+ */
+static void
+hio_input_status(session_t *session, httpd_status_t rv)
+{
+    if (rv < 0) {
+	hio_finish(session, "protocol error");
+	return;
+    }
+
+    if (rv == HS_PENDING) {
+	/* Stop input on this socket. */
+	(void) hio_flush(session);
+	if (session->ioid != NULL_IOID) {
+	    RemoveInput(session->ioid);
+	    session->ioid = NULL_IOID;
+	}
+	return;
+    }
+
+    if (rv == HS_STREAM) {
+	/*
+	 * Leave input enabled, because it tells us when the client goes away.
+	 * There is no timeout.
+	 */
+	(void) hio_flush(session);
+	if (session->ioid == NULL_IOID) {
+	    session->ioid = AddInput(session->src, hio_socket_input);
+	}
+	return;
+    }
+
+    hio_resume(session);
+}
+
+/**
+ * Process input that arrived behind an asynchronous request.
+ *
+ * @param[in] id	timeout ID
+ */
+static void
+hio_held_input(ioid_t id)
 {
     session_t *session;
-    char buf[1024];
-    ssize_t nr;
 
     session = NULL;
     FOREACH_LLIST(&sessions, session, session_t *) {
-	if (session->ioid == id) {
+	if (session->hoid == id) {
 	    break;
 	}
     } FOREACH_LLIST_END(&sessions, session, session_t *);
     if (session == NULL) {
-	vtrace("httpd mystery input\n");
+	vtrace("httpd mystery held input\n");
 	return;
     }
+    session->hoid = NULL_IOID;
+    if (session->toid != NULL_IOID) {
+	RemoveTimeOut(session->toid);
+	session->toid = NULL_IOID;
+    }
+    hio_input_status(session, httpd_input_held(session->dhandle));
+}
 
-    /* Move this session to the front of the list. */
-    llist_unlink(&session->link);
-    LLIST_PREPEND(&session->link, sessions);
+/**
+ * New inbound data for an httpd connection.
+ *
+ * @param[in] fd	socket file descriptor
+ * @param[in] id	I/O ID
+ */
+void
+hio_socket_input(iosrc_t fd, ioid_t id)
+{
+    session_t *session;
+    char buf[RECV_BUFSIZE];
+    ssize_t nr;
+
+    session = session_lookup(fd);
+    if (session == NULL || session->ioid != id) {
+	vtrace("httpd mystery input\n");
+	return;
+    }
 
     session->idle = 0;
 
@@ -205,6 +528,10 @@ hio_socket_input(iosrc_t fd, ioid_t id)
     }
 
     nr = recv(session->s, buf, sizeof(buf), 0);
+    if (nr > 0 && session->stream.active) {
+	/* The client has nothing more to say on a stream. Ignore it. */
+	return;
+    }
     if (nr <= 0) {
 	const char *ebuf;
 	bool harmless = false;
@@ -223,20 +550,7 @@ hio_socket_input(iosrc_t fd, ioid_t id)
 	    hio_socket_close(session);
 	}
     } else {
-	httpd_status_t rv;
-
-	rv = httpd_input(session->dhandle, buf, nr);
-	if (rv < 0) {
-	    httpd_close(session->dhandle, "protocol error");
-	    hio_socket_close(session);
-	} else if (rv == HS_PENDING) {
-	    /* Stop input on this socket. */
-	    RemoveInput(session->ioid);
-	    session->ioid = NULL_IOID;
-	} else if (session->toid == NULL_IOID) {
-	    /* Leave input enabled and start the timeout. */
-	    session->toid = AddTimeOut(IDLE_MAX * 1000, hio_timeout);
-	}
+	hio_input_status(session, httpd_input(session->dhandle, buf, nr));
     }
 }
 
@@ -262,6 +576,7 @@ hio_connection(iosrc_t fd, ioid_t id)
     socklen_t len;
     char hostbuf[128];
     session_t *session;
+    int on = 1;
 
     /* Find the listener. */
     FOREACH_LLIST(&listeners, l, hio_listener_t *) {
@@ -291,12 +606,23 @@ hio_connection(iosrc_t fd, ioid_t id)
 
 #if !defined(_WIN32) /*[*/
     fcntl(t, F_SETFD, 1);
+    fcntl(t, F_SETFL, fcntl(t, F_GETFL) | O_NONBLOCK);
 #endif /*]*/
 
+    /*
+     * Responses are written in several pieces. Don't let Nagle's algorithm
+     * hold back the last one until the client's delayed ACK.
+     */
+    if (setsockopt(t, IPPROTO_TCP, TCP_NODELAY, (char *)&on,
+		sizeof(on)) < 0) {
+	vtrace("httpd setsockopt(TCP_NODELAY): %s\n", socket_errtext());
+    }
+
     session = Malloc(sizeof(session_t));
     memset(session, 0, sizeof(session_t));
     session->listener = l;
     vb_init(&session->pending.result);
+    vb_init(&session->output.buf);
     session->s = t;
 #if defined(_WIN32) /*[*/
     session->event = CreateEvent(NULL, FALSE, FALSE, NULL);
@@ -334,15 +660,17 @@ hio_connection(iosrc_t fd, ioid_t id)
 	session->dhandle = httpd_new(session, "???");
     }
 #if !defined(_WIN32) /*[*/
-    session->ioid = AddInput(t, hio_socket_input);
+    session->src = t;
 #else /*][*/
-    session->ioid = AddInput(session->event, hio_socket_input);
+    session->src = session->event;
 #endif /*]*/
+    session->ioid = AddInput(session->src, hio_socket_input);
 
     /* Set the timeout for the first line of input. */
     session->toid = AddTimeOut(IDLE_MAX * 1000, hio_timeout);
 
     LLIST_APPEND(&session->link, sessions);
+    session_hash_add(session);
     l->n_sessions++;
 }
 
@@ -514,6 +842,9 @@ hio_stop(void)
 /**
  * Send output on an http session.
  *
+ * The output is queued, and sent when processing of the request is
+ * finished.
+ *
  * @param[in] mhandle	our handle
  * @param[in] buf	buffer to transmit
  * @param[in] len	length of buffer
@@ -522,12 +853,56 @@ void
 hio_send(void *mhandle, const char *buf, size_t len)
 {
     session_t *s = mhandle;
-    ssize_t nw;
 
-    nw = send(s->s, buf, (int)len, 0);
-    if (nw < 0) {
-	vtrace("http send error: %s\n", socket_errtext());
-    }
+    vb_append(&s->output.buf, buf, len);
+}
+
+/**
+ * Turn a session into a stream.
+ *
+ * @param[in] dhandle	Session handle
+ * @param[in] context	Node context, passed to the close callback
+ * @param[in] closed	Function to call when the session is closed
+ */
+void
+hio_stream_start(void *dhandle, void *context, hio_stream_closed_t *closed)
+{
+    session_t *s = httpd_mhandle(dhandle);
+
+    s->stream.active = true;
+    s->stream.context = context;
+    s->stream.closed = closed;
+}
+
+/**
+ * Send output on a streaming session.
+ *
+ * @param[in] mhandle	our handle
+ * @param[in] buf	buffer to transmit
+ * @param[in] len	length of buffer
+ */
+void
+hio_stream_send(void *mhandle, const char *buf, size_t len)
+{
+    session_t *s = mhandle;
+
+    hio_send(s, buf, len);
+    (void) hio_flush(s);
+}
+
+/**
+ * Check a streaming session for back-pressure.
+ *
+ * @param[in] dhandle	Session handle
+ *
+ * @return true if the client has not yet accepted everything sent to it
+ */
+bool
+hio_stream_busy(void *dhandle)
+{
+    session_t *s = httpd_mhandle(dhandle);
+
+    return vb_len(&s->output.buf) != 0;
 }
 
 /**
@@ -622,17 +997,21 @@ hio_complete(task_cbh handle, bool success, bool abort)
 {
     session_t *s = handle;
     char *prompt = task_cb_prompt(handle);
+    varbuf_t result = s->pending.result;
 
     /* We're done. */
     s->pending.done = true;
 
+    /*
+     * Get ready for the next command. The session may be closed by the
+     * time the callback returns.
+     */
+    vb_init(&s->pending.result);
+
     /* Pass the result up to the node. */
     s->pending.callback(s->dhandle, success? SC_SUCCESS: SC_USER_ERROR,
-	    vb_buf(&s->pending.result), vb_len(&s->pending.result), prompt,
-	    strlen(prompt));
-
-    /* Get ready for the next command. */
-    vb_reset(&s->pending.result);
+	    vb_buf(&result), vb_len(&result), prompt, strlen(prompt));
+    vb_free(&result);
 
     /* This is always the end of the command. */
     return true;
@@ -707,27 +1086,10 @@ hio_async_done(void *dhandle, httpd_status_t rv)
     session_t *session = httpd_mhandle(dhandle);
 
     if (rv < 0) {
-	hio_socket_close(session);
+	hio_finish(session, "request complete");
 	return;
     }
-
-    /* Allow more input. */
-    if (session->ioid == NULL_IOID) {
-#if !defined(_WIN32) /*[*/
-	session->ioid = AddInput(session->s, hio_socket_input);
-#else /*][*/
-	session->ioid = AddInput(session->event, hio_socket_input);
-#endif /*]*/
-    }
-
-    /*
-     * Set a timeout for that input to arrive. We didn't set this timeout
-     * as soon as the last input arrived, because it might have taken us a
-     * long time to proces the last request.
-     */
-    if (session->toid == NULL_IOID) {
-	session->toid = AddTimeOut(IDLE_MAX * 1000, hio_timeout);
-    }
+    hio_resume(session);
 }
 
 /**
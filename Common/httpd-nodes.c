@@ -42,96 +42,246 @@
 #include <fcntl.h>
 #include <assert.h>
 
+#include "3270ds.h"
+#include "boolstr.h"
+#include "ctlr.h"
+#include "ctlrc.h"
 #include "fprint_screen.h"
+#include "kybd.h"
+#include "lazya.h"
+#include "metrics.h"
+#include "names.h"
+#include "nvt.h"
+#include "telnet.h"
+#include "unicodec.h"
+#include "utf8.h"
+#include "utils.h"
 #include "varbuf.h"
 
 #include "httpd-core.h"
 #include "httpd-io.h"
 #include "httpd-nodes.h"
 
-#if defined(_WIN32) /*[*/
-# include "winprint.h"
-#endif /*]*/
-
 extern unsigned char favicon[];
 extern unsigned favicon_size;
 
+/* The emulator state the last generation number was assigned to. */
+static struct {
+    unsigned long generation;	/* generation number */
+    unsigned long screen_generation; /* screen_generation */
+    unsigned long state_generation; /* state_generation */
+    struct ea *ea_buf;		/* buffer */
+    int cursor_addr;		/* cursor address */
+    unsigned kybdlock;		/* keyboard lock */
+    enum cstate cstate;		/* connection state */
+    int rows, cols;		/* screen dimensions */
+} hn_state;
+static time_t hn_epoch;		/* time the first tag was generated */
+
+/* The most recently rendered screen image. */
+static struct {
+    bool valid;			/* true if image is valid */
+    varbuf_t image;		/* HTML image */
+    unsigned long generation;	/* generation it was rendered from */
+} image_cache;
+
+/* Event stream clients. */
+#define STREAM_PACE_MS	100	/* how often streams are brought up to date */
+#define STREAM_KEEPALIVE 15	/* seconds between keepalives on idle streams */
+typedef struct {
+    llist_t link;		/* list linkage */
+    void *dhandle;		/* session handle */
+    bool started;		/* true if initial state has been sent */
+    unsigned long generation;	/* generation last sent */
+    int rows, cols;		/* screen dimensions last sent */
+    char **text;		/* row text last sent */
+    int cursor_addr;		/* cursor address last sent */
+    unsigned kybdlock;		/* keyboard lock last sent */
+    bool formatted;		/* formatted state last sent */
+    enum cstate cstate;		/* connection state last sent */
+    time_t last_send;		/* time of last output */
+} hn_stream_t;
+static llist_t streams = LLIST_INIT(streams);
+static ioid_t stream_id = NULL_IOID;
+
+/* Batch requests in progress. */
+typedef struct {
+    llist_t link;		/* list linkage */
+    void *dhandle;		/* session handle */
+    char **actions;		/* actions to run */
+    int n_actions;		/* number of actions */
+    int next;			/* index of the next action to run */
+    bool stop_on_error;		/* true to stop at the first failure */
+    bool screen;		/* true to include the screen in the response */
+    bool failed;		/* true if any action has failed */
+    bool running;		/* true while hn_batch_run is starting actions */
+    varbuf_t results;		/* results so far */
+} hn_batch_t;
+static llist_t batches = LLIST_INIT(batches);
+
+static void hn_batch_complete(void *dhandle, sendto_cbs_t cbs,
+	const char *buf, size_t len, const char *sl_buf, size_t sl_len);
+
+/* Actions whose results depend only on the emulator state. */
+static const char *read_only_actions[] = {
+    AnAscii, AnAscii1, AnAsciiField,
+    AnEbcdic, AnEbcdic1, AnEbcdicField,
+    AnReadBuffer,
+    NULL
+};
+
+/**
+ * Return the emulator state generation number.
+ *
+ * The number changes whenever the screen buffer, cursor, keyboard lock
+ * (OIA) state, connection state, screen dimensions or settings change.
+ *
+ * @return generation number
+ */
+static unsigned long
+hn_generation(void)
+{
+    if (hn_state.screen_generation != screen_generation ||
+	    hn_state.state_generation != state_generation ||
+	    hn_state.ea_buf != ea_buf ||
+	    hn_state.cursor_addr != cursor_addr ||
+	    hn_state.kybdlock != kybdlock ||
+	    hn_state.cstate != cstate ||
+	    hn_state.rows != ROWS ||
+	    hn_state.cols != COLS) {
+	hn_state.generation++;
+	hn_state.screen_generation = screen_generation;
+	hn_state.state_generation = state_generation;
+	hn_state.ea_buf = ea_buf;
+	hn_state.cursor_addr = cursor_addr;
+	hn_state.kybdlock = kybdlock;
+	hn_state.cstate = cstate;
+	hn_state.rows = ROWS;
+	hn_state.cols = COLS;
+    }
+    return hn_state.generation;
+}
+
+/**
+ * Entity tag function for the emulator state.
+ *
+ * The tag includes the time the first one was generated, so tags from an
+ * earlier instance of the emulator will not match.
+ *
+ * @param[in] uri	URI fragment (ignored)
+ *
+ * @return entity tag
+ */
+static const char *
+hn_state_etag(const char *uri _is_unused)
+{
+    if (hn_epoch == 0) {
+	hn_epoch = time(NULL);
+    }
+    return lazyaf("\"%lx-%lx\"", (unsigned long)hn_epoch, hn_generation());
+}
+
+/**
+ * Entity tag function for the REST nodes.
+ *
+ * Only a single action whose result depends only on the emulator state
+ * can be tagged. Anything else might have side effects, so it must always
+ * be run.
+ *
+ * @param[in] uri	URI fragment (the action)
+ *
+ * @return entity tag, or NULL
+ */
+static const char *
+hn_rest_etag(const char *uri)
+{
+    const char *s = uri;
+    size_t nlen;
+    int i;
+
+    /* Isolate the action name. */
+    while (isspace((unsigned char)*s)) {
+	s++;
+    }
+    for (nlen = 0; isalnum((unsigned char)s[nlen]); nlen++) {
+    }
+    for (i = 0; read_only_actions[i] != NULL; i++) {
+	if (strlen(read_only_actions[i]) == nlen &&
+		!strncasecmp(s, read_only_actions[i], nlen)) {
+	    break;
+	}
+    }
+    if (read_only_actions[i] == NULL) {
+	return NULL;
+    }
+
+    /* Allow simple parameters, but nothing after them. */
+    s += nlen;
+    while (isspace((unsigned char)*s)) {
+	s++;
+    }
+    if (*s == '(') {
+	s += 1 + strcspn(s + 1, "()\"");
+	if (*s++ != ')') {
+	    return NULL;
+	}
+	while (isspace((unsigned char)*s)) {
+	    s++;
+	}
+    }
+    if (*s) {
+	return NULL;
+    }
+
+    return hn_state_etag(uri);
+}
+
 /**
  * Capture the screen image.
  *
+ * The image is rendered directly into memory and cached, so repeated
+ * requests for an unchanged screen do not render it again.
+ *
  * @param[in] d		Session handle
- * @param[out] image	Image in HTML, if succeeded; must free when finished
+ * @param[out] image	Image in HTML, if succeeded; valid until the next call
  * @param[out] status	Error code, if failed
  *
  * @return true for success, false for failure
  */
 static bool
-hn_image(void *dhandle, varbuf_t *image, httpd_status_t *status)
+hn_image(void *dhandle, const varbuf_t **image, httpd_status_t *status)
 {
-    httpd_status_t rv;
-    int fd;
-    FILE *f;
-    char *temp_name;
-    char buf[8192];
-
-    /* Open the temporary file. */
-#if defined(_WIN32) /*[*/
-    fd = win_mkstemp(&temp_name, P_HTML);
-#else /*][*/
-    temp_name = NewString("/tmp/x3hXXXXXX");
-    fd = mkstemp(temp_name);
-#endif /*]*/
-    if (fd < 0) {
-	rv = httpd_dyn_error(dhandle, CT_HTML, 400, "Internal error (open)");
-	unlink(temp_name);
-	Free(temp_name);
-	*status = rv;
-	return false;
-    }
-    f = fdopen(fd, "w+");
-    if (f == NULL) {
-	rv = httpd_dyn_error(dhandle, CT_HTML, 400, "Internal error (fdopen)");
-	close(fd);
-	unlink(temp_name);
-	Free(temp_name);
-	*status = rv;
-	return false;
+    unsigned long generation = hn_generation();
+
+    if (image_cache.valid && image_cache.generation == generation) {
+	*image = &image_cache.image;
+	return true;
     }
 
-    /* Write the screen to it in HTML. */
-    switch (fprint_screen(f, P_HTML, FPS_NO_HEADER, NULL, NULL, NULL)) {
+    /* Write the screen in HTML. */
+    image_cache.valid = false;
+    vb_reset(&image_cache.image);
+    switch (fprint_screen_vb(&image_cache.image, P_HTML, FPS_NO_HEADER,
+		NULL)) {
     case FPS_STATUS_SUCCESS:
     case FPS_STATUS_SUCCESS_WRITTEN:
 	break;
     case FPS_STATUS_ERROR:
     case FPS_STATUS_CANCEL:
-	rv = httpd_dyn_error(dhandle, CT_HTML, 400,
+	*status = httpd_dyn_error(dhandle, CT_HTML, 400,
 		"Internal error (fprint_screen)");
-	fclose(f);
-	unlink(temp_name);
-	Free(temp_name);
-	*status = rv;
 	return false;
     case FPS_STATUS_WAIT:
 	assert(false);
 	return false;
     }
 
-
-    /* Read it back into a varbuf_t. */
-    fflush(f);
-    rewind(f);
-    vb_init(image);
-    while (fgets(buf, sizeof(buf), f) != NULL) {
-	vb_appends(image, buf);
-    }
-
-    /* Dispose of the file. */
-    fclose(f);
-    unlink(temp_name);
-    Free(temp_name);
+    /* Remember what it was rendered from. */
+    image_cache.valid = true;
+    image_cache.generation = generation;
 
     /* Success. */
+    *image = &image_cache.image;
     return true;
 }
 
@@ -147,7 +297,7 @@ static httpd_status_t
 hn_screen_image(const char *uri, void *dhandle)
 {
     httpd_status_t rv;
-    varbuf_t r;
+    const varbuf_t *r;
 
     /* Get the image. */
     if (hn_image(dhandle, &r, &rv)) {
@@ -157,8 +307,7 @@ hn_screen_image(const char *uri, void *dhandle)
 <title>3270 Screen Image</title>\n\
 </head>\n\
 <body>\n\
-%.*s\n", (int)vb_len(&r), vb_buf(&r));
-	vb_free(&r);
+%.*s\n", (int)vb_len(r), vb_buf(r));
     }
     return rv;
 }
@@ -185,7 +334,7 @@ static void
 dyn_form_complete(void *dhandle, sendto_cbs_t cbs, const char *buf,
 	size_t len, const char *sl_buf, size_t sl_len)
 {
-    varbuf_t r;
+    const varbuf_t *r;
     httpd_status_t rv = HS_CONTINUE;
 
     switch (cbs) {
@@ -204,7 +353,7 @@ CMD_FORM
 <pre>%.*s</pre>\n\
 <h2>Result</h2>\n\
 <pre>%.*s</pre>",
-		    vb_buf(&r),
+		    vb_buf(r),
 		    sl_len, sl_buf,
 		    len, buf);
 	    } else {
@@ -220,10 +369,9 @@ CMD_FORM
 <pre>%.*s</pre>\n\
 <h2>Result</h2>\n\
 <i>(none)</i>",
-		    vb_buf(&r),
+		    vb_buf(r),
 		    sl_len, sl_buf);
 	    }
-	    vb_free(&r);
 	}
 	break;
     case SC_USER_ERROR:
@@ -249,7 +397,7 @@ hn_interact(const char *uri, void *dhandle)
 {
     const char *action;
     httpd_status_t rv;
-    varbuf_t r;
+    const varbuf_t *r;
 
     /* If the specified an action, execute it. */
     action = httpd_fetch_query(dhandle, "action");
@@ -282,9 +430,7 @@ hn_interact(const char *uri, void *dhandle)
 CMD_FORM
 "<br>\n\
 %s\n",
-	    vb_buf(&r));
-
-    vb_free(&r);
+	    vb_buf(r));
 
     return rv;
 }
@@ -570,6 +716,675 @@ rest_json_dyn(const char *url, void *dhandle)
     }
 }
 
+/**
+ * Append a JSON-quoted row of the screen to a buffer.
+ *
+ * The row is rendered the same way as by the Ascii() action.
+ *
+ * @param[in] row	Row number
+ * @param[in,out] r	Buffer
+ */
+static void
+hn_row_text(int row, varbuf_t *r)
+{
+    int baddr = row * COLS;
+    bool is_zero = FA_IS_ZERO(get_field_attribute(baddr));
+    int col;
+
+    vb_appends(r, "\"");
+    for (col = 0; col < COLS; col++, baddr++) {
+	enum dbcs_state d = ctlr_dbcs_state(baddr);
+	ucs4_t uc;
+	char utf8[6];
+	int len;
+
+	if (ea_buf[baddr].fa) {
+	    is_zero = FA_IS_ZERO(ea_buf[baddr].fa);
+	    uc = ' ';
+	} else if (is_zero) {
+	    uc = ' ';
+	} else if (IS_RIGHT(d)) {
+	    continue;
+	} else if (is_nvt(&ea_buf[baddr], false, &uc)) {
+	    /* NVT-mode text. */
+	} else if (IS_LEFT(d)) {
+	    uc = ebcdic_to_unicode((ea_buf[baddr].ec << 8) |
+		    ea_buf[baddr + 1].ec, CS_BASE, EUO_NONE);
+	} else {
+	    uc = ebcdic_to_unicode(ea_buf[baddr].ec, ea_buf[baddr].cs,
+		    EUO_BLANK_UNDEF);
+	}
+	if (uc == 0) {
+	    uc = ' ';
+	}
+
+	if (uc == '"' || uc == '\\') {
+	    vb_appendf(r, "\\%c", (char)uc);
+	} else if (uc < ' ') {
+	    vb_appendf(r, "\\u%04x", (unsigned)uc);
+	} else if ((len = unicode_to_utf8(uc, utf8)) > 0) {
+	    vb_append(r, utf8, len);
+	}
+    }
+    vb_appends(r, "\"");
+}
+
+/**
+ * Free the row text saved for a stream.
+ *
+ * @param[in,out] st	Stream
+ */
+static void
+hn_stream_free_text(hn_stream_t *st)
+{
+    int i;
+
+    if (st->text != NULL) {
+	for (i = 0; i < st->rows; i++) {
+	    Free(st->text[i]);
+	}
+	Replace(st->text, NULL);
+    }
+}
+
+/**
+ * Bring an event stream up to date.
+ *
+ * Nothing is sent while the client has not accepted what was sent to it
+ * already. Changes that happen in the meantime are coalesced, and only the
+ * state when the client catches up is sent.
+ *
+ * @param[in,out] st	Stream
+ */
+static void
+hn_stream_update(hn_stream_t *st)
+{
+    unsigned long generation;
+    varbuf_t r;
+    bool any = false;
+    int nlines = 0;
+    int row;
+
+    if (hio_stream_busy(st->dhandle)) {
+	return;
+    }
+
+    generation = hn_generation();
+    if (st->started && generation == st->generation) {
+	if (time(NULL) - st->last_send >= STREAM_KEEPALIVE) {
+	    httpd_stream_send(st->dhandle, ":\n\n", 3);
+	    st->last_send = time(NULL);
+	}
+	return;
+    }
+    vb_init(&r);
+
+    /* Connection state. */
+    if (!st->started || cstate != st->cstate) {
+	vb_appendf(&r, "event: connection\n"
+		"data: {\"state\":\"%s\",\"host\":\"%s\"}\n\n",
+		state_name[cstate],
+		(cstate > RECONNECTING && current_host != NULL)?
+		    lazya(json_quote(current_host)): "");
+	st->cstate = cstate;
+    }
+
+    /* Screen contents, all of it or just the rows that changed. */
+    if (!st->started || ROWS != st->rows || COLS != st->cols) {
+	hn_stream_free_text(st);
+	st->rows = ROWS;
+	st->cols = COLS;
+	st->text = (char **)Calloc(ROWS, sizeof(char *));
+	vb_appendf(&r, "event: screen\n"
+		"data: {\"rows\":%d,\"columns\":%d,\"erase\":true,"
+		"\"lines\":[", ROWS, COLS);
+	any = true;
+    }
+    for (row = 0; row < ROWS; row++) {
+	varbuf_t t;
+
+	vb_init(&t);
+	hn_row_text(row, &t);
+	if (st->text[row] != NULL && !strcmp(st->text[row], vb_buf(&t))) {
+	    vb_free(&t);
+	    continue;
+	}
+	if (!any) {
+	    vb_appends(&r, "event: screen\ndata: {\"lines\":[");
+	    any = true;
+	}
+	vb_appendf(&r, "%s{\"row\":%d,\"text\":%s}", nlines++? ",": "", row,
+		vb_buf(&t));
+	Replace(st->text[row], vb_consume(&t));
+    }
+    if (any) {
+	vb_appends(&r, "]}\n\n");
+    }
+
+    /* Cursor and keyboard lock. */
+    if (!st->started ||
+	    cursor_addr != st->cursor_addr ||
+	    kybdlock != st->kybdlock ||
+	    formatted != st->formatted) {
+	vb_appendf(&r, "event: oia\n"
+		"data: {\"cursor\":{\"row\":%d,\"column\":%d},"
+		"\"locked\":%s,\"error\":%s,\"formatted\":%s}\n\n",
+		cursor_addr / COLS, cursor_addr % COLS,
+		kybdlock? "true": "false",
+		(kybdlock & KL_OERR_MASK)? "true": "false",
+		formatted? "true": "false");
+	st->cursor_addr = cursor_addr;
+	st->kybdlock = kybdlock;
+	st->formatted = formatted;
+    }
+
+    st->started = true;
+    st->generation = generation;
+    if (vb_len(&r)) {
+	httpd_stream_send(st->dhandle, vb_buf(&r), vb_len(&r));
+	st->last_send = time(NULL);
+    }
+    vb_free(&r);
+}
+
+/**
+ * Timeout callback for event streams.
+ *
+ * @param[in] id	Timeout ID
+ */
+static void
+hn_stream_tick(ioid_t id _is_unused)
+{
+    hn_stream_t *st;
+
+    stream_id = NULL_IOID;
+    FOREACH_LLIST(&streams, st, hn_stream_t *) {
+	hn_stream_update(st);
+    } FOREACH_LLIST_END(&streams, st, hn_stream_t *);
+    if (!llist_isempty(&streams)) {
+	stream_id = AddTimeOut(STREAM_PACE_MS, hn_stream_tick);
+    }
+}
+
+/**
+ * Close callback for event streams.
+ *
+ * @param[in] context	Stream
+ */
+static void
+hn_stream_closed(void *context)
+{
+    hn_stream_t *st = (hn_stream_t *)context;
+
+    llist_unlink(&st->link);
+    hn_stream_free_text(st);
+    Free(st);
+    if (llist_isempty(&streams) && stream_id != NULL_IOID) {
+	RemoveTimeOut(stream_id);
+	stream_id = NULL_IOID;
+    }
+}
+
+/**
+ * Callback for the event stream node (/3270/rest/stream).
+ *
+ * @param[in] uri	URI
+ * @param[in] dhandle	Session handle
+ *
+ * @return httpd_status_t
+ */
+static httpd_status_t
+hn_stream(const char *uri _is_unused, void *dhandle)
+{
+    httpd_status_t rv;
+    hn_stream_t *st;
+
+    rv = httpd_dyn_stream(dhandle);
+    if (rv != HS_STREAM) {
+	return rv;
+    }
+
+    st = (hn_stream_t *)Calloc(1, sizeof(hn_stream_t));
+    llist_init(&st->link);
+    st->dhandle = dhandle;
+    hio_stream_start(dhandle, st, hn_stream_closed);
+    LLIST_APPEND(&st->link, streams);
+
+    /* Send the initial state now, and start watching for changes. */
+    hn_stream_update(st);
+    if (stream_id == NULL_IOID) {
+	stream_id = AddTimeOut(STREAM_PACE_MS, hn_stream_tick);
+    }
+    return rv;
+}
+
+/**
+ * Callback for the metrics node (/3270/metrics).
+ *
+ * @param[in] uri	URI
+ * @param[in] dhandle	Session handle
+ *
+ * @return httpd_status_t
+ */
+static httpd_status_t
+hn_metrics(const char *uri _is_unused, void *dhandle)
+{
+    varbuf_t r;
+    httpd_status_t rv;
+
+    vb_init(&r);
+    metrics_dump(&r);
+    rv = httpd_dyn_complete_buf(dhandle, vb_buf(&r), vb_len(&r));
+    vb_free(&r);
+    return rv;
+}
+
+/**
+ * Skip JSON white space.
+ *
+ * @param[in] s		Text
+ * @param[in] end	End of text
+ *
+ * @return Pointer to the first non-space character
+ */
+static const char *
+hn_json_ws(const char *s, const char *end)
+{
+    while (s < end && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')) {
+	s++;
+    }
+    return s;
+}
+
+/**
+ * Parse the four hex digits of a JSON \u escape.
+ *
+ * @param[in,out] sp	Text pointer, returned pointing past the digits
+ * @param[in] end	End of text
+ * @param[out] u	Returned value
+ *
+ * @return true for success
+ */
+static bool
+hn_json_hex4(const char **sp, const char *end, ucs4_t *u)
+{
+    const char *s = *sp;
+    int i;
+
+    if (end - s < 4) {
+	return false;
+    }
+    *u = 0;
+    for (i = 0; i < 4; i++) {
+	char c = s[i];
+
+	if (c >= '0' && c <= '9') {
+	    *u = (*u << 4) | (c - '0');
+	} else if (c >= 'a' && c <= 'f') {
+	    *u = (*u << 4) | (c - 'a' + 10);
+	} else if (c >= 'A' && c <= 'F') {
+	    *u = (*u << 4) | (c - 'A' + 10);
+	} else {
+	    return false;
+	}
+    }
+    *sp = s + 4;
+    return true;
+}
+
+/**
+ * Parse a JSON string.
+ *
+ * @param[in,out] sp	Text pointer, pointing at the opening quote. Returned
+ *			pointing past the closing quote.
+ * @param[in] end	End of text
+ *
+ * @return Decoded string in UTF-8, or NULL for a syntax error
+ */
+static char *
+hn_json_string(const char **sp, const char *end)
+{
+    const char *s = *sp + 1;
+    varbuf_t r;
+    ucs4_t u, lo;
+    char utf8[6];
+    int len;
+
+    vb_init(&r);
+    while (s < end && *s != '"') {
+	if ((unsigned char)*s < ' ') {
+	    goto fail;
+	}
+	if (*s != '\\') {
+	    vb_append(&r, s++, 1);
+	    continue;
+	}
+	if (++s >= end) {
+	    goto fail;
+	}
+	switch (*s++) {
+	case '"':
+	case '\\':
+	case '/':
+	    vb_append(&r, s - 1, 1);
+	    break;
+	case 'b':
+	    vb_appends(&r, "\b");
+	    break;
+	case 'f':
+	    vb_appends(&r, "\f");
+	    break;
+	case 'n':
+	    vb_appends(&r, "\n");
+	    break;
+	case 'r':
+	    vb_appends(&r, "\r");
+	    break;
+	case 't':
+	    vb_appends(&r, "\t");
+	    break;
+	case 'u':
+	    if (!hn_json_hex4(&s, end, &u)) {
+		goto fail;
+	    }
+	    if (u >= 0xd800 && u < 0xdc00) {
+		/* High surrogate, must be followed by a low surrogate. */
+		if (end - s < 2 || s[0] != '\\' || s[1] != 'u') {
+		    goto fail;
+		}
+		s += 2;
+		if (!hn_json_hex4(&s, end, &lo) || lo < 0xdc00 || lo > 0xdfff) {
+		    goto fail;
+		}
+		u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+	    } else if (u >= 0xdc00 && u < 0xe000) {
+		goto fail;
+	    }
+	    if (u == 0 || (len = unicode_to_utf8(u, utf8)) <= 0) {
+		goto fail;
+	    }
+	    vb_append(&r, utf8, len);
+	    break;
+	default:
+	    goto fail;
+	}
+    }
+    if (s >= end) {
+	goto fail;
+    }
+    *sp = s + 1;
+    return vb_consume(&r);
+
+fail:
+    vb_free(&r);
+    return NULL;
+}
+
+/**
+ * Free a batch request.
+ *
+ * @param[in] b		Batch request
+ */
+static void
+hn_batch_free(hn_batch_t *b)
+{
+    int i;
+
+    llist_unlink(&b->link);
+    for (i = 0; i < b->n_actions; i++) {
+	Free(b->actions[i]);
+    }
+    Free(b->actions);
+    vb_free(&b->results);
+    Free(b);
+}
+
+/**
+ * Parse the body of a batch request, a JSON array of action strings.
+ *
+ * @param[in,out] b	Batch request
+ * @param[in] buf	Body
+ * @param[in] len	Length of body
+ *
+ * @return true for success
+ */
+static bool
+hn_batch_parse(hn_batch_t *b, const char *buf, size_t len)
+{
+    const char *s = buf;
+    const char *end = buf + len;
+    char *action;
+
+    s = hn_json_ws(s, end);
+    if (s >= end || *s++ != '[') {
+	return false;
+    }
+    s = hn_json_ws(s, end);
+    while (s < end && *s == '"') {
+	if ((action = hn_json_string(&s, end)) == NULL) {
+	    return false;
+	}
+	b->actions = (char **)Realloc(b->actions,
+		(b->n_actions + 1) * sizeof(char *));
+	b->actions[b->n_actions++] = action;
+	s = hn_json_ws(s, end);
+	if (s < end && *s == ',') {
+	    s = hn_json_ws(s + 1, end);
+	    if (s >= end || *s != '"') {
+		return false;
+	    }
+	} else if (s >= end || *s != ']') {
+	    /* Elements must be separated by commas. */
+	    return false;
+	}
+    }
+    if (s >= end || *s++ != ']') {
+	return false;
+    }
+    return hn_json_ws(s, end) == end && b->n_actions > 0;
+}
+
+/**
+ * Add the result of one action to a batch response.
+ *
+ * @param[in,out] b	Batch request
+ * @param[in] action	Action
+ * @param[in] success	true if the action succeeded
+ * @param[in] buf	Result, formatted as JSON array elements
+ * @param[in] len	Length of result
+ * @param[in] sl_buf	Status line
+ * @param[in] sl_len	Length of status line
+ */
+static void
+hn_batch_result(hn_batch_t *b, const char *action, bool success,
+	const char *buf, size_t len, const char *sl_buf, size_t sl_len)
+{
+    char *q_action = json_quote(action);
+
+    if (!success) {
+	b->failed = true;
+    }
+    if (len > 2 && !strncmp(buf + len - 2, ",\n", 2)) {
+	len -= 2;
+    }
+    vb_appendf(&b->results, "%s\
+  {\n\
+   \"action\": \"%s\",\n\
+   \"success\": %s,\n\
+   \"status\": \"%.*s\",\n",
+	    vb_len(&b->results)? ",\n": "",
+	    q_action, success? "true": "false",
+	    (int)sl_len, sl_buf);
+    if (len) {
+	const char *end = buf + len;
+
+	/* Indent the result lines two more columns, to nest them here. */
+	vb_appends(&b->results, "   \"result\": [\n");
+	while (buf < end) {
+	    const char *nl = memchr(buf, '\n', end - buf);
+	    size_t line_len = (nl != NULL)? (size_t)(nl - buf):
+					    (size_t)(end - buf);
+
+	    vb_appendf(&b->results, "  %.*s\n", (int)line_len, buf);
+	    buf += line_len + (nl != NULL);
+	}
+	vb_appends(&b->results, "   ]\n  }");
+    } else {
+	vb_appends(&b->results, "   \"result\": null\n  }");
+    }
+    Free(q_action);
+}
+
+/**
+ * Run the remaining actions in a batch request.
+ *
+ * @param[in,out] b	Batch request
+ *
+ * @return httpd_status_t, HS_PENDING if an action is still running
+ */
+static httpd_status_t
+hn_batch_run(hn_batch_t *b)
+{
+    void *dhandle = b->dhandle;
+    varbuf_t r;
+    httpd_status_t rv;
+    int row;
+
+    b->running = true;
+    while (b->next < b->n_actions && !(b->stop_on_error && b->failed)) {
+	const char *action = b->actions[b->next++];
+	const char *error;
+
+	switch (hio_to3270(action, hn_batch_complete, dhandle, CT_JSON)) {
+	case SENDTO_COMPLETE:
+	    /* The result has already been added. */
+	    continue;
+	case SENDTO_PENDING:
+	    b->running = false;
+	    return HS_PENDING;
+	case SENDTO_INVALID:
+	    error = "  \"Invalid 3270 action.\"";
+	    break;
+	default:
+	case SENDTO_FAILURE:
+	    error = "  \"Processing error.\"";
+	    break;
+	}
+	hn_batch_result(b, action, false, error, strlen(error), "", 0);
+    }
+    b->running = false;
+
+    /* Send the response. */
+    vb_init(&r);
+    vb_appendf(&r, "{\n\
+ \"success\": %s,\n\
+ \"results\": [\n\
+%s\n\
+ ]",
+	    b->failed? "false": "true", vb_buf(&b->results));
+    if (b->screen) {
+	vb_appends(&r, ",\n \"screen\": [\n");
+	for (row = 0; row < ROWS; row++) {
+	    vb_appends(&r, "  ");
+	    hn_row_text(row, &r);
+	    vb_appends(&r, (row < ROWS - 1)? ",\n": "\n");
+	}
+	vb_appends(&r, " ]");
+    }
+    vb_appends(&r, "\n}\n");
+    hn_batch_free(b);
+    rv = httpd_dyn_complete_buf(dhandle, vb_buf(&r), vb_len(&r));
+    vb_free(&r);
+    return rv;
+}
+
+/**
+ * Completion callback for an action in a batch request.
+ *
+ * @param[in] dhandle	daemon handle
+ * @param[in] cbs	completion status
+ * @param[in] buf	data buffer
+ * @param[in] len	length of data buffer
+ * @param[in] sl_buf	status-line buffer
+ * @param[in] sl_len	length of status-line buffer
+ */
+static void
+hn_batch_complete(void *dhandle, sendto_cbs_t cbs, const char *buf,
+	size_t len, const char *sl_buf, size_t sl_len)
+{
+    hn_batch_t *b = NULL;
+    hn_batch_t *bb;
+    httpd_status_t rv;
+
+    FOREACH_LLIST(&batches, bb, hn_batch_t *) {
+	if (bb->dhandle == dhandle) {
+	    b = bb;
+	    break;
+	}
+    } FOREACH_LLIST_END(&batches, bb, hn_batch_t *);
+    if (b == NULL) {
+	return;
+    }
+
+    hn_batch_result(b, b->actions[b->next - 1], cbs == SC_SUCCESS, buf, len,
+	    sl_buf, sl_len);
+    if (b->running) {
+	/* Completed synchronously; hn_batch_run() carries on. */
+	return;
+    }
+    if ((rv = hn_batch_run(b)) != HS_PENDING) {
+	hio_async_done(dhandle, rv);
+    }
+}
+
+/**
+ * Callback for the batch node (/3270/rest/batch).
+ *
+ * The body is a JSON array of actions, which are run in order. The response
+ * gives the result of each one.
+ *
+ * @param[in] uri	URI
+ * @param[in] dhandle	Session handle
+ *
+ * @return httpd_status_t
+ */
+static httpd_status_t
+hn_batch(const char *uri _is_unused, void *dhandle)
+{
+    static const char *options[] = { "stop-on-error", "screen", NULL };
+    bool values[2] = { false, false };
+    const char *body;
+    const char *value;
+    const char *error;
+    size_t len;
+    hn_batch_t *b;
+    int i;
+
+    for (i = 0; options[i] != NULL; i++) {
+	if ((value = httpd_fetch_query(dhandle, options[i])) != NULL &&
+		(error = boolstr(value, &values[i])) != NULL) {
+	    return httpd_dyn_error(dhandle, CT_JSON, 400, "  \"%s: %s\"\n",
+		    options[i], error);
+	}
+    }
+
+    b = (hn_batch_t *)Calloc(1, sizeof(hn_batch_t));
+    llist_init(&b->link);
+    LLIST_APPEND(&b->link, batches);
+    b->dhandle = dhandle;
+    b->stop_on_error = values[0];
+    b->screen = values[1];
+    vb_init(&b->results);
+
+    body = httpd_fetch_body(dhandle, &len);
+    if (!hn_batch_parse(b, body, len)) {
+	hn_batch_free(b);
+	return httpd_dyn_error(dhandle, CT_JSON, 400,
+		"  \"The body must be a JSON array of action strings.\"\n");
+    }
+    return hn_batch_run(b);
+}
+
 /**
  * Initialize the HTTP object hierarchy.
  */
@@ -585,8 +1400,9 @@ httpd_objects_init(void)
     initted = true;
 
     httpd_register_dir("/3270", "Emulator state");
-    httpd_register_dyn_term("/3270/screen.html", "Screen image",
+    nhandle = httpd_register_dyn_term("/3270/screen.html", "Screen image",
 	    CT_HTML, "text/html; charset=utf-8", HF_TRAILER, hn_screen_image);
+    httpd_set_etag(nhandle, hn_state_etag);
     httpd_register_dyn_term("/3270/interact.html", "Interactive form",
 	    CT_HTML, "text/html; charset=utf-8", HF_TRAILER, hn_interact);
     httpd_register_dir("/3270/rest", "REST interface");
@@ -597,17 +1413,27 @@ httpd_objects_init(void)
 	    "REST plain text interface", CT_TEXT, "text/plain; charset=utf-8",
 	    HF_NONE, rest_text_dyn);
     httpd_set_alias(nhandle, "text/Query()");
+    httpd_set_etag(nhandle, hn_rest_etag);
     nhandle = httpd_register_dyn_nonterm("/3270/rest/stext",
 	    "REST plain text interface with status line", CT_TEXT,
 	    "text/plain; charset=utf-8",
 	    HF_NONE, rest_status_text_dyn);
     httpd_set_alias(nhandle, "stext/Query()");
+    httpd_set_etag(nhandle, hn_rest_etag);
     nhandle = httpd_register_dyn_nonterm("/3270/rest/html",
 	    "REST HTML interface", CT_HTML, "text/html; charset=utf-8",
 	    HF_TRAILER, rest_html_dyn);
     httpd_set_alias(nhandle, "html/Query()");
+    httpd_set_etag(nhandle, hn_rest_etag);
     nhandle = httpd_register_dyn_nonterm("/3270/rest/json",
 	    "REST JSON interface", CT_JSON, "application/json; charset=utf-8",
 	    HF_NONE, rest_json_dyn);
     httpd_set_alias(nhandle, "json/Query()");
+    httpd_set_etag(nhandle, hn_rest_etag);
+    httpd_register_dyn_term("/3270/rest/stream", "REST event stream",
+	    CT_TEXT, "text/event-stream; charset=utf-8", HF_NONE, hn_stream);
+    httpd_register_dyn_term("/3270/rest/batch", "REST batch interface",
+	    CT_JSON, "application/json; charset=utf-8", HF_POST, hn_batch);
+    httpd_register_dyn_term("/3270/metrics", "Prometheus metrics", CT_TEXT,
+	    "text/plain; version=0.0.4; charset=utf-8", HF_NONE, hn_metrics);
 }
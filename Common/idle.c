@@ -92,6 +92,7 @@ idle_init(void)
     /* Get values from resources. */
     cmd = appres.idle_command;
     idle_command = cmd? NewString(cmd): NULL;
+    task_cache_macro(idle_command);
     tmo = appres.idle_timeout;
     idle_timeout_string = tmo? NewString(tmo): NULL;
     if (appres.idle_command_enabled) {
@@ -361,5 +362,6 @@ push_idle(char *s)
     Replace(idle_result, NULL);
 
     /* Push a callback with a macro. */
+    task_cache_macro(s);
     push_cb(s, strlen(s), &idle_cb, (task_cbh)&idle_cb);
 }
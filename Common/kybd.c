@@ -1035,6 +1035,46 @@ ins_prep(int faddr, int baddr, int count, bool *no_room, bool oerr_fail)
     return true;
 }
 
+/*
+ * Replace the nulls in front of a newly-entered character with blanks, back
+ * to the start of the field.
+ */
+static void
+blank_fill(int faddr, int baddr)
+{
+    register int baddr_fill = baddr;
+
+    DEC_BA(baddr_fill);
+    while (baddr_fill != faddr) {
+
+	/* Check for backward line wrap. */
+	if ((baddr_fill % COLS) == COLS - 1) {
+	    bool aborted = true;
+	    register int baddr_scan = baddr_fill;
+
+	    /* Check the field within the preceeding line for NULLs. */
+	    while (baddr_scan != faddr) {
+		if (ea_buf[baddr_scan].ec != EBC_null) {
+		    aborted = false;
+		    break;
+		}
+		if (!(baddr_scan % COLS)) {
+		    break;
+		}
+		DEC_BA(baddr_scan);
+	    }
+	    if (aborted) {
+		break;
+	    }
+	}
+
+	if (ea_buf[baddr_fill].ec == EBC_null) {
+	    ctlr_add(baddr_fill, EBC_space, 0);
+	}
+	DEC_BA(baddr_fill);
+    }
+}
+
 /* Flags OR'ed into an EBCDIC code when pushed into the typeahead queue. */
 #define GE_WFLAG	0x10000
 #define PASTE_WFLAG	0x20000
@@ -1280,37 +1320,7 @@ key_Character(unsigned ebc, bool with_ge, bool pasting, bool oerr_fail,
 
     /* Replace leading nulls with blanks, if desired. */
     if (formatted && toggled(BLANK_FILL)) {
-	register int baddr_fill = baddr;
-
-	DEC_BA(baddr_fill);
-	while (baddr_fill != faddr) {
-
-	    /* Check for backward line wrap. */
-	    if ((baddr_fill % COLS) == COLS - 1) {
-		bool aborted = true;
-		register int baddr_scan = baddr_fill;
-
-		/* Check the field within the preceeding line for NULLs. */
-		while (baddr_scan != faddr) {
-		    if (ea_buf[baddr_scan].ec != EBC_null) {
-			aborted = false;
-			break;
-		    }
-		    if (!(baddr_scan % COLS)) {
-			break;
-		    }
-		    DEC_BA(baddr_scan);
-		}
-		if (aborted) {
-		    break;
-		}
-	    }
-
-	    if (ea_buf[baddr_fill].ec == EBC_null) {
-		ctlr_add(baddr_fill, EBC_space, 0);
-	    }
-	    DEC_BA(baddr_fill);
-	}
+	blank_fill(faddr, baddr);
     }
 
     mdt_set(cursor_addr);
@@ -1771,6 +1781,161 @@ key_UCharacter(ucs4_t ucs4, enum keytype keytype, enum iaction cause,
     }
 }
 
+/*
+ * Handle a run of ordinary characters from a paste or the String action.
+ *
+ * As much of the run as fits in the current field, without crossing the end
+ * of the current row, is validated and translated up front and then written
+ * in one operation. The result is the same as calling key_UCharacter() for
+ * each character, but the field lookup, insert-mode shift, MDT update and
+ * cursor move are done once per run instead of once per character.
+ *
+ * Anything that needs special handling (NVT mode, DBCS, protected or numeric
+ * fields, reverse input, composing, characters with no single-byte EBCDIC
+ * translation) is left for key_UCharacter().
+ *
+ * Returns the number of characters consumed, which may be 0.
+ */
+static size_t
+key_UString(const ucs4_t *ws, size_t len, bool pasting, enum iaction cause)
+{
+    static unsigned char *ebc_buf = NULL;
+    static unsigned char *cs_buf = NULL;
+    static size_t buf_len = 0;
+    int baddr, faddr, xaddr;
+    unsigned char fa;
+    bool insert = toggled(INSERT_MODE);
+    size_t limit;
+    size_t n;
+    bool no_room;
+
+    if (!IN_3270 || kybdlock || dbcs || composing != NONE ||
+	    toggled(REVERSE_INPUT) || (insert && toggled(BLANK_FILL)) ||
+	    (keyboard_disabled() && IA_IS_KEY(cause))) {
+	return 0;
+    }
+
+    baddr = cursor_addr;
+    faddr = find_field_attribute(baddr);
+    fa = get_field_attribute(baddr);
+    if (ea_buf[baddr].fa || FA_IS_PROTECTED(fa) || FA_IS_NUMERIC(fa)) {
+	return 0;
+    }
+
+    /* Stop at the end of the row, so wrap and margin checks still work. */
+    limit = COLS - BA_TO_COL(baddr);
+    if (limit > len) {
+	limit = len;
+    }
+    if (limit > buf_len) {
+	buf_len = COLS;
+	ebc_buf = (unsigned char *)Realloc(ebc_buf, buf_len);
+	cs_buf = (unsigned char *)Realloc(cs_buf, buf_len);
+    }
+
+    /* Translate and validate the run, stopping at the end of the field. */
+    for (n = 0, xaddr = baddr; n < limit; n++, xaddr++) {
+	ebc_t ebc;
+	bool ge;
+
+	if (ea_buf[xaddr].fa ||
+		ea_buf[xaddr].ec == EBC_so || ea_buf[xaddr].ec == EBC_si) {
+	    break;
+	}
+	if (ws[n] < 0x20) {
+	    break;
+	}
+	ebc = unicode_to_ebcdic_ge(ws[n], &ge, toggled(APL_MODE));
+	if (ebc < 0x40 || (ebc & 0xff00)) {
+	    break;
+	}
+	ebc_buf[n] = (unsigned char)ebc;
+	cs_buf[n] = ge? CS_GE: 0;
+    }
+
+    if (insert && n > 0) {
+	int next_faddr;
+	size_t nulls = 0;
+
+	/* Insert only as many as will fit; the rest will overflow. */
+	if (faddr == -1) {
+	    next_faddr = (((baddr / COLS) + 1) * COLS) % (ROWS*COLS);
+	} else {
+	    next_faddr = faddr;
+	    INC_BA(next_faddr);
+	    while (next_faddr != faddr && !ea_buf[next_faddr].fa) {
+		INC_BA(next_faddr);
+	    }
+	}
+	xaddr = baddr;
+	while (nulls < n && xaddr != next_faddr) {
+	    if (ea_buf[xaddr].ec == EBC_null) {
+		nulls++;
+	    }
+	    INC_BA(xaddr);
+	}
+	n = nulls;
+	if (n > 0 && !ins_prep(faddr, baddr, (int)n, &no_room, true)) {
+	    return 0;
+	}
+    }
+    if (n == 0) {
+	return 0;
+    }
+
+    vtrace(" %s -> Key(U+%04x) ... %u characters\n", ia_name[(int)cause],
+	    ws[0], (unsigned)n);
+
+    /* Write the run. */
+    for (xaddr = baddr; xaddr < baddr + (int)n; xaddr++) {
+	ctlr_add(xaddr, ebc_buf[xaddr - baddr], cs_buf[xaddr - baddr]);
+	ctlr_add_fg(xaddr, 0);
+	ctlr_add_gr(xaddr, 0);
+    }
+    baddr = (baddr + (int)n) % (ROWS * COLS);
+
+    /* Replace leading nulls with blanks, if desired. */
+    if (formatted && toggled(BLANK_FILL)) {
+	blank_fill(faddr, baddr);
+    }
+
+    mdt_set(cursor_addr);
+
+    /* Implement auto-skip, as key_Character() does. */
+    if (!(pasting && toggled(OVERLAY_PASTE))) {
+	while (ea_buf[baddr].fa) {
+	    if (FA_IS_SKIP(ea_buf[baddr].fa)) {
+		baddr = next_unprotected(baddr);
+	    } else {
+		INC_BA(baddr);
+	    }
+	}
+    }
+    cursor_move(baddr);
+
+    ctlr_dbcs_postprocess();
+    return n;
+}
+
+/*
+ * Returns the length of the run of ordinary text at the front of a
+ * String() or paste buffer, i.e., characters with no special meaning to
+ * emulate_uinput().
+ */
+static size_t
+ordinary_run(const ucs4_t *ws, size_t len)
+{
+    size_t n;
+
+    for (n = 0; n < len; n++) {
+	if (ws[n] < 0x20 || ws[n] == '\\' ||
+		(ws[n] >= UPRIV2 && ws[n] <= UPRIV_dup)) {
+	    break;
+	}
+    }
+    return n;
+}
+
 static bool
 MonoCase_action(ia_t ia, unsigned argc, const char **argv)
 {
@@ -3638,6 +3803,7 @@ emulate_uinput(const ucs4_t *ws, size_t xlen, bool pasting)
     bool just_wrapped = false;
     ucs4_t c;
     bool auto_skip = true;
+    size_t nb;
 
     if (pasting && toggled(OVERLAY_PASTE)) {
 	auto_skip = false;
@@ -3781,6 +3947,14 @@ emulate_uinput(const ucs4_t *ws, size_t xlen, bool pasting)
 		if (pasting && (c >= UPRIV_GE_00 && c <= UPRIV_GE_ff)) {
 		    /* Untranslatable CP 310 code point. */
 		    key_Character(c - UPRIV_GE_00, true, ia, true, NULL);
+		} else if ((nb = key_UString(ws, ordinary_run(ws, xlen),
+				pasting, ia)) > 0) {
+		    /*
+		     * Ordinary text, entered in bulk. The last character is
+		     * consumed below.
+		     */
+		    ws += nb - 1;
+		    xlen -= nb - 1;
 		} else {
 		    /* Ordinary text. */
 		    key_UCharacter(c, KT_STD, ia, true);
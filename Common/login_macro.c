@@ -160,6 +160,7 @@ login_macro(char *s)
 		HOST_FLAG(NO_LOGIN_HOST)? "": AnWait "(" KwInputField ") ",
 		safe_param(s));
     }
+    task_cache_macro(action);
     push_cb(action, strlen(action), &login_cb, (task_cbh)&login_cb);
 }
 
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2020 Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	metrics.c
+ *		Operational metrics.
+ *
+ * Counters and duration histograms are kept for the life of the process,
+ * and dumped in Prometheus text exposition format by the /3270/metrics
+ * httpd node.
+ */
+
+#include "globals.h"
+
+#if !defined(_WIN32) /*[*/
+# include <unistd.h>
+# include <sys/resource.h>
+#endif /*]*/
+
+#include "task.h"
+#include "telnet.h"
+#include "varbuf.h"
+
+#include "metrics.h"
+
+#define METRICS_PREFIX	"x3270_"
+
+/* Histogram bucket upper bounds, in seconds. */
+static struct {
+    double le;			/* upper bound */
+    const char *le_str;		/* upper bound, as it appears in the output */
+} bucket_le[] = {
+    { 0.0005, "0.0005" }, { 0.001, "0.001" }, { 0.0025, "0.0025" },
+    { 0.005, "0.005" }, { 0.01, "0.01" }, { 0.025, "0.025" },
+    { 0.05, "0.05" }, { 0.1, "0.1" }, { 0.25, "0.25" }, { 0.5, "0.5" },
+    { 1.0, "1" }, { 2.5, "2.5" }, { 5.0, "5" }, { 10.0, "10" },
+    { 30.0, "30" }, { 60.0, "60" }, { 300.0, "300" }, { 3600.0, "3600" }
+};
+#define NUM_BUCKETS	(sizeof(bucket_le) / sizeof(bucket_le[0]))
+
+/* Histogram state. */
+typedef struct {
+    unsigned long long bucket[NUM_BUCKETS + 1]; /* counts, last is +Inf */
+    unsigned long long count;	/* total observations */
+    double sum;			/* total seconds */
+    bool running;		/* timer is running */
+    struct timeval start;	/* timer start */
+} histogram_t;
+static histogram_t histogram[NUM_MH];
+
+/* Counter and histogram descriptions. */
+static struct {
+    const char *name;
+    const char *help;
+} counter_desc[NUM_MC] = {
+    { "network_received_bytes_total", "Bytes received from the host." },
+    { "network_sent_bytes_total", "Bytes sent to the host." },
+    { "network_received_records_total", "Records received from the host." },
+    { "network_sent_records_total", "Records sent to the host." },
+    { "connect_attempts_total", "Connection attempts." },
+    { "reconnect_attempts_total", "Automatic reconnection attempts." },
+    { "connects_total", "Connections established." },
+    { "connect_failures_total",
+	"Connection attempts that failed before the connection was "
+	"established." },
+    { "disconnects_total", "Established connections that ended." },
+    { "trace_written_bytes_total", "Bytes written to the trace file." }
+}, histogram_desc[NUM_MH] = {
+    { "host_response_seconds",
+	"Time from sending an AID to the host unlocking the keyboard." },
+    { "connect_seconds", "Time to establish a connection." },
+    { "connection_seconds", "Lifetime of established connections." },
+    { "tls_handshake_seconds", "Time to negotiate TLS." },
+    { "command_seconds", "Time to execute script commands." },
+    { "event_loop_busy_seconds",
+	"Time spent processing events per pass through the event loop." }
+};
+
+unsigned long long metrics_counter[NUM_MC];
+
+/* Time spent waiting for events in the current event loop pass. */
+static double loop_waited;
+static struct timeval wait_start;
+
+/**
+ * Compute the difference between two times.
+ *
+ * @param[in] t0	Start time
+ * @param[in] t1	End time
+ *
+ * @return Difference in seconds
+ */
+static double
+tv_diff(struct timeval *t0, struct timeval *t1)
+{
+    return (double)(t1->tv_sec - t0->tv_sec) +
+	(double)(t1->tv_usec - t0->tv_usec) / 1000000.0;
+}
+
+/**
+ * Add an observation to a histogram.
+ *
+ * @param[in] h		Histogram
+ * @param[in] seconds	Duration
+ */
+static void
+observe(metrics_histogram_t h, double seconds)
+{
+    histogram_t *hg = &histogram[h];
+    size_t i;
+
+    if (seconds < 0.0) {
+	/* The clock went backwards. */
+	seconds = 0.0;
+    }
+    for (i = 0; i < NUM_BUCKETS; i++) {
+	if (seconds <= bucket_le[i].le) {
+	    break;
+	}
+    }
+    hg->bucket[i]++;
+    hg->count++;
+    hg->sum += seconds;
+}
+
+/**
+ * Add the duration between two times to a histogram.
+ *
+ * @param[in] h		Histogram
+ * @param[in] t0	Start time
+ * @param[in] t1	End time, or NULL for now
+ */
+void
+metrics_observe(metrics_histogram_t h, struct timeval *t0, struct timeval *t1)
+{
+    struct timeval now;
+
+    if (t1 == NULL) {
+	gettimeofday(&now, NULL);
+	t1 = &now;
+    }
+    observe(h, tv_diff(t0, t1));
+}
+
+/**
+ * Start timing an operation.
+ *
+ * @param[in] h		Histogram
+ */
+void
+metrics_start(metrics_histogram_t h)
+{
+    histogram[h].running = true;
+    gettimeofday(&histogram[h].start, NULL);
+    if (h == MH_EVENT_LOOP) {
+	loop_waited = 0.0;
+    }
+}
+
+/**
+ * Finish timing an operation, if it was started.
+ *
+ * @param[in] h		Histogram
+ */
+void
+metrics_stop(metrics_histogram_t h)
+{
+    histogram_t *hg = &histogram[h];
+    struct timeval now;
+    double seconds;
+
+    if (!hg->running) {
+	return;
+    }
+    hg->running = false;
+    gettimeofday(&now, NULL);
+    seconds = tv_diff(&hg->start, &now);
+    if (h == MH_EVENT_LOOP) {
+	seconds -= loop_waited;
+    }
+    observe(h, seconds);
+}
+
+/**
+ * The event loop is about to wait for events.
+ */
+void
+metrics_wait_start(void)
+{
+    gettimeofday(&wait_start, NULL);
+}
+
+/**
+ * The event loop has finished waiting for events.
+ */
+void
+metrics_wait_stop(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    loop_waited += tv_diff(&wait_start, &now);
+}
+
+/**
+ * Track connection state changes.
+ *
+ * @param[in] old_cstate	Previous state
+ * @param[in] new_cstate	New state
+ */
+void
+metrics_cstate(enum cstate old_cstate, enum cstate new_cstate)
+{
+    bool was_idle = old_cstate <= TLS_PASS;
+    bool is_idle = new_cstate <= TLS_PASS;
+
+    if (was_idle && !is_idle) {
+	/* Starting a connection. */
+	metrics_count(MC_CONNECT_ATTEMPTS, 1);
+	if (old_cstate == RECONNECTING) {
+	    metrics_count(MC_RECONNECT_ATTEMPTS, 1);
+	}
+	metrics_start(MH_CONNECT);
+    }
+
+    if (new_cstate >= CONNECTED_NVT && histogram[MH_CONNECT].running) {
+	/* Connected. */
+	metrics_count(MC_CONNECTS, 1);
+	metrics_stop(MH_CONNECT);
+	metrics_start(MH_CONNECTION);
+    } else if (!was_idle && is_idle) {
+	if (histogram[MH_CONNECTION].running) {
+	    /* Disconnected. */
+	    metrics_count(MC_DISCONNECTS, 1);
+	    metrics_stop(MH_CONNECTION);
+	} else {
+	    /* Gave up on connecting. */
+	    metrics_count(MC_CONNECT_FAILURES, 1);
+	    histogram[MH_CONNECT].running = false;
+	}
+    }
+}
+
+/**
+ * Dump a gauge.
+ *
+ * @param[out] r	Buffer
+ * @param[in] name	Name, without the prefix
+ * @param[in] help	Help text
+ * @param[in] value	Value
+ */
+static void
+dump_gauge(varbuf_t *r, const char *name, const char *help,
+	unsigned long long value)
+{
+    vb_appendf(r, "# HELP " METRICS_PREFIX "%s %s\n", name, help);
+    vb_appendf(r, "# TYPE " METRICS_PREFIX "%s gauge\n", name);
+    vb_appendf(r, METRICS_PREFIX "%s %llu\n", name, value);
+}
+
+/**
+ * Dump the process memory usage.
+ *
+ * @param[out] r	Buffer
+ */
+static void
+dump_memory(varbuf_t *r)
+{
+#if !defined(_WIN32) /*[*/
+    struct rusage ru;
+    FILE *f;
+
+    /* Current resident size, where /proc makes it available. */
+    f = fopen("/proc/self/statm", "r");
+    if (f != NULL) {
+	unsigned long size, resident;
+
+	if (fscanf(f, "%lu %lu", &size, &resident) == 2) {
+	    unsigned long long page = sysconf(_SC_PAGESIZE);
+
+	    dump_gauge(r, "virtual_memory_bytes", "Virtual memory size.",
+		    size * page);
+	    dump_gauge(r, "resident_memory_bytes", "Resident memory size.",
+		    resident * page);
+	}
+	fclose(f);
+    }
+
+    /* Peak resident size. */
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+	dump_gauge(r, "max_resident_memory_bytes",
+		"Peak resident memory size.",
+# if defined(__APPLE__) /*[*/
+		(unsigned long long)ru.ru_maxrss
+# else /*][*/
+		(unsigned long long)ru.ru_maxrss * 1024
+# endif /*]*/
+		);
+    }
+#endif /*]*/
+}
+
+/**
+ * Dump all of the metrics in Prometheus text format.
+ *
+ * @param[out] r	Buffer
+ */
+void
+metrics_dump(struct varbuf *r)
+{
+    int i;
+    unsigned queues, tasks;
+
+    vb_appends(r, "# HELP " METRICS_PREFIX "build_info Emulator version.\n");
+    vb_appends(r, "# TYPE " METRICS_PREFIX "build_info gauge\n");
+    vb_appendf(r, METRICS_PREFIX "build_info{app=\"%s\",version=\"%s\"} 1\n",
+	    app, build_rpq_version);
+
+    for (i = 0; i < NUM_MC; i++) {
+	vb_appendf(r, "# HELP " METRICS_PREFIX "%s %s\n", counter_desc[i].name,
+		counter_desc[i].help);
+	vb_appendf(r, "# TYPE " METRICS_PREFIX "%s counter\n",
+		counter_desc[i].name);
+	vb_appendf(r, METRICS_PREFIX "%s %llu\n", counter_desc[i].name,
+		metrics_counter[i]);
+    }
+
+    for (i = 0; i < NUM_MH; i++) {
+	histogram_t *hg = &histogram[i];
+	const char *name = histogram_desc[i].name;
+	unsigned long long cum = 0;
+	unsigned long long usec;
+	size_t j;
+
+	vb_appendf(r, "# HELP " METRICS_PREFIX "%s %s\n", name,
+		histogram_desc[i].help);
+	vb_appendf(r, "# TYPE " METRICS_PREFIX "%s histogram\n", name);
+	for (j = 0; j < NUM_BUCKETS; j++) {
+	    cum += hg->bucket[j];
+	    vb_appendf(r, METRICS_PREFIX "%s_bucket{le=\"%s\"} %llu\n", name,
+		    bucket_le[j].le_str, cum);
+	}
+	vb_appendf(r, METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %llu\n", name,
+		hg->count);
+
+	/*
+	 * Printing a double would follow LC_NUMERIC and could use a decimal
+	 * comma, so the sum is printed from integer microseconds.
+	 */
+	usec = (unsigned long long)((hg->sum * 1000000.0) + 0.5);
+	vb_appendf(r, METRICS_PREFIX "%s_sum %llu.%06llu\n", name,
+		usec / 1000000ULL, usec % 1000000ULL);
+	vb_appendf(r, METRICS_PREFIX "%s_count %llu\n", name, hg->count);
+    }
+
+    vb_appends(r, "# HELP " METRICS_PREFIX "connection_state "
+	    "Current connection state.\n");
+    vb_appends(r, "# TYPE " METRICS_PREFIX "connection_state gauge\n");
+    for (i = 0; i < NUM_CSTATE; i++) {
+	vb_appendf(r, METRICS_PREFIX "connection_state{state=\"%s\"} %d\n",
+		state_name[i], (enum cstate)i == cstate);
+    }
+
+    task_get_depth(&queues, &tasks);
+    dump_gauge(r, "task_queues", "Active task queues.", queues);
+    dump_gauge(r, "tasks", "Tasks on all task queues.", tasks);
+
+    dump_memory(r);
+}
@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2020 Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	mirror.c
+ *		Shared-memory screen mirror.
+ *
+ * When the screenMirror resource names a file, the screen buffer, cursor
+ * and OIA state are published into it once per pass through the event
+ * loop, whenever they have changed. See mirror_shm.h for the layout and
+ * the locking protocol.
+ */
+
+#include "globals.h"
+
+#if !defined(_WIN32) /*[*/
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif /*]*/
+#include <errno.h>
+#include <fcntl.h>
+#if !defined(_WIN32) /*[*/
+# include <signal.h>
+#endif /*]*/
+
+#include "appres.h"
+#include "ctlr.h"
+#include "kybd.h"
+#include "mirror.h"
+#include "mirror_shm.h"
+#include "popups.h"
+#include "resources.h"
+#include "toggles.h"
+#include "trace.h"
+#include "utils.h"
+
+#if !defined(_WIN32) /*[*/
+/* Statics. */
+static int mirror_fd = -1;		/* open mirror file */
+static char *mirror_path;		/* its name */
+static mirror_header_t *mirror_map;	/* its mapping */
+static size_t mirror_size;		/* size of the mapping */
+static bool mirror_tried;		/* tried to open appres.screen_mirror */
+
+/* Last published state. */
+static unsigned long last_generation;
+static int last_cursor;
+static unsigned last_kybdlock;
+static enum cstate last_cstate;
+static unsigned last_flags;
+static int last_rows, last_cols;
+static struct ea *last_ea_buf;
+
+/**
+ * Compute the size of a mirror file with room for a given number of cells.
+ *
+ * @param[in] capacity	Number of cells
+ * @returns size in bytes
+ */
+static size_t
+mirror_file_size(unsigned capacity)
+{
+    return sizeof(mirror_header_t) + (capacity * sizeof(mirror_cell_t));
+}
+
+/**
+ * Close the mirror and remove the file.
+ */
+static void
+mirror_close(void)
+{
+    if (mirror_map != NULL) {
+	munmap((void *)mirror_map, mirror_size);
+	mirror_map = NULL;
+	mirror_size = 0;
+    }
+    if (mirror_fd >= 0) {
+	close(mirror_fd);
+	mirror_fd = -1;
+	unlink(mirror_path);
+	vtrace("Screen mirror %s closed\n", mirror_path);
+    }
+    Replace(mirror_path, NULL);
+}
+
+/**
+ * Map (or re-map) the mirror file with room for a given number of cells.
+ *
+ * @param[in] capacity	Number of cells
+ * @returns true for success
+ */
+static bool
+mirror_map_cells(unsigned capacity)
+{
+    size_t size = mirror_file_size(capacity);
+    void *map;
+
+    /*
+     * The file only grows, so a reader with an older, smaller mapping can
+     * still safely read from it until it notices the new capacity.
+     */
+    if (ftruncate(mirror_fd, size) < 0) {
+	popup_an_errno(errno, "Screen mirror %s", mirror_path);
+	return false;
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mirror_fd, 0);
+    if (map == MAP_FAILED) {
+	popup_an_errno(errno, "Screen mirror %s", mirror_path);
+	return false;
+    }
+    if (mirror_map != NULL) {
+	munmap((void *)mirror_map, mirror_size);
+    }
+    mirror_map = (mirror_header_t *)map;
+    mirror_size = size;
+    return true;
+}
+
+/**
+ * Check an existing file for being a mirror that can be taken over: a plain
+ * file of ours, with a mirror header, whose emulator is no longer running.
+ *
+ * @param[in] fd	Open file
+ * @returns true if the file can be re-used
+ */
+static bool
+mirror_stale(int fd)
+{
+    struct stat st;
+    mirror_header_t h;
+
+    if (fstat(fd, &st) < 0 ||
+	    !S_ISREG(st.st_mode) ||
+	    st.st_uid != geteuid() ||
+	    st.st_nlink != 1 ||
+	    pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+	    h.magic != MIRROR_MAGIC) {
+	return false;
+    }
+    return h.pid == 0 || (kill((pid_t)h.pid, 0) < 0 && errno == ESRCH);
+}
+
+/**
+ * Open the mirror file.
+ *
+ * @param[in] path	File name
+ * @returns true for success
+ */
+static bool
+mirror_open(const char *path)
+{
+    unsigned capacity;
+    mirror_header_t *h;
+
+    mirror_path = NewString(path);
+    mirror_fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+    if (mirror_fd < 0 && errno == EEXIST) {
+	/* Only take over a mirror left behind by an earlier run. */
+	mirror_fd = open(path, O_RDWR | O_NOFOLLOW);
+	if (mirror_fd >= 0 && !mirror_stale(mirror_fd)) {
+	    close(mirror_fd);
+	    mirror_fd = -1;
+	    popup_an_error("Screen mirror %s: File exists and is not a stale "
+		    "screen mirror", path);
+	    Replace(mirror_path, NULL);
+	    return false;
+	}
+	if (mirror_fd >= 0 && ftruncate(mirror_fd, 0) < 0) {
+	    close(mirror_fd);
+	    mirror_fd = -1;
+	}
+    }
+    if (mirror_fd < 0) {
+	popup_an_errno(errno, "Screen mirror %s", path);
+	Replace(mirror_path, NULL);
+	return false;
+    }
+    fcntl(mirror_fd, F_SETFD, 1);
+
+    capacity = maxROWS * maxCOLS;
+    if (capacity < (unsigned)(ROWS * COLS)) {
+	capacity = ROWS * COLS;
+    }
+    if (!mirror_map_cells(capacity)) {
+	mirror_close();
+	return false;
+    }
+
+    h = mirror_map;
+    memset(h, 0, sizeof(*h));
+    h->magic = MIRROR_MAGIC;
+    h->version = MIRROR_VERSION;
+    h->header_size = sizeof(mirror_header_t);
+    h->capacity = capacity;
+    h->cell_size = sizeof(mirror_cell_t);
+    h->cells_offset = sizeof(mirror_header_t);
+    h->pid = (uint32_t)getpid();
+
+    /* Force the first publish. */
+    last_ea_buf = NULL;
+    vtrace("Screen mirror %s opened, %u cells\n", path, capacity);
+    return true;
+}
+
+/**
+ * Compute the current mirror flags.
+ *
+ * @returns MF_XXX flags
+ */
+static unsigned
+mirror_flags(void)
+{
+    unsigned flags = 0;
+
+    if (formatted) {
+	flags |= MF_FORMATTED;
+    }
+    if (IN_3270) {
+	flags |= MF_3270;
+    }
+    if (IN_NVT) {
+	flags |= MF_NVT;
+    }
+    if (IN_SSCP) {
+	flags |= MF_SSCP;
+    }
+    if (CONNECTED) {
+	flags |= MF_CONNECTED;
+    }
+    if (is_altbuffer) {
+	flags |= MF_ALTBUFFER;
+    }
+    if (toggled(INSERT_MODE)) {
+	flags |= MF_INSERT;
+    }
+    return flags;
+}
+#endif /*]*/
+
+/**
+ * Publish the current screen state into the mirror, if it has changed.
+ */
+void
+mirror_publish(void)
+{
+#if !defined(_WIN32) /*[*/
+    mirror_header_t *h;
+    mirror_cell_t *cells;
+    unsigned flags;
+    int count;
+    int i;
+
+    if (mirror_fd < 0) {
+	if (appres.screen_mirror == NULL || mirror_tried) {
+	    return;
+	}
+	mirror_tried = true;
+	if (!mirror_open(appres.screen_mirror)) {
+	    return;
+	}
+    }
+
+    flags = mirror_flags();
+    if (screen_generation == last_generation &&
+	    ea_buf == last_ea_buf &&
+	    cursor_addr == last_cursor &&
+	    kybdlock == last_kybdlock &&
+	    cstate == last_cstate &&
+	    flags == last_flags &&
+	    ROWS == last_rows &&
+	    COLS == last_cols) {
+	return;
+    }
+
+    count = ROWS * COLS;
+    if ((unsigned)count > mirror_map->capacity) {
+	/* Grow the file. The new capacity is published below. */
+	if (!mirror_map_cells(count)) {
+	    mirror_close();
+	    return;
+	}
+    }
+
+    h = mirror_map;
+    cells = (mirror_cell_t *)((char *)h + h->cells_offset);
+
+    /* Take the sequence lock. */
+    h->seq++;
+    __sync_synchronize();
+
+    if ((unsigned)count > h->capacity) {
+	h->capacity = count;
+    }
+    h->generation++;
+    h->rows = ROWS;
+    h->cols = COLS;
+    h->cursor = cursor_addr;
+    h->kybdlock = kybdlock;
+    h->cstate = cstate;
+    h->flags = flags;
+    for (i = 0; i < count; i++) {
+	cells[i].fa = ea_buf[i].fa;
+	cells[i].ec = ea_buf[i].ec;
+	cells[i].cs = ea_buf[i].cs;
+	cells[i].fg = ea_buf[i].fg;
+	cells[i].bg = ea_buf[i].bg;
+	cells[i].gr = ea_buf[i].gr;
+	cells[i].ic = ea_buf[i].ic;
+	cells[i].db = ea_buf[i].db;
+	cells[i].ucs4 = ea_buf[i].ucs4;
+    }
+
+    /* Release the sequence lock. */
+    __sync_synchronize();
+    h->seq++;
+
+    last_generation = screen_generation;
+    last_ea_buf = ea_buf;
+    last_cursor = cursor_addr;
+    last_kybdlock = kybdlock;
+    last_cstate = cstate;
+    last_flags = flags;
+    last_rows = ROWS;
+    last_cols = COLS;
+#endif /*]*/
+}
+
+#if !defined(_WIN32) /*[*/
+/**
+ * Upcall for changing the screenMirror resource.
+ *
+ * @param[in] name	Name of toggle
+ * @param[in] value	Toggle value
+ * @returns true if toggle changed successfully
+ */
+static bool
+mirror_toggle_upcall(const char *name, const char *value)
+{
+    mirror_close();
+    if (value == NULL || !*value) {
+	Replace(appres.screen_mirror, NULL);
+	return true;
+    }
+
+    if (!mirror_open(value)) {
+	return false;
+    }
+    Replace(appres.screen_mirror, NewString(value));
+    mirror_tried = true;
+    mirror_publish();
+    return true;
+}
+
+/**
+ * Clean up the mirror when the emulator exits.
+ *
+ * @param[in] ignored	Unused
+ */
+static void
+mirror_exiting(bool ignored _is_unused)
+{
+    mirror_close();
+}
+#endif /*]*/
+
+/**
+ * Register the screen mirror with the rest of the system.
+ */
+void
+mirror_register(void)
+{
+#if !defined(_WIN32) /*[*/
+    register_schange(ST_EXITING, mirror_exiting);
+    register_extended_toggle(ResScreenMirror, mirror_toggle_upcall, NULL,
+	    NULL, (void **)&appres.screen_mirror, XRM_STRING);
+#endif /*]*/
+}
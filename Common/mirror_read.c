@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2020 Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	mirror_read.c
+ *		Reader side of the shared-memory screen mirror.
+ *
+ * This module depends only on the C library, so it can be compiled into
+ * programs that want to watch an emulator's screen without talking to it.
+ */
+
+#if !defined(_WIN32) /*[*/
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mirror_shm.h"
+
+#define MAX_TRIES	1000	/* give up after this many torn reads */
+
+struct mirror_reader {
+    int fd;			/* open file */
+    void *map;			/* mapping */
+    size_t size;		/* size of the mapping */
+};
+
+/**
+ * (Re-)map the mirror file at its current size.
+ *
+ * @param[in,out] r	Reader
+ * @returns 0 for success, -1 for failure
+ */
+static int
+reader_map(mirror_reader_t *r)
+{
+    struct stat st;
+    void *map;
+
+    if (fstat(r->fd, &st) < 0) {
+	return -1;
+    }
+    if ((size_t)st.st_size < sizeof(mirror_header_t)) {
+	errno = EINVAL;
+	return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, r->fd, 0);
+    if (map == MAP_FAILED) {
+	return -1;
+    }
+    if (r->map != NULL) {
+	munmap(r->map, r->size);
+    }
+    r->map = map;
+    r->size = st.st_size;
+    return 0;
+}
+
+/**
+ * Open a screen mirror.
+ *
+ * @param[in] path	File name, the value of the screenMirror resource
+ * @returns reader, or NULL with errno set
+ */
+mirror_reader_t *
+mirror_reader_open(const char *path)
+{
+    mirror_reader_t *r;
+    const volatile mirror_header_t *h;
+    int save_errno;
+
+    if ((r = (mirror_reader_t *)calloc(1, sizeof(*r))) == NULL) {
+	return NULL;
+    }
+    r->fd = -1;
+    if ((r->fd = open(path, O_RDONLY)) < 0) {
+	goto fail;
+    }
+    if (reader_map(r) < 0) {
+	goto fail;
+    }
+    h = (const volatile mirror_header_t *)r->map;
+    if (h->magic != MIRROR_MAGIC || h->version != MIRROR_VERSION ||
+	    h->cell_size != sizeof(mirror_cell_t)) {
+	errno = EINVAL;
+	goto fail;
+    }
+    return r;
+
+fail:
+    save_errno = errno;
+    mirror_reader_close(r);
+    errno = save_errno;
+    return NULL;
+}
+
+/**
+ * Take a consistent snapshot of the mirror.
+ *
+ * @param[in] r		Reader
+ * @param[out] header	Returned header
+ * @param[out] cells	Returned cells, or NULL for just the header
+ * @param[in] max_cells	Size of the cells array
+ * @returns number of cells copied, or -1 for failure (with errno set)
+ */
+int
+mirror_reader_snapshot(mirror_reader_t *r, mirror_header_t *header,
+	mirror_cell_t *cells, unsigned max_cells)
+{
+    const volatile mirror_header_t *h;
+    int tries;
+
+    for (tries = 0; tries < MAX_TRIES; tries++) {
+	uint32_t seq;
+	unsigned count;
+
+	h = (const volatile mirror_header_t *)r->map;
+	seq = h->seq;
+	__sync_synchronize();
+	if (seq & 1) {
+	    /* Update in progress. */
+	    sched_yield();
+	    continue;
+	}
+
+	memcpy(header, (const void *)h, sizeof(*header));
+	count = header->rows * header->cols;
+	if (header->cells_offset + ((size_t)count * sizeof(mirror_cell_t))
+		> r->size) {
+	    /* The file has grown. */
+	    if (reader_map(r) < 0) {
+		return -1;
+	    }
+	    continue;
+	}
+	if (count > max_cells) {
+	    count = max_cells;
+	}
+	if (cells != NULL && count > 0) {
+	    memcpy(cells, (const char *)r->map + header->cells_offset,
+		    count * sizeof(mirror_cell_t));
+	}
+
+	__sync_synchronize();
+	if (h->seq == seq) {
+	    return (cells != NULL)? (int)count: 0;
+	}
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+/**
+ * Return the current generation of the mirror, to check for changes
+ * cheaply.
+ *
+ * @param[in] r		Reader
+ * @returns generation number
+ */
+uint64_t
+mirror_reader_generation(mirror_reader_t *r)
+{
+    mirror_header_t header;
+
+    if (mirror_reader_snapshot(r, &header, NULL, 0) < 0) {
+	return 0;
+    }
+    return header.generation;
+}
+
+/**
+ * Close a screen mirror.
+ *
+ * @param[in] r		Reader
+ */
+void
+mirror_reader_close(mirror_reader_t *r)
+{
+    if (r == NULL) {
+	return;
+    }
+    if (r->map != NULL) {
+	munmap(r->map, r->size);
+    }
+    if (r->fd >= 0) {
+	close(r->fd);
+    }
+    free(r);
+}
+#else /*][*/
+typedef int mirror_read_unused;	/* ISO C forbids an empty source file */
+#endif /*]*/
@@ -87,7 +87,7 @@ static irv_t peer_irv = {
 static tcb_t peer_cb = {
     "s3sock",
     IA_SCRIPT,
-    CB_NEW_TASKQ | CB_PEER,
+    CB_NEW_TASKQ | CB_PEER | CB_BULK,
     peer_data,
     peer_done,
     NULL,
@@ -103,7 +103,7 @@ static tcb_t peer_cb = {
 static tcb_t interactive_cb = {
     "s3sock",
     IA_COMMAND,
-    CB_NEW_TASKQ | CB_PEER,
+    CB_NEW_TASKQ | CB_PEER | CB_BULK,
     peer_data,
     peer_done,
     NULL,
@@ -61,6 +61,7 @@
 #include "kybd.h"
 #include "login_macro.h"
 #include "min_version.h"
+#include "mirror.h"
 #include "model.h"
 #include "nvt.h"
 #include "opts.h"
@@ -195,6 +196,7 @@ main(int argc, char *argv[])
     xio_register();
     sio_glue_register();
     hio_register();
+    mirror_register();
     proxy_register();
     model_register();
     net_register();
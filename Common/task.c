@@ -66,6 +66,7 @@
 #include "kybd.h"
 #include "lazya.h"
 #include "menubar.h"
+#include "metrics.h"
 #include "names.h"
 #include "nvt.h"
 #include "opts.h"
@@ -99,10 +100,49 @@
 /* IA test for UTF-8 overrides. */
 #define IA_UTF8(ia)	((ia) == IA_HTTPD)
 
+/* Size of one screen position in ReadBuffer(Binary) output. */
+#define RB_BINARY_CELL	12
+
+/* Maximum number of entries in the compiled macro cache. */
+#define MACRO_CACHE_MAX	64
+
+/* Number of hash buckets in the compiled macro cache. */
+#define MACRO_HASH_SIZE	64
+
+/* Microseconds per second. */
+#define USEC_PER_SEC	1000000L
+
 /* Globals */
 struct macro_def *macro_defs = NULL;
 
 /* Statics */
+
+/* A parsed command. */
+typedef struct {
+    action_elt_t *action;	/* resolved action */
+    unsigned count;		/* parameter count */
+    char **params;		/* parameters */
+    char *text;			/* source text */
+} parsed_command_t;
+
+/* A compiled macro. */
+typedef struct compiled_macro {
+    llist_t llist;		/* cache linkage, most recently used first */
+    struct compiled_macro *hnext; /* hash bucket linkage */
+    unsigned hash;		/* hash of the source text */
+    char *text;			/* source text */
+    unsigned refcount;		/* reference count */
+    unsigned actions_count;	/* number of actions defined when compiled */
+    unsigned count;		/* number of commands */
+    parsed_command_t *commands;	/* commands */
+} compiled_macro_t;
+static llist_t macro_cache = LLIST_INIT(macro_cache);
+static unsigned macro_cache_count = 0;
+static compiled_macro_t *macro_hash[MACRO_HASH_SIZE];
+
+enum pc_stat { PC_OK, PC_EMPTY, PC_ERROR };
+enum em_stat { EM_CONTINUE, EM_ERROR };
+
 typedef struct task {
     /* Common fields. */
     struct task *next;	/* next task on the stack */
@@ -159,6 +199,8 @@ typedef struct task {
 	char   *dptr;	/* data pointer */
 #	define LAST_BUF 64
 	char	last[LAST_BUF]; /* last command */
+	compiled_macro_t *compiled; /* compiled form of msc, or NULL */
+	unsigned cix;	/* next command in compiled form */
     } macro;
 
     /* cb fields. */
@@ -172,6 +214,29 @@ static task_t *current_task = NULL;	/* the current task */
 static int passthru_index = 0;
 static peer_listen_t global_peer_listen = NULL;
 
+/* Scheduling classes, in priority order. */
+enum sched_class {
+    SC_UI,		/* user interface (keymaps, b3270 UI) */
+    SC_NORMAL,		/* most callbacks */
+    SC_BULK,		/* peer and child scripts */
+    NUM_SC
+};
+
+/* Scheduling parameters and statistics, per class. */
+static struct {
+    const char *name;		/* name, for display */
+    unsigned commands;		/* maximum commands per turn */
+    unsigned long usec;		/* maximum time per turn */
+    unsigned long turns;	/* number of turns taken */
+    unsigned long preemptions;	/* number of times a turn was cut short */
+    unsigned long waited_usec;	/* total time spent waiting for a turn */
+    unsigned long max_wait_usec;/* longest time spent waiting for a turn */
+} sched_classes[NUM_SC] = {
+    { "ui",	64, 20000L, 0L, 0L, 0L, 0L },
+    { "normal",	16, 10000L, 0L, 0L, 0L, 0L },
+    { "bulk",	 4,  5000L, 0L, 0L, 0L, 0L }
+};
+
 /* List of active task stacks. */
 typedef struct _taskq {
     llist_t llist;	/* linkage */
@@ -183,10 +248,21 @@ typedef struct _taskq {
     unsigned short index;	/* index, for debug display */
     bool deleted;	/* delete flag */
     bool output_wait_needed; /* should Wait(Output) block? */
+    enum sched_class sclass;	/* scheduling class */
+    unsigned long sched_pass;	/* last scheduling pass it had a turn in */
+    struct timeval ready;	/* when it became ready to run, or zero */
+    unsigned long waited_usec;	/* total time spent waiting for a turn */
 } taskq_t;
 static llist_t taskq = LLIST_INIT(taskq);
 static unsigned short taskq_index = 1;
 
+/* Scheduler state for the current turn. */
+static unsigned long sched_pass = 0;	/* pass number */
+static unsigned sched_used;		/* commands run this turn */
+static unsigned sched_quantum;		/* commands allowed this turn */
+static struct timeval sched_deadline;	/* end of this turn */
+static bool sched_any_preempted = false;/* some queue was preempted */
+
 typedef struct _owait {
     struct _owait *next;	/* linkage */
     const tcb_t *cb;		/* callback block */
@@ -235,6 +311,10 @@ static void task_pop(void);
 static void wait_timed_out(ioid_t id);
 static task_t *task_redirect_to(void);
 static bool expect_matches(task_t *task);
+static void unref_compiled_macro(compiled_macro_t *cm);
+static bool sched_expired(void);
+static void sched_preempt(taskq_t *q);
+static char *no_ctrl(const char *s);
 
 /* Macro that defines that the keyboard is locked due to user input. */
 #define KBWAIT_MASK	(KL_OIA_LOCKED|KL_OIA_TWAIT|KL_DEFERRED_UNLOCK|KL_ENTER_INHIBIT|KL_AWAITING_FIRST)
@@ -289,6 +369,7 @@ static action_t Bell_action;
 static action_t Printer_action;
 
 static unsigned char calc_cs(unsigned char cs);
+static void read_buffer_binary(struct ea *buf, bool field, int baddr);
 
 /**
  * Expand the name of a task.
@@ -348,7 +429,8 @@ macros_init(void)
     int ix = 1;
     static char *last_s = NULL;
 
-    /* Free the previous macro definitions. */
+    /* Free the previous macro definitions and their compiled forms. */
+    task_flush_macro_cache();
     while (macro_defs) {
 	m = macro_defs->next;
 	Free(macro_defs);
@@ -390,6 +472,7 @@ macros_init(void)
 	    continue;
 	}
 	m->action = action;
+	task_cache_macro(m->action);
 	if (macro_last) {
 	    macro_last->next = m;
 	} else {
@@ -643,6 +726,9 @@ free_task(task_t *t)
 
     /* Free auxiliary buffers. */
     Replace(t->macro.msc, NULL);
+    if (t->macro.compiled != NULL) {
+	unref_compiled_macro(t->macro.compiled);
+    }
     Replace(t->expect.text, NULL);
     
     /* Free the structure. */
@@ -678,6 +764,10 @@ task_pop(void)
     if (s->next) {
 	s->next->child_msec = msec;
     }
+    if (s->type == ST_MACRO && s->next != NULL && s->next->type == ST_CB) {
+	/* A command from a script (or other callback) is done. */
+	metrics_observe(MH_COMMAND, &s->t0, &t1);
+    }
 
     /* Dequeue. */
     if (s->next == NULL) {
@@ -794,12 +884,15 @@ cleanup_socket(bool b _is_unused)
 #endif /*]*/
 
 /*
- * Interpret and execute a script or macro command.
+ * Parse a script or macro command.
+ *
+ * On success, fills in 'pc' and sets '*np' to point to the text following
+ * the command. If 'quiet' is set, syntax errors and unknown actions are not
+ * reported; this is used when compiling macros ahead of time, when errors
+ * will be reported later, if the macro is actually run.
  */
-enum em_stat { EM_CONTINUE, EM_ERROR };
-static enum em_stat
-execute_command(enum iaction cause, char *s, char **np, char *buf,
-	size_t buflen)
+static enum pc_stat
+parse_command(char *s, char **np, parsed_command_t *pc, bool quiet)
 {
 #   define MAX_ANAME	64
     enum {
@@ -831,8 +924,9 @@ execute_command(enum iaction cause, char *s, char **np, char *buf,
     action_elt_t *any = NULL;
     action_elt_t *exact = NULL;
     unsigned i;
-    enum em_stat rc = EM_ERROR;	/* failure return code */
+    enum pc_stat rc = PC_ERROR;	/* failure return code */
     char *s_orig = s;
+    size_t alen;
     static const char *fail_text[] = {
 	/*1*/ "Action name must begin with an alphanumeric character",
 	/*2*/ "Syntax error in action name",
@@ -1040,7 +1134,7 @@ execute_command(enum iaction cause, char *s, char **np, char *buf,
 	if (np) {
 	    *np = s - 1;
 	}
-	rc = EM_CONTINUE;
+	rc = PC_EMPTY;
 	goto silent_failure;
     case ME_S_PARMx:	/* space after space-style parameter */
 	break;
@@ -1105,58 +1199,102 @@ success:
 	FOREACH_LLIST(&actions_list, e, action_elt_t *) {
 	    if (!strncasecmp(aname, e->t.name, strlen(aname))) {
 		if (any != NULL) {
-		    popup_an_error("Ambiguous action name: %s", aname);
+		    if (!quiet) {
+			popup_an_error("Ambiguous action name: %s", aname);
+		    }
 		    goto silent_failure;
 		}
 		any = e;
 	    }
 	} FOREACH_LLIST_END(&actions_list, e, action_elt_t *);
     }
-
-    if (any != NULL) {
-	const char **params = NULL;
-	size_t alen;
-
-	if (any->t.ia_restrict != IA_NONE && cause != any->t.ia_restrict) {
-	    popup_an_error("Action %s is invalid in this context",
-		    any->t.name);
-	    goto silent_failure;
+    if (any == NULL) {
+	if (!quiet) {
+	    popup_an_error("Unknown action: %s", aname);
 	}
+	goto silent_failure;
+    }
 
-	if (param_count) {
-	    /* Create the parameter array. */
-	    params = (const char **)Malloc(param_count * sizeof(const char *));
-	    for (i = 0; i < param_count; i++) {
-		params[i] = vb_buf(&r[i])? vb_buf(&r[i]) : NewString("");
-	    }
+    /* Fill in the parsed command. */
+    pc->action = any;
+    pc->count = param_count;
+    pc->params = NULL;
+    if (param_count) {
+	/* Create the parameter array. */
+	pc->params = (char **)Malloc(param_count * sizeof(char *));
+	for (i = 0; i < param_count; i++) {
+	    pc->params[i] = vb_consume(&r[i]);
 	}
+    }
+    alen = *np - s_orig;
+    pc->text = Malloc(alen + 1);
+    memcpy(pc->text, s_orig, alen);
+    pc->text[alen] = '\0';
 
-	/* Record the action. */
-	alen = *np - s_orig;
-	if (alen > buflen - 1) {
-	    alen = buflen - 1;
+    for (i = param_count; i < vbcount; i++) {
+	vb_free(&r[i]);
+    }
+    Free(r);
+    return PC_OK;
+
+failure:
+    if (!quiet) {
+	popup_an_error("%s at column %d", fail_text[failreason-1],
+		(int)(s - s_orig) );
+    }
+silent_failure:
+    if (vbcount) {
+	for (i = 0; i < vbcount; i++) {
+	    vb_free(&r[i]);
 	}
-	strncpy(buf, s_orig, alen);
-	buf[alen] = '\0';
+	Free(r);
+    }
+    return rc;
 
-	run_action_entry(any, cause, param_count, param_count? params: NULL);
+#undef fail
+}
 
-	if (vbcount) {
-	    /* Free the varbuf array. */
-	    Free((char *)params);
-	    for (i = 0; i < vbcount; i++) {
-		vb_free(&r[i]);
-	    }
-	    Free(r);
-	    r = NULL;
-	}
+/* Free the contents of a parsed command. */
+static void
+free_parsed_command(parsed_command_t *pc)
+{
+    unsigned i;
 
-	/* Refresh the screen, in case the action changed it. */
-	screen_disp(false);
-    } else {
-	popup_an_error("Unknown action: %s", aname);
-	goto silent_failure;
+    for (i = 0; i < pc->count; i++) {
+	Free(pc->params[i]);
     }
+    Replace(pc->params, NULL);
+    Replace(pc->text, NULL);
+}
+
+/*
+ * Execute a parsed script or macro command.
+ */
+static enum em_stat
+execute_parsed(enum iaction cause, parsed_command_t *pc, char *buf,
+	size_t buflen)
+{
+    action_elt_t *any = pc->action;
+    size_t alen;
+
+    if (any->t.ia_restrict != IA_NONE && cause != any->t.ia_restrict) {
+	popup_an_error("Action %s is invalid in this context", any->t.name);
+	return EM_ERROR;
+    }
+
+    /* Record the action. */
+    alen = strlen(pc->text);
+    if (alen > buflen - 1) {
+	alen = buflen - 1;
+    }
+    memcpy(buf, pc->text, alen);
+    buf[alen] = '\0';
+
+    run_action_entry(any, cause, pc->count,
+	    pc->count? (const char **)pc->params: NULL);
+
+    /* Refresh the screen, in case the action changed it. */
+    screen_disp(false);
 
     /* If it produced an error message, it failed. */
     if (!current_task->success) {
@@ -1166,20 +1304,213 @@ success:
     trace_rollover_check();
 
     return EM_CONTINUE;
+}
 
-failure:
-    popup_an_error("%s at column %d", fail_text[failreason-1],
-	    (int)(s - s_orig) );
-silent_failure:
-    if (vbcount) {
-	for (i = 0; i < vbcount; i++) {
-	    vb_free(&r[i]);
-	}
-	Free(r);
+/*
+ * Interpret and execute a script or macro command.
+ */
+static enum em_stat
+execute_command(enum iaction cause, char *s, char **np, char *buf,
+	size_t buflen)
+{
+    parsed_command_t pc;
+    enum em_stat rc;
+
+    switch (parse_command(s, np, &pc, false)) {
+    case PC_OK:
+	break;
+    case PC_EMPTY:
+	return EM_CONTINUE;
+    case PC_ERROR:
+    default:
+	return EM_ERROR;
     }
+
+    rc = execute_parsed(cause, &pc, buf, buflen);
+    free_parsed_command(&pc);
     return rc;
+}
 
-#undef fail
+/*
+ * Compile a macro into a list of parsed commands.
+ *
+ * Returns NULL if the macro could not be parsed, in which case it will be run
+ * (and the error reported) the slow way.
+ */
+static compiled_macro_t *
+compile_macro(const char *text)
+{
+    compiled_macro_t *cm;
+    char *buf = NewString(text);
+    char *a = buf;
+    char *next;
+    parsed_command_t pc;
+    enum pc_stat ps;
+    unsigned alloc = 0;
+
+    cm = (compiled_macro_t *)Calloc(1, sizeof(compiled_macro_t));
+    llist_init(&cm->llist);
+    cm->actions_count = actions_list_count;
+    while (*a) {
+	next = NULL;
+	ps = parse_command(a, &next, &pc, true);
+	if (ps == PC_EMPTY) {
+	    break;
+	}
+	if (ps == PC_ERROR) {
+	    unref_compiled_macro(cm);
+	    Free(buf);
+	    return NULL;
+	}
+	if (cm->count >= alloc) {
+	    alloc = alloc? alloc * 2: 4;
+	    cm->commands = (parsed_command_t *)Realloc(cm->commands,
+		    alloc * sizeof(parsed_command_t));
+	}
+	cm->commands[cm->count++] = pc; /* struct copy */
+	a = next;
+    }
+    cm->text = buf;
+    cm->refcount = 1;
+    return cm;
+}
+
+/* Drop a reference to a compiled macro, freeing it if it is unused. */
+static void
+unref_compiled_macro(compiled_macro_t *cm)
+{
+    unsigned i;
+
+    if (cm->refcount > 1) {
+	cm->refcount--;
+	return;
+    }
+    for (i = 0; i < cm->count; i++) {
+	free_parsed_command(&cm->commands[i]);
+    }
+    Free(cm->commands);
+    Free(cm->text);
+    Free(cm);
+}
+
+/* Hash the text of a macro (FNV-1a). */
+static unsigned
+macro_text_hash(const char *text, size_t len)
+{
+    unsigned h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+	h = (h ^ (unsigned char)text[i]) * 16777619U;
+    }
+    return h;
+}
+
+/* Remove a macro from the compiled macro cache and drop its reference. */
+static void
+uncache_compiled_macro(compiled_macro_t *cm)
+{
+    compiled_macro_t **pp;
+
+    pp = &macro_hash[cm->hash % MACRO_HASH_SIZE];
+    while (*pp != cm) {
+	pp = &(*pp)->hnext;
+    }
+    *pp = cm->hnext;
+    llist_unlink(&cm->llist);
+    macro_cache_count--;
+    unref_compiled_macro(cm);
+}
+
+/*
+ * Look up a macro in the compiled macro cache.
+ *
+ * Returns a new reference to the compiled macro, or NULL.
+ */
+static compiled_macro_t *
+find_compiled_macro(const char *text, size_t len)
+{
+    compiled_macro_t *cm;
+    unsigned hash;
+
+    /* Most emulators never cache anything, so don't hash for nothing. */
+    if (macro_cache_count == 0) {
+	return NULL;
+    }
+
+    hash = macro_text_hash(text, len);
+    for (cm = macro_hash[hash % MACRO_HASH_SIZE]; cm != NULL;
+	    cm = cm->hnext) {
+	if (cm->hash == hash && !strncmp(cm->text, text, len) &&
+		cm->text[len] == '\0') {
+	    if (cm->actions_count != actions_list_count) {
+		/* New actions have been defined, so it is stale. */
+		uncache_compiled_macro(cm);
+		return NULL;
+	    }
+
+	    /* Move it to the front, so the oldest entries are at the back. */
+	    llist_unlink(&cm->llist);
+	    llist_insert_before(&cm->llist, macro_cache.next);
+	    cm->refcount++;
+	    return cm;
+	}
+    }
+    return NULL;
+}
+
+/**
+ * Compile a macro and add it to the compiled macro cache, so subsequent runs
+ * of it do not have to parse it again. This is done for the text of macros
+ * that are defined once and run repeatedly, such as login macros and idle
+ * commands.
+ *
+ * @param[in] text	Macro text
+ */
+void
+task_cache_macro(const char *text)
+{
+    compiled_macro_t *cm;
+
+    if (text == NULL) {
+	return;
+    }
+
+    /* See if it is already there. */
+    if ((cm = find_compiled_macro(text, strlen(text))) != NULL) {
+	unref_compiled_macro(cm);
+	return;
+    }
+
+    /* Compile it. */
+    if ((cm = compile_macro(text)) == NULL) {
+	vtrace("Macro '%s' not cached\n", no_ctrl(text));
+	return;
+    }
+
+    /* Trim the cache. */
+    if (macro_cache_count >= MACRO_CACHE_MAX) {
+	uncache_compiled_macro((compiled_macro_t *)macro_cache.prev);
+    }
+
+    /* Add it at the front, and to its hash bucket. */
+    llist_insert_before(&cm->llist, macro_cache.next);
+    cm->hash = macro_text_hash(text, strlen(text));
+    cm->hnext = macro_hash[cm->hash % MACRO_HASH_SIZE];
+    macro_hash[cm->hash % MACRO_HASH_SIZE] = cm;
+    macro_cache_count++;
+}
+
+/**
+ * Empty the compiled macro cache. Called when the resources that define
+ * macros change.
+ */
+void
+task_flush_macro_cache(void)
+{
+    while (!llist_isempty(&macro_cache)) {
+	uncache_compiled_macro((compiled_macro_t *)macro_cache.next);
+    }
 }
 
 /* Expand control characters in a string. */
@@ -1239,10 +1570,12 @@ run_macro(void)
     vtrace(TASK_NAME_FMT " running\n", TASK_NAME);
 
     /*
-     * Keep executing commands off the line until one pauses or
-     * we run out of commands.
+     * Keep executing commands off the line (or out of the compiled macro)
+     * until one pauses or we run out of commands.
      */
-    while (*a && !fatal) {
+    while ((s->macro.compiled != NULL?
+		s->macro.cix < s->macro.compiled->count: *a != '\0') &&
+	    !fatal) {
 	enum iaction ia;
 	bool was_ckbwait = CKBWAIT;
 	bool was_ft = (ft_state != FT_NONE);
@@ -1260,8 +1593,23 @@ run_macro(void)
 	    break;
 	}
 
+	/*
+	 * Give other task queues a turn if this one has used up its own.
+	 * run_taskq() will notice and do the rest.
+	 */
+	if (sched_expired()) {
+	    task_set_state(s, TS_RUNNING, "preempted");
+	    return;
+	}
+	sched_used++;
+
 	task_set_state(s, TS_RUNNING, "executing");
-	vtrace(TASK_NAME_FMT " '%s'\n", TASK_NAME, no_ctrl(a));
+	if (s->macro.compiled != NULL) {
+	    vtrace(TASK_NAME_FMT " '%s' (compiled)\n", TASK_NAME,
+		    no_ctrl(s->macro.compiled->commands[s->macro.cix].text));
+	} else {
+	    vtrace(TASK_NAME_FMT " '%s'\n", TASK_NAME, no_ctrl(a));
+	}
 	s->success = true;
 
 	if (s->type == ST_MACRO &&
@@ -1272,8 +1620,14 @@ run_macro(void)
 	    ia = IA_MACRO;
 	}
 
-	es = execute_command(ia, a, &nextm, s->macro.last, LAST_BUF);
-	s->macro.dptr = nextm;
+	if (s->macro.compiled != NULL) {
+	    es = execute_parsed(ia,
+		    &s->macro.compiled->commands[s->macro.cix++],
+		    s->macro.last, LAST_BUF);
+	} else {
+	    es = execute_command(ia, a, &nextm, s->macro.last, LAST_BUF);
+	    s->macro.dptr = nextm;
+	}
 
 	/*
 	 * If a new task was started, we will be resumed
@@ -1339,6 +1693,8 @@ push_xmacro_onto(taskq_t *q, enum task_type type, const char *st, size_t len,
     memcpy(s->macro.msc, st, len);
     s->macro.msc[len] = '\0';
     s->macro.dptr = s->macro.msc;
+    s->macro.compiled = find_compiled_macro(st, len);
+    s->macro.cix = 0;
     s->fatal = false;
     task_set_state(s, TS_RUNNING, "fresh push");
     return s;
@@ -1410,6 +1766,14 @@ push_cb(const char *buf, size_t len, const tcb_t *cb, task_cbh handle)
 	q->index = taskq_index++;
 	q->deleted = false;
 	q->output_wait_needed = find_owait(cb);
+	if (cb->flags & CB_UI) {
+	    q->sclass = SC_UI;
+	} else if (cb->flags & CB_BULK) {
+	    q->sclass = SC_BULK;
+	} else {
+	    q->sclass = SC_NORMAL;
+	}
+	gettimeofday(&q->ready, NULL);
 	LLIST_APPEND(&q->llist, taskq);
 	name = q->unique_name = xs_buffer("CB(%s)[#%u]", q->name, q->index);
 	vtrace("%s started%s\n", name, q->output_wait_needed? " (owait)": "");
@@ -1698,6 +2062,80 @@ connect_errno(int e, const char *fmt, ...)
     Free(msg);
 }
 
+/*
+ * Start a task queue's turn.
+ */
+static void
+sched_start_turn(taskq_t *q)
+{
+    struct timeval now;
+    unsigned long usec;
+
+    gettimeofday(&now, NULL);
+    sched_used = 0;
+    sched_quantum = sched_classes[q->sclass].commands;
+    usec = now.tv_usec + sched_classes[q->sclass].usec;
+    sched_deadline.tv_sec = now.tv_sec + (usec / USEC_PER_SEC);
+    sched_deadline.tv_usec = usec % USEC_PER_SEC;
+    sched_classes[q->sclass].turns++;
+
+    /* Account for the time it spent waiting. */
+    if (q->ready.tv_sec != 0) {
+	unsigned long waited = 0L;
+
+	if (now.tv_sec > q->ready.tv_sec ||
+		(now.tv_sec == q->ready.tv_sec &&
+		 now.tv_usec >= q->ready.tv_usec)) {
+	    waited = ((now.tv_sec - q->ready.tv_sec) * USEC_PER_SEC) +
+		now.tv_usec - q->ready.tv_usec;
+	}
+	q->waited_usec += waited;
+	sched_classes[q->sclass].waited_usec += waited;
+	if (waited > sched_classes[q->sclass].max_wait_usec) {
+	    sched_classes[q->sclass].max_wait_usec = waited;
+	}
+	q->ready.tv_sec = 0;
+	q->ready.tv_usec = 0;
+    }
+}
+
+/*
+ * Check for the end of the current turn.
+ * At least one command is always allowed per turn.
+ */
+static bool
+sched_expired(void)
+{
+    struct timeval now;
+
+    if (sched_used == 0) {
+	return false;
+    }
+    if (sched_used >= sched_quantum) {
+	return true;
+    }
+    gettimeofday(&now, NULL);
+    return now.tv_sec > sched_deadline.tv_sec ||
+	(now.tv_sec == sched_deadline.tv_sec &&
+	 now.tv_usec >= sched_deadline.tv_usec);
+}
+
+/*
+ * Cut a task queue's turn short. It goes to the end of the list, so the other
+ * queues in its class go first next time.
+ */
+static void
+sched_preempt(taskq_t *q)
+{
+    vtrace("CB(%s)[#%u] preempted after %u command%s\n", q->name, q->index,
+	    sched_used, (sched_used == 1)? "": "s");
+    sched_classes[q->sclass].preemptions++;
+    sched_any_preempted = true;
+    gettimeofday(&q->ready, NULL);
+    llist_unlink(&q->llist);
+    LLIST_APPEND(&q->llist, taskq);
+}
+
 /**
  * Run one task queue.
  *
@@ -1715,6 +2153,14 @@ run_taskq(void)
 	    return any;
 	}
 
+	if ((current_task->state == TS_RUNNING ||
+		    current_task->state == TS_NEED_RUN) &&
+		sched_expired()) {
+	    /* Used up its turn. */
+	    sched_preempt(current_task->taskq);
+	    return any;
+	}
+
 	switch (current_task->state) {
 
 	case TS_IDLE:
@@ -1866,30 +2312,47 @@ run_taskq(void)
 
 /**
  * Run pending tasks.
+ *
+ * Each task queue gets one turn per call, in priority order of its scheduling
+ * class. A turn ends when the queue blocks, or when it has used up its
+ * class's command or time quantum. A queue whose turn was cut short is moved
+ * to the end of the list, so queues in the same class take turns, and since
+ * every queue gets a turn on every call, none of them can be starved.
+ *
+ * @return true if any task ran
  */
 bool
 run_tasks(void)
 {
     taskq_t *q;
     bool any = false;
+    int sc;
 
     /* There is no running task unless we are inside this function. */
     assert(current_task == NULL);
 
+    sched_pass++;
+    sched_any_preempted = false;
+
 restart:
-    /* Walk each queue, and run the tasks on it. */
-    FOREACH_LLIST(&taskq, q, taskq_t *) {
-	if (q->top != NULL) {
-	    current_task = q->top;
-	    any |= run_taskq();
-	}
-	if (q->deleted) {
-	    llist_unlink(&q->llist);
-	    Free(q->unique_name);
-	    Free(q);
-	    goto restart;
-	}
-    } FOREACH_LLIST_END(&taskq, q, taskq_t *);
+    /* Walk each queue, in priority order, and run the tasks on it. */
+    for (sc = 0; sc < NUM_SC; sc++) {
+	FOREACH_LLIST(&taskq, q, taskq_t *) {
+	    if (q->top != NULL && q->sclass == (enum sched_class)sc &&
+		    q->sched_pass != sched_pass) {
+		q->sched_pass = sched_pass;
+		sched_start_turn(q);
+		current_task = q->top;
+		any |= run_taskq();
+	    }
+	    if (q->deleted) {
+		llist_unlink(&q->llist);
+		Free(q->unique_name);
+		Free(q);
+		goto restart;
+	    }
+	} FOREACH_LLIST_END(&taskq, q, taskq_t *);
+    }
 
     /* Now there is no active task. */
     current_task = NULL;
@@ -1897,6 +2360,40 @@ restart:
     return any;
 }
 
+/**
+ * Check for task queues that were preempted in the last call to run_tasks()
+ * and are still ready to run. The event loop uses this to poll for I/O
+ * without blocking.
+ *
+ * @return true if there are runnable tasks
+ */
+bool
+task_pending(void)
+{
+    return sched_any_preempted;
+}
+
+/**
+ * Count the active task queues and the tasks on them.
+ *
+ * @param[out] queues	Returned number of queues
+ * @param[out] tasks	Returned number of tasks
+ */
+void
+task_get_depth(unsigned *queues, unsigned *tasks)
+{
+    taskq_t *q;
+
+    *queues = 0;
+    *tasks = 0;
+    FOREACH_LLIST(&taskq, q, taskq_t *) {
+	if (q->top != NULL) {
+	    (*queues)++;
+	    *tasks += q->depth;
+	}
+    } FOREACH_LLIST_END(&taskq, q, taskq_t *);
+}
+
 /* Set and propagate the output_wait_needed flag. */
 static void
 set_output_needed(bool needed)
@@ -1943,6 +2440,70 @@ set_output_needed(bool needed)
  * Macro- and script-specific actions.
  */
 
+static const char hex_digits[] = "0123456789abcdef";
+
+/*
+ * Append a byte to a varbuf as two hex digits, optionally preceded by a
+ * space. This is called for every screen position, so it avoids printf.
+ */
+static void
+vb_append_hex(varbuf_t *r, bool space, unsigned char c)
+{
+    char hex[3];
+    size_t n = 0;
+
+    if (space) {
+	hex[n++] = ' ';
+    }
+    hex[n++] = hex_digits[c >> 4];
+    hex[n++] = hex_digits[c & 0xf];
+    vb_append(r, hex, n);
+}
+
+/*
+ * Append a Unicode value to a varbuf as a space and a hex number of at least
+ * four digits (the equivalent of " %04x").
+ */
+static void
+vb_append_uhex(varbuf_t *r, ucs4_t u)
+{
+    char hex[1 + 8];
+    int ndigits = 4;
+    int i;
+
+    while (ndigits < 8 && (u >> (ndigits * 4)) != 0) {
+	ndigits++;
+    }
+    hex[0] = ' ';
+    for (i = ndigits; i > 0; i--) {
+	hex[i] = hex_digits[u & 0xf];
+	u >>= 4;
+    }
+    vb_append(r, hex, ndigits + 1);
+}
+
+/*
+ * Append an extended attribute type and value pair to a varbuf
+ * (the equivalent of "%s%02x=%02x").
+ */
+static void
+vb_append_attr(varbuf_t *r, const char *sep, unsigned char type,
+	unsigned char value)
+{
+    vb_appends(r, sep);
+    vb_append_hex(r, false, type);
+    vb_append(r, "=", 1);
+    vb_append_hex(r, false, value);
+}
+
+/* Returns true if a buffer position holds plain 3270-mode SBCS text. */
+static bool
+is_plain_sbcs(struct ea *buf, int baddr)
+{
+    return !buf[baddr].fa && !buf[baddr].ucs4 && buf[baddr].cs == CS_BASE &&
+	!IS_LEFT(ctlr_dbcs_state(baddr)) && !IS_RIGHT(ctlr_dbcs_state(baddr));
+}
+
 static void
 dump_range(int first, int len, bool in_ascii, struct ea *buf,
     int rel_rows _is_unused, int rel_cols, bool force_utf8)
@@ -1951,6 +2512,9 @@ dump_range(int first, int len, bool in_ascii, struct ea *buf,
     bool any = false;
     bool is_zero = false;
     varbuf_t r;
+    unsigned char *run_ebc = NULL;
+    char *run_mb = NULL;
+    size_t run_mb_len = 0;
 
     vb_init(&r);
 
@@ -1982,7 +2546,6 @@ dump_range(int first, int len, bool in_ascii, struct ea *buf,
 	if (in_ascii) {
 	    char mb[16];
 	    ucs4_t uc;
-	    size_t j;
 	    size_t xlen;
 
 	    if (buf[first + i].fa) {
@@ -2000,8 +2563,8 @@ dump_range(int first, int len, bool in_ascii, struct ea *buf,
 		    }
 		    xlen = unicode_to_multibyte_f(uc, mb, sizeof(mb),
 			    force_utf8);
-		    for (j = 0; j < xlen - 1; j++) {
-			vb_appendf(&r, "%c", mb[j]);
+		    if (xlen > 1) {
+			vb_append(&r, mb, xlen - 1);
 		    }
 		} else {
 		    /* 3270-mode text. */
@@ -2009,17 +2572,39 @@ dump_range(int first, int len, bool in_ascii, struct ea *buf,
 			xlen = ebcdic_to_multibyte_f((buf[first + i].ec << 8) |
 				buf[first + i + 1].ec,
 				mb, sizeof(mb), force_utf8);
-			for (j = 0; j < xlen - 1; j++) {
-			    vb_appendf(&r, "%c", mb[j]);
+			if (xlen > 1) {
+			    vb_append(&r, mb, xlen - 1);
+			}
+		    } else if (!toggled(MONOCASE) &&
+			    is_plain_sbcs(buf, first + i)) {
+			int n = 0;
+
+			/*
+			 * Translate a run of plain SBCS text, up to the end of
+			 * the row, in one go.
+			 */
+			if (run_ebc == NULL) {
+			    run_ebc = Malloc(rel_cols);
+			    run_mb_len = mb_max_len(rel_cols);
+			    run_mb = Malloc(run_mb_len);
+			}
+			run_ebc[n++] = buf[first + i].ec;
+			while (i + 1 < len && (first + i + 1) % rel_cols &&
+				is_plain_sbcs(buf, first + i + 1)) {
+			    i++;
+			    run_ebc[n++] = buf[first + i].ec;
 			}
+			xlen = ebcdic_to_multibyte_string_f(run_ebc, n, run_mb,
+				run_mb_len, force_utf8);
+			vb_append(&r, run_mb, xlen);
 		    } else {
 			xlen = ebcdic_to_multibyte_fx(buf[first + i].ec,
 				buf[first + i].cs, mb, sizeof(mb),
 				EUO_BLANK_UNDEF |
 				 (toggled(MONOCASE)? EUO_TOUPPER: 0),
 				&uc, force_utf8);
-			for (j = 0; j < xlen - 1; j++) {
-			    vb_appendf(&r, "%c", mb[j]);
+			if (xlen > 1) {
+			    vb_append(&r, mb, xlen - 1);
 			}
 		    }
 		}
@@ -2040,7 +2625,7 @@ dump_range(int first, int len, bool in_ascii, struct ea *buf,
 		/* 3270-mode text. */
 		ebc = buf[first + i].ec;
 	    }
-	    vb_appendf(&r, "%s%02x", any ? " " : "", ebc);
+	    vb_append_hex(&r, any, ebc);
 	}
 	any = true;
     }
@@ -2048,6 +2633,8 @@ dump_range(int first, int len, bool in_ascii, struct ea *buf,
 	action_output("%s", vb_buf(&r));
     }
     vb_free(&r);
+    Free(run_ebc);
+    Free(run_mb);
 }
 
 static bool
@@ -2208,6 +2795,77 @@ calc_cs(unsigned char cs)
     }
 }
 
+/*
+ * Append one screen position to a varbuf in ReadBuffer(Binary) format:
+ *  0 field attribute (nonzero for a field attribute position)
+ *  1 EBCDIC code
+ *  2 character set
+ *  3 foreground color
+ *  4 background color
+ *  5 highlighting
+ *  6 input control
+ *  7 DBCS state
+ *  8-11 NVT-mode Unicode value, big-endian
+ */
+static void
+binary_cell(varbuf_t *r, const struct ea *ea)
+{
+    char cell[RB_BINARY_CELL];
+
+    cell[0] = ea->fa;
+    cell[1] = ea->ec;
+    cell[2] = ea->cs;
+    cell[3] = ea->fg;
+    cell[4] = ea->bg;
+    cell[5] = ea->gr;
+    cell[6] = ea->ic;
+    cell[7] = ea->db;
+    cell[8] = (ea->ucs4 >> 24) & 0xff;
+    cell[9] = (ea->ucs4 >> 16) & 0xff;
+    cell[10] = (ea->ucs4 >> 8) & 0xff;
+    cell[11] = ea->ucs4 & 0xff;
+    vb_append(r, cell, RB_BINARY_CELL);
+}
+
+/*
+ * ReadBuffer(Binary): Dump the raw character and attribute planes in base64,
+ * one line per row, or the current field on a single 'Contents' line.
+ * Because each cell is a multiple of 3 bytes, there is never any padding,
+ * and each cell is exactly 16 base64 characters.
+ */
+static void
+read_buffer_binary(struct ea *buf, bool field, int baddr)
+{
+    varbuf_t r;
+    char *b64;
+
+    vb_init(&r);
+    if (field) {
+	int field_baddr = baddr;
+
+	do {
+	    binary_cell(&r, &buf[baddr]);
+	    INC_BA(baddr);
+	} while (baddr != field_baddr && !buf[baddr].fa);
+	b64 = base64_encode_buf(vb_buf(&r), vb_len(&r));
+	action_output("Contents: %s", b64);
+	Free(b64);
+    } else {
+	int row, col;
+
+	for (row = 0; row < ROWS; row++) {
+	    vb_reset(&r);
+	    for (col = 0; col < COLS; col++) {
+		binary_cell(&r, &buf[(row * COLS) + col]);
+	    }
+	    b64 = base64_encode_buf(vb_buf(&r), vb_len(&r));
+	    action_output("%s", b64);
+	    Free(b64);
+	}
+    }
+    vb_free(&r);
+}
+
 /*
  * Internals of the ReadBuffer action.
  * Operates on the supplied 'buf' parameter, which might be the live
@@ -2223,7 +2881,7 @@ do_read_buffer(const char **params, unsigned num_params, struct ea *buf,
     unsigned char current_gr = 0x00;
     unsigned char current_cs = 0x00;
     unsigned char current_ic = 0x00;
-    enum { RB_ASCII, RB_EBCDIC, RB_UNICODE } mode = RB_ASCII;
+    enum { RB_ASCII, RB_EBCDIC, RB_UNICODE, RB_BINARY } mode = RB_ASCII;
     varbuf_t r;
     bool field = false;
     int field_baddr = 0;
@@ -2239,11 +2897,13 @@ do_read_buffer(const char **params, unsigned num_params, struct ea *buf,
 		mode = RB_EBCDIC;
 	    } else if (!strncasecmp(params[i], KwUnicode, strlen(params[i]))) {
 		mode = RB_UNICODE;
+	    } else if (!strncasecmp(params[i], KwBinary, strlen(params[i]))) {
+		mode = RB_BINARY;
 	    } else if (!strncasecmp(params[i], KwField, strlen(params[i]))) {
 		field = true;
 	    } else {
 		return action_args_are(AnReadBuffer, KwAscii, KwEbcdic,
-			KwUnicode, KwField, NULL);
+			KwUnicode, KwBinary, KwField, NULL);
 		return false;
 	    }
 	}
@@ -2281,6 +2941,11 @@ do_read_buffer(const char **params, unsigned num_params, struct ea *buf,
 	baddr = 0;
     }
 
+    if (mode == RB_BINARY) {
+	read_buffer_binary(buf, field, baddr);
+	return true;
+    }
+
     vb_init(&r);
     for (;;) {
 	if (!field && !(baddr % COLS)) {
@@ -2293,51 +2958,47 @@ do_read_buffer(const char **params, unsigned num_params, struct ea *buf,
 	    if (field && any) {
 		break;
 	    }
-	    vb_appendf(&r, " SF(%02x=%02x", XA_3270, buf[baddr].fa);
+	    vb_append_attr(&r, " SF(", XA_3270, buf[baddr].fa);
 	    if (buf[baddr].fg) {
-		vb_appendf(&r, ",%02x=%02x", XA_FOREGROUND, buf[baddr].fg);
+		vb_append_attr(&r, ",", XA_FOREGROUND, buf[baddr].fg);
 	    }
 	    if (buf[baddr].bg) {
-		vb_appendf(&r, ",%02x=%02x", XA_BACKGROUND, buf[baddr].bg);
+		vb_append_attr(&r, ",", XA_BACKGROUND, buf[baddr].bg);
 	    }
 	    if (buf[baddr].gr) {
-		vb_appendf(&r, ",%02x=%02x", XA_HIGHLIGHTING,
+		vb_append_attr(&r, ",", XA_HIGHLIGHTING,
 			buf[baddr].gr | 0xf0);
 	    }
 	    if (buf[baddr].ic) {
-		vb_appendf(&r, ",%02x=%02x", XA_INPUT_CONTROL, buf[baddr].ic);
+		vb_append_attr(&r, ",", XA_INPUT_CONTROL, buf[baddr].ic);
 	    }
 	    if (buf[baddr].cs & CS_MASK) {
-		vb_appendf(&r, ",%02x=%02x", XA_CHARSET,
-			calc_cs(buf[baddr].cs));
+		vb_append_attr(&r, ",", XA_CHARSET, calc_cs(buf[baddr].cs));
 	    }
-	    vb_appends(&r, ")");
+	    vb_append(&r, ")", 1);
 	} else {
 	    bool any_sa = false;
 	    unsigned char xcs;
 #           define SA_SEP (any_sa? ",": " SA(")
 
 	    if (buf[baddr].fg != current_fg) {
-		vb_appendf(&r, "%s%02x=%02x", SA_SEP, XA_FOREGROUND,
-			buf[baddr].fg);
+		vb_append_attr(&r, SA_SEP, XA_FOREGROUND, buf[baddr].fg);
 		current_fg = buf[baddr].fg;
 		any_sa = true;
 	    }
 	    if (buf[baddr].bg != current_bg) {
-		vb_appendf(&r, "%s%02x=%02x", SA_SEP, XA_BACKGROUND,
-			buf[baddr].fg);
+		vb_append_attr(&r, SA_SEP, XA_BACKGROUND, buf[baddr].fg);
 		current_bg = buf[baddr].bg;
 		any_sa = true;
 	    }
 	    if (buf[baddr].gr != current_gr) {
-		vb_appendf(&r, "%s%02x=%02x", SA_SEP, XA_HIGHLIGHTING,
+		vb_append_attr(&r, SA_SEP, XA_HIGHLIGHTING,
 			buf[baddr].gr | 0xf0);
 		current_gr = buf[baddr].gr;
 		any_sa = true;
 	    }
 	    if (buf[baddr].ic != current_ic) {
-		vb_appendf(&r, "%s%02x=%02x", SA_SEP, XA_INPUT_CONTROL,
-			buf[baddr].ic);
+		vb_append_attr(&r, SA_SEP, XA_INPUT_CONTROL, buf[baddr].ic);
 		current_gr = buf[baddr].gr;
 		any_sa = true;
 	    }
@@ -2347,12 +3008,12 @@ do_read_buffer(const char **params, unsigned num_params, struct ea *buf,
 		xcs = CS_BASE;
 	    }
 	    if (xcs != (current_cs & CS_MASK)) {
-		vb_appendf(&r, "%s%02x=%02x", SA_SEP, XA_CHARSET, calc_cs(xcs));
+		vb_append_attr(&r, SA_SEP, XA_CHARSET, calc_cs(xcs));
 		current_cs = xcs;
 		any_sa = true;
 	    }
 	    if (any_sa) {
-		vb_appends(&r, ")");
+		vb_append(&r, ")", 1);
 	    }
 	    if (mode == RB_EBCDIC) {
 		/*
@@ -2361,9 +3022,11 @@ do_read_buffer(const char **params, unsigned num_params, struct ea *buf,
 		 * anything in EBCDIC.
 		 */
 		if (buf[baddr].cs & CS_GE) {
-		    vb_appendf(&r, " GE(%02x)", buf[baddr].ec);
+		    vb_append(&r, " GE(", 4);
+		    vb_append_hex(&r, false, buf[baddr].ec);
+		    vb_append(&r, ")", 1);
 		} else {
-		    vb_appendf(&r, " %02x", buf[baddr].ec);
+		    vb_append_hex(&r, true, buf[baddr].ec);
 		}
 	    } else if (mode == RB_ASCII) {
 		bool done = false;
@@ -2382,13 +3045,13 @@ do_read_buffer(const char **params, unsigned num_params, struct ea *buf,
 			len = ebcdic_to_multibyte_f((buf[baddr].ec << 8) | buf[baddr + 1].ec, mb,
 				sizeof(mb), force_utf8);
 		    }
-		    vb_appends(&r, " ");
-		    for (j = 0; j < len-1; j++) {
-			vb_appendf(&r, "%02x", mb[j] & 0xff);
+		    vb_append(&r, " ", 1);
+		    for (j = 0; j + 1 < len; j++) {
+			vb_append_hex(&r, false, mb[j] & 0xff);
 		    }
 		    done = true;
 		} else if (IS_RIGHT(ctlr_dbcs_state(baddr))) {
-		    vb_appends(&r, " -");
+		    vb_append(&r, " -", 2);
 		    done = true;
 		}
 
@@ -2418,12 +3081,12 @@ do_read_buffer(const char **params, unsigned num_params, struct ea *buf,
 		}
 
 		if (!done) {
-		    vb_appends(&r, " ");
+		    vb_append(&r, " ", 1);
 		    if (mb[0] == '\0') {
-			vb_appends(&r, "00");
+			vb_append(&r, "00", 2);
 		    } else {
 			for (j = 0; mb[j]; j++) {
-			    vb_appendf(&r, "%02x", mb[j] & 0xff);
+			    vb_append_hex(&r, false, mb[j] & 0xff);
 			}
 		    }
 		}
@@ -2432,7 +3095,7 @@ do_read_buffer(const char **params, unsigned num_params, struct ea *buf,
 		ucs4_t uc;
 
 		if (IS_RIGHT(ctlr_dbcs_state(baddr))) {
-		    vb_appends(&r, " -");
+		    vb_append(&r, " -", 2);
 		} else {
 		    if (IS_LEFT(ctlr_dbcs_state(baddr))) {
 			if ((uc = buf[baddr].ucs4) == 0) {
@@ -2460,7 +3123,7 @@ do_read_buffer(const char **params, unsigned num_params, struct ea *buf,
 			    }
 			}
 		    }
-		    vb_appendf(&r, " %04x", uc);
+		    vb_append_uhex(&r, uc);
 		}
 	    }
 	}
@@ -3665,12 +4328,15 @@ task_get_tasks(void)
 {
     varbuf_t r;
     taskq_t *q;
+    int sc;
 
     vb_init(&r);
 
     FOREACH_LLIST(&taskq, q, taskq_t *) {
 	int i;
-	vb_appendf(&r, "CB(%s) #%u\n", q->name, q->index);
+	vb_appendf(&r, "CB(%s) #%u %s waited %.3fs\n", q->name, q->index,
+		sched_classes[q->sclass].name,
+		(double)q->waited_usec / USEC_PER_SEC);
 
 	/* Walk the list backwards. */
 	for (i = 0; i < q->depth; i++) {
@@ -3696,6 +4362,19 @@ task_get_tasks(void)
 	}
     } FOREACH_LLIST_END(&taskq, q, taskq_t *);
 
+    /* Dump the scheduler statistics. */
+    for (sc = 0; sc < NUM_SC; sc++) {
+	vb_appendf(&r, "Class %s: %lu turns, %lu preempted, latency avg "
+		"%.3fs max %.3fs\n",
+		sched_classes[sc].name,
+		sched_classes[sc].turns,
+		sched_classes[sc].preemptions,
+		sched_classes[sc].turns?
+		    ((double)sched_classes[sc].waited_usec /
+		     sched_classes[sc].turns / USEC_PER_SEC): 0.0,
+		(double)sched_classes[sc].max_wait_usec / USEC_PER_SEC);
+    }
+
     return vb_consume(&r);
 }
 
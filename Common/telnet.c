@@ -69,6 +69,7 @@
 #include "kybd.h"
 #include "lazya.h"
 #include "linemode.h"
+#include "metrics.h"
 #include "names.h"
 #include "nvt.h"
 #include "popups.h"
@@ -979,6 +980,9 @@ net_connected(void)
 	sio_negotiate_ret_t rv;
 	char *session, *cert;
 
+	if (cstate != TLS_PENDING) {
+	    metrics_start(MH_TLS_HANDSHAKE);
+	}
 	change_cstate(TLS_PENDING, "net_connected");
 
 	rv = sio_negotiate(sio, sock, hostname, &data);
@@ -1002,6 +1006,7 @@ net_connected(void)
 		sio_provider(), session, cert);
 	Free(session);
 	Free(cert);
+	metrics_stop(MH_TLS_HANDSHAKE);
 	st_changed(ST_SECURE, true);
 
 	/* Tell everyone else again. */
@@ -1393,6 +1398,7 @@ net_input(iosrc_t fd _is_unused, ioid_t id _is_unused)
     trace_netdata('<', netrbuf, nr);
 
     ns_brcvd += nr;
+    metrics_count(MC_BYTES_RECEIVED, nr);
     stats_poke();
     for (cp = netrbuf; cp < (netrbuf + nr); cp++) {
 #if defined(LOCAL_PROCESS) /*[*/
@@ -1623,6 +1629,7 @@ telnet_fsm(unsigned char c)
 	case EOR:	/* eor, process accumulated input */
 	    if (IN_3270 || (IN_E && tn3270e_negotiated)) {
 		ns_rrcvd++;
+		metrics_count(MC_RECORDS_RECEIVED, 1);
 		stats_poke();
 		if (process_eor()) {
 		    return false;
@@ -2692,6 +2699,7 @@ net_rawout(unsigned const char *buf, size_t len)
 	    }
 	}
 	ns_bsent += nw;
+	metrics_count(MC_BYTES_SENT, nw);
 	stats_poke();
 	len -= nw;
 	buf += nw;
@@ -3005,17 +3013,30 @@ trace_netdata(char direction, unsigned const char *buf, size_t len)
  */
 void
 net_output(void)
+{
+    net_output_buf(obuf, obptr - obuf);
+}
+
+/*
+ * net_output_buf
+ *	Send a 3270 record from a buffer other than obuf, the same way
+ *	net_output() does. This saves copying a record that is kept
+ *	somewhere else into obuf first.
+ */
+void
+net_output_buf(const unsigned char *buf, size_t len)
 {
     static unsigned char *xobuf = NULL;
-    static int xobuf_len = 0;
+    static size_t xobuf_len = 0;
+    unsigned char hbuf[EH_SIZE];
+    size_t hlen = 0;
     int need_resize = 0;
-    unsigned char *nxoptr, *xoptr;
-
-#define BSTART	((IN_TN3270E || IN_SSCP)? obuf_base: obuf)
+    unsigned char *xoptr;
+    size_t i;
 
     /* Set the TN3720E header. */
     if (IN_TN3270E || IN_SSCP) {
-	tn3270e_header *h = (tn3270e_header *)obuf_base;
+	tn3270e_header *h = (tn3270e_header *)hbuf;
 
 	/* Check for sending a TN3270E response. */
 	if (response_required == TN3270E_RSF_ALWAYS_RESPONSE) {
@@ -3030,6 +3051,7 @@ net_output(void)
 	h->response_flag = 0;
 	h->seq_number[0] = (e_xmit_seq >> 8) & 0xff;
 	h->seq_number[1] = e_xmit_seq & 0xff;
+	hlen = EH_SIZE;
 
 	vtrace("SENT TN3270E(%s NO-RESPONSE %u)\n",
 		IN_TN3270E? "3270-DATA": "SSCP-LU-DATA", e_xmit_seq);
@@ -3039,7 +3061,7 @@ net_output(void)
     }
 
     /* Reallocate the expanded output buffer. */
-    while (xobuf_len <  (obptr - BSTART + 1) * 2) {
+    while (xobuf_len < (hlen + len + 1) * 2) {
 	xobuf_len += BUFSZ;
 	need_resize++;
     }
@@ -3049,9 +3071,13 @@ net_output(void)
 
     /* Copy and expand IACs. */
     xoptr = xobuf;
-    nxoptr = BSTART;
-    while (nxoptr < obptr) {
-	if ((*xoptr++ = *nxoptr++) == IAC) {
+    for (i = 0; i < hlen; i++) {
+	if ((*xoptr++ = hbuf[i]) == IAC) {
+	    *xoptr++ = IAC;
+	}
+    }
+    for (i = 0; i < len; i++) {
+	if ((*xoptr++ = buf[i]) == IAC) {
 	    *xoptr++ = IAC;
 	}
     }
@@ -3063,8 +3089,8 @@ net_output(void)
 
     vtrace("SENT EOR\n");
     ns_rsent++;
+    metrics_count(MC_RECORDS_SENT, 1);
     stats_poke();
-#undef BSTART
 }
 
 /* Send a TN3270E positive response to the server. */
@@ -3535,6 +3561,7 @@ net_starttls_continue(void)
 	    sio_provider(), session, cert);
     Free(session);
     Free(cert);
+    metrics_stop(MH_TLS_HANDSHAKE);
     st_changed(ST_SECURE, true);
 
     if (starttls_pending == TELNET_PENDING) {
@@ -3584,6 +3611,7 @@ continue_tls(unsigned char *sbbuf, int len)
     vtrace("%s FOLLOWS %s\n", opt(TELOPT_STARTTLS), cmd(SE));
 
     /* Negotiate. */
+    metrics_start(MH_TLS_HANDSHAKE);
     net_starttls_continue();
 }
 
@@ -121,6 +121,7 @@ do_toggle_reason(toggle_index_t ix, enum toggle_type reason)
      * menu label(s).
      */
     toggle_toggle(ix);
+    state_generation++;
     for (u = t->upcalls; u != NULL; u = u->next) {
 	if (u->upcall != NULL) {
 	    u->upcall(ix, reason);
@@ -504,6 +505,7 @@ have_value:
 	    if (!u->upcall(argv[arg], value)) {
 		goto failed;
 	    }
+	    state_generation++;
 	    if (u->done == NULL) {
 		for (notifies = extended_notifies;
 		     notifies != NULL;
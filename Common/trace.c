@@ -50,6 +50,7 @@
 #include "fprint_screen.h"
 #include "lazya.h"
 #include "menubar.h"
+#include "metrics.h"
 #include "names.h"
 #include "nvt.h"
 #include "popups.h"
@@ -343,6 +344,7 @@ vwtrace(bool do_ts, const char *fmt, va_list args)
 	    }
 	    fwrite(ts, strlen(ts), 1, tracef);
 	    fflush(tracef);
+	    metrics_count(MC_TRACE_BYTES, strlen(ts));
 	    wrote_ts = true;
 	}
 
@@ -357,6 +359,7 @@ vwtrace(bool do_ts, const char *fmt, va_list args)
 	nw = fwrite(bp, n2w, 1, tracef);
 	if (nw == 1) {
 	    fflush(tracef);
+	    metrics_count(MC_TRACE_BYTES, n2w);
 	} else {
 	    if (errno != EPIPE && !IS_EILSEQ(errno)) {
 		popup_an_errno(errno, "Write to trace file failed");
@@ -305,6 +305,52 @@ cpalias_t cpaliases[] = {
 
 static uni_t *cur_uni = NULL;
 
+/*
+ * Unicode-to-EBCDIC (reverse) translation tables, built from the forward
+ * tables.  U+0000 through U+00FF are mapped by a direct array; the rest of
+ * the BMP is split into 256-character pages, which are allocated only when
+ * the code page has characters in them.  A zero entry means there is no
+ * translation.
+ */
+typedef struct {
+    unsigned char latin[256];	/* U+0000..U+00FF */
+    unsigned char *page[256];	/* indexed by the high byte, [0] is latin */
+} u2e_t;
+static u2e_t u2e_cur;		/* current host code page */
+static u2e_t u2e_apl;		/* APL (GE) code page */
+
+/*
+ * EBCDIC-to-UTF-8 translation table for the current host code page, giving
+ * the same result as ebcdic_to_multibyte() in a UTF-8 locale (CS_BASE,
+ * EUO_BLANK_UNDEF).  Every translation is in the BMP, so three bytes are
+ * enough.  e2a_cur[] has the single-byte (ASCII) translations, with 0x80 for
+ * the characters that need more than one byte, so eight of them can be
+ * checked at once.
+ */
+typedef struct {
+    unsigned char len;
+    char bytes[3];
+} e2u8_t;
+static e2u8_t e2u8_cur[256];
+static unsigned char e2a_cur[256];
+
+#define HIGH_BITS	0x8080808080808080ULL
+
+/*
+ * Single-byte EBCDIC-to-Unicode translation tables, giving the same result as
+ * ebcdic_to_unicode().  There is a table for the base character set and one
+ * for GE/APL, for each combination of the flags that affect the translation.
+ * A table is built the first time that combination is used, and they are all
+ * discarded when the host code page changes.
+ */
+#define E2U_FLAGS	(EUO_UPRIV | EUO_ASCII_BOX | EUO_APL_CIRCLED)
+#define E2U_IX(flags)	((((flags) & (EUO_UPRIV | EUO_ASCII_BOX)) >> 1) | \
+			 (((flags) & EUO_APL_CIRCLED) >> 2))
+#define E2U_NIX		8
+enum { E2U_BASE, E2U_APL, E2U_NSETS };
+static ucs4_t e2u_cache[E2U_NSETS][E2U_NIX][256];
+static bool e2u_valid[E2U_NSETS][E2U_NIX];
+
 static void
 codepage_list_one(bool dbcs)
 {
@@ -349,13 +395,10 @@ codepage_list(void)
 
 /*
  * Translate a single EBCDIC character in an arbitrary character set to
- * Unicode.  Note that CS_DBCS is never used -- use CS_BASE and pass an
- * EBCDIC character > 0xff.
- *
- * Returns 0 for no translation.
+ * Unicode, without using the translation tables.
  */
-ucs4_t
-ebcdic_to_unicode(ebc_t c, unsigned char cs, unsigned flags)
+static ucs4_t
+ebcdic_to_unicode_nocache(ebc_t c, unsigned char cs, unsigned flags)
 {
     ucs4_t uc;
 
@@ -388,6 +431,100 @@ ebcdic_to_unicode(ebc_t c, unsigned char cs, unsigned flags)
     return uc;
 }
 
+/* Build a single-byte translation table. */
+static void
+e2u_build(int set, unsigned flags)
+{
+    int ix = E2U_IX(flags);
+    unsigned char cs = (set == E2U_APL)? CS_APL: CS_BASE;
+    int c;
+
+    for (c = 0; c < 256; c++) {
+	e2u_cache[set][ix][c] = ebcdic_to_unicode_nocache(c, cs,
+		flags & E2U_FLAGS);
+    }
+    e2u_valid[set][ix] = true;
+}
+
+/*
+ * Return the single-byte translation table for a character set and set of
+ * flags, building it if necessary.
+ */
+static const ucs4_t *
+e2u_table(int set, unsigned flags)
+{
+    int ix = E2U_IX(flags);
+
+    if (!e2u_valid[set][ix]) {
+	e2u_build(set, flags);
+    }
+    return e2u_cache[set][ix];
+}
+
+/* Discard the single-byte translation tables. */
+static void
+e2u_invalidate(void)
+{
+    memset(e2u_valid, 0, sizeof(e2u_valid));
+}
+
+/*
+ * Translate a single EBCDIC character in an arbitrary character set to
+ * Unicode.  Note that CS_DBCS is never used -- use CS_BASE and pass an
+ * EBCDIC character > 0xff.
+ *
+ * Returns 0 for no translation.
+ */
+ucs4_t
+ebcdic_to_unicode(ebc_t c, unsigned char cs, unsigned flags)
+{
+    int set;
+    int ix;
+
+    if (c & 0xff00) {
+	return ebcdic_to_unicode_nocache(c, cs, flags);
+    }
+    if ((cs & CS_GE) || ((cs & CS_MASK) == CS_APL)) {
+	set = E2U_APL;
+    } else if (cs != CS_BASE) {
+	return 0;
+    } else {
+	set = E2U_BASE;
+    }
+    ix = E2U_IX(flags);
+    if (!e2u_valid[set][ix]) {
+	e2u_build(set, flags);
+    }
+    return e2u_cache[set][ix][c];
+}
+
+/*
+ * Translate a run of single-byte screen buffer positions to Unicode, giving
+ * the same result as calling ebcdic_to_unicode() on each one.  Field
+ * attributes, DBCS and NVT-mode text are not treated specially; the caller
+ * is expected to handle those positions itself.
+ */
+void
+ebcdic_to_unicode_row(const struct ea *ea, size_t len, unsigned flags,
+	ucs4_t *uc)
+{
+    const ucs4_t *base = e2u_table(E2U_BASE, flags);
+    const ucs4_t *apl = e2u_table(E2U_APL, flags);
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+	unsigned char cs = ea[i].cs;
+
+	if (cs == CS_BASE) {
+	    uc[i] = base[ea[i].ec];
+	} else if ((cs & CS_GE) || ((cs & CS_MASK) == CS_APL)) {
+	    uc[i] = apl[ea[i].ec];
+	} else {
+	    uc[i] = 0;
+	}
+    }
+}
+
 /*
  * Translate a single EBCDIC character in the base or DBCS character sets to
  *  Unicode.
@@ -442,6 +579,121 @@ ebcdic_base_to_unicode(ebc_t c, unsigned flags)
     }
 }
 
+/* Empty out a reverse translation table. */
+static void
+u2e_clear(u2e_t *t)
+{
+    int i;
+
+    for (i = 1; i < 256; i++) {
+	Replace(t->page[i], NULL);
+    }
+    memset(t->latin, 0, sizeof(t->latin));
+    t->page[0] = t->latin;
+}
+
+/*
+ * Add a character to a reverse translation table.
+ * If there is more than one EBCDIC code for a character, the first one
+ * added wins.
+ */
+static void
+u2e_add(u2e_t *t, ucs4_t u, unsigned char e)
+{
+    unsigned char **p;
+
+    if (u == 0 || u > 0xffff) {
+	return;
+    }
+    p = &t->page[u >> 8];
+    if (*p == NULL) {
+	*p = (unsigned char *)Malloc(256);
+	memset(*p, 0, 256);
+    }
+    if ((*p)[u & 0xff] == 0) {
+	(*p)[u & 0xff] = e;
+    }
+}
+
+/* Look up a character in a reverse translation table. */
+static unsigned char
+u2e_lookup(const u2e_t *t, ucs4_t u)
+{
+    const unsigned char *p;
+
+    if (u > 0xffff || (p = t->page[u >> 8]) == NULL) {
+	return 0;
+    }
+    return p[u & 0xff];
+}
+
+/* Build the reverse translation table for the current host code page. */
+static void
+u2e_build_cur(void)
+{
+    int i;
+
+    u2e_clear(&u2e_cur);
+    u2e_add(&u2e_cur, 0x0020, 0x40);
+    for (i = 0; i < UT_SIZE; i++) {
+	u2e_add(&u2e_cur, cur_uni->code[i], UT_OFFSET + i);
+    }
+}
+
+/* Build the reverse translation table for the APL code page, once. */
+static void
+u2e_build_apl(void)
+{
+    ebc_t e;
+
+    if (u2e_apl.page[0] != NULL) {
+	return;
+    }
+    u2e_clear(&u2e_apl);
+    for (e = 0x70; e <= 0xfe; e++) {
+	int u = apl_to_unicode(e, EUO_NONE);
+
+	if (u > 0) {
+	    u2e_add(&u2e_apl, (ucs4_t)u, (unsigned char)e);
+	}
+    }
+}
+
+/* Build the EBCDIC-to-UTF-8 tables for the current host code page. */
+static void
+e2u8_build_cur(void)
+{
+    int c;
+
+    for (c = 0; c < 256; c++) {
+	ucs4_t uc = ebcdic_to_unicode(c, CS_BASE, EUO_BLANK_UNDEF);
+	char u8b[7];
+	int nu8;
+
+	if (uc == 0) {
+	    uc = ' ';
+	}
+	nu8 = unicode_to_utf8(uc, u8b);
+	if (nu8 < 0 || nu8 > (int)sizeof(e2u8_cur[c].bytes)) {
+	    nu8 = 0;
+	}
+	e2u8_cur[c].len = nu8;
+	memcpy(e2u8_cur[c].bytes, u8b, nu8);
+	e2a_cur[c] = (nu8 == 1)? u8b[0]: 0x80;
+    }
+}
+
+/* Returns true if the local multi-byte encoding is UTF-8. */
+static bool
+local_is_utf8(void)
+{
+#if defined(_WIN32) /*[*/
+    return u_local_cp == CP_UTF8;
+#else /*][*/
+    return is_utf8;
+#endif /*]*/
+}
+
 /*
  * Map a UCS-4 character to an EBCDIC character.
  * Returns 0 for failure, nonzero for success.
@@ -449,7 +701,6 @@ ebcdic_base_to_unicode(ebc_t c, unsigned flags)
 ebc_t
 unicode_to_ebcdic(ucs4_t u)
 {
-    int i;
     ebc_t d;
 
     if (!u)
@@ -457,10 +708,8 @@ unicode_to_ebcdic(ucs4_t u)
     if (u == 0x0020)
 	return 0x40;
 
-    for (i = 0; i < UT_SIZE; i++) {
-	if (cur_uni->code[i] == u) {
-	    return UT_OFFSET + i;
-	}
+    if ((d = u2e_lookup(&u2e_cur, u)) != 0) {
+	return d;
     }
     /* See if it's DBCS. */
     d = unicode_to_ebcdic_dbcs(u);
@@ -485,14 +734,7 @@ unicode_to_ebcdic_ge(ucs4_t u, bool *ge, bool prefer_apl)
     e_cur = unicode_to_ebcdic(u);
 
     /* Find the character in the APL code page. */
-    for (e_apl = 0x70; e_apl <= 0xfe; e_apl++) {
-	if ((ucs4_t)apl_to_unicode(e_apl, EUO_NONE) == u) {
-	    break;
-	}
-    }
-    if (e_apl > 0xfe) {
-	e_apl = 0;
-    }
+    e_apl = u2e_lookup(&u2e_apl, u);
 
     if (e_apl != 0 && ((e_cur == 0) || prefer_apl)) {
 	*ge = true;
@@ -590,6 +832,14 @@ set_uni(const char *cpname, int local_cp _is_unused,
 	}
     }
 
+    /* Build the reverse and UTF-8 translation tables. */
+    if (rc) {
+	e2u_invalidate();
+	u2e_build_cur();
+	u2e_build_apl();
+	e2u8_build_cur();
+    }
+
     if (cannot_fail && !rc) {
 	Error("Cannot find default charset definition");
     }
@@ -965,6 +1215,17 @@ ebcdic_to_multibyte_x(ebc_t ebc, unsigned char cs, char mb[],
 size_t
 ebcdic_to_multibyte(ebc_t ebc, char mb[], size_t mb_len)
 {
+    /* SBCS characters in a UTF-8 locale come straight from the table. */
+    if (ebc < 0x100 && local_is_utf8() && mb_len > e2u8_cur[ebc].len) {
+	const e2u8_t *x = &e2u8_cur[ebc];
+
+	if (x->len == 0) {
+	    return 0;
+	}
+	memcpy(mb, x->bytes, x->len);
+	mb[x->len] = '\0';
+	return x->len + 1;
+    }
     return ebcdic_to_multibyte_x(ebc, CS_BASE, mb, mb_len, EUO_BLANK_UNDEF,
 	    NULL);
 }
@@ -1012,17 +1273,90 @@ ebcdic_to_multibyte_fx(ebc_t ebc, unsigned char cs, char mb[], size_t mb_len,
     }
 }
 
+/*
+ * Convert an EBCDIC string to UTF-8, using the table for the current host
+ * code page.  Runs of eight characters that translate to ASCII are copied
+ * as a single word.
+ * Stops when the next character will not fit, leaving room for a terminating
+ * NULL.  Returns the length of the UTF-8 string.
+ */
+static size_t
+ebcdic_to_utf8_string(const unsigned char *ebc, size_t ebc_len, char *u8,
+	size_t u8_len)
+{
+    size_t n = 0;
+
+    if (u8_len-- == 0) {
+	return 0;
+    }
+    while (ebc_len) {
+	size_t run = (ebc_len < 8)? ebc_len: 8;
+	size_t i;
+
+	if (run == 8 && u8_len - n >= 8) {
+	    unsigned char a[8];
+	    uint64_t w;
+
+	    for (i = 0; i < 8; i++) {
+		a[i] = e2a_cur[ebc[i]];
+	    }
+	    memcpy(&w, a, sizeof(w));
+	    if (!(w & HIGH_BITS)) {
+		memcpy(u8 + n, a, sizeof(a));
+		n += 8;
+		ebc += 8;
+		ebc_len -= 8;
+		continue;
+	    }
+	}
+
+	/* Translate this group one character at a time. */
+	for (i = 0; i < run; i++) {
+	    const e2u8_t *x = &e2u8_cur[ebc[i]];
+
+	    if (x->len > u8_len - n) {
+		goto done;
+	    }
+	    memcpy(u8 + n, x->bytes, x->len);
+	    n += x->len;
+	}
+	ebc += run;
+	ebc_len -= run;
+    }
+
+done:
+    u8[n] = '\0';
+    return n;
+}
+
 /*
  * Convert an EBCDIC string to a multibyte string.
  * Makes lots of assumptions: standard character set, EUO_BLANK_UNDEF.
- * Returns the length of the multibyte string.
+ * Returns the length of the multibyte string, which is NULL-terminated.
  */
 size_t
-ebcdic_to_multibyte_string(unsigned char *ebc, size_t ebc_len, char mb[],
-	size_t mb_len)
+ebcdic_to_multibyte_string(const unsigned char *ebc, size_t ebc_len,
+	char mb[], size_t mb_len)
+{
+    return ebcdic_to_multibyte_string_f(ebc, ebc_len, mb, mb_len, false);
+}
+
+/*
+ * ebcdic_to_multibyte_string with UTF-8 override.
+ */
+size_t
+ebcdic_to_multibyte_string_f(const unsigned char *ebc, size_t ebc_len,
+	char mb[], size_t mb_len, bool force_utf8)
 {
     size_t nmb = 0;
 
+    if (force_utf8 || local_is_utf8()) {
+	return ebcdic_to_utf8_string(ebc, ebc_len, mb, mb_len);
+    }
+
+    if (mb_len) {
+	mb[0] = '\0';
+    }
     while (ebc_len && mb_len) {
 	size_t xlen;
 
@@ -1242,6 +1576,8 @@ multibyte_to_ebcdic(const char *mb, size_t mb_len, int *consumedp,
 
 /*
  * Convert a local multi-byte string to an EBCDIC string.
+ * In a UTF-8 locale, runs of eight ASCII characters are translated as a
+ * single word, and everything else is decoded directly, without iconv.
  * Returns the length of the resulting EBCDIC string, or -1 if there is a
  * conversion error.
  */
@@ -1251,12 +1587,51 @@ multibyte_to_ebcdic_string(char *mb, size_t mb_len, unsigned char *ebc,
 {
     int ne = 0;
     bool in_dbcs = false;
+    int slow = 0;
 
     while (mb_len > 0 && ebc_len > 0) {
 	ebc_t e;
 	int consumed;
 
-	e = multibyte_to_ebcdic(mb, mb_len, &consumed, errorp);
+	while (is_utf8 && !in_dbcs && !slow && mb_len >= 8 && ebc_len >= 8) {
+	    unsigned char a[8];
+	    uint64_t w;
+	    int i;
+
+	    memcpy(&w, mb, sizeof(w));
+	    if (w & HIGH_BITS) {
+		slow = 8;
+		break;
+	    }
+	    for (i = 0; i < 8; i++) {
+		if ((a[i] = u2e_cur.latin[(unsigned char)mb[i]]) == 0) {
+		    break;
+		}
+	    }
+	    if (i < 8) {
+		slow = 8;
+		break;
+	    }
+	    memcpy(ebc, a, sizeof(a));
+	    ebc += 8;
+	    ebc_len -= 8;
+	    ne += 8;
+	    mb += 8;
+	    mb_len -= 8;
+	}
+	if (mb_len == 0 || ebc_len == 0) {
+	    break;
+	}
+	if (slow) {
+	    slow--;
+	}
+
+	if (is_utf8 && !(*mb & 0x80) &&
+		(e = u2e_cur.latin[(unsigned char)*mb]) != 0) {
+	    consumed = 1;
+	} else {
+	    e = multibyte_to_ebcdic(mb, mb_len, &consumed, errorp);
+	}
 	if (e == 0)
 	    return -1;
 	if (e & 0xff00) {
@@ -1396,6 +1771,58 @@ unicode_to_multibyte(ucs4_t ucs4, char *mb, size_t mb_len)
 #endif /*]*/
 }
 
+/*
+ * Convert a UCS-4 string to a local multi-byte string.
+ * Stops when the next character will not fit, leaving room for a terminating
+ * NULL.  Returns the length of the multi-byte string.
+ */
+size_t
+unicode_to_multibyte_string(const ucs4_t *ucs4, size_t u_len, char *mb,
+	size_t mb_len)
+{
+    size_t n = 0;
+
+    if (mb_len == 0) {
+	return 0;
+    }
+    if (local_is_utf8()) {
+	for (; u_len; ucs4++, u_len--) {
+	    int nu8;
+
+	    if (*ucs4 < 0x80) {
+		if (mb_len - n < 2) {
+		    break;
+		}
+		mb[n++] = (char)*ucs4;
+		continue;
+	    }
+	    if (mb_len - n < 7) {
+		break;
+	    }
+	    if ((nu8 = unicode_to_utf8(*ucs4, mb + n)) > 0) {
+		n += nu8;
+	    }
+	}
+    } else {
+	for (; u_len; ucs4++, u_len--) {
+	    char xmb[16];
+	    int nc;
+
+	    nc = unicode_to_multibyte(*ucs4, xmb, sizeof(xmb));
+	    if (nc <= 1) {
+		continue;
+	    }
+	    if (mb_len - n < (size_t)nc) {
+		break;
+	    }
+	    memcpy(mb + n, xmb, nc - 1);
+	    n += nc - 1;
+	}
+    }
+    mb[n] = '\0';
+    return n;
+}
+
 /*
  * Unicode to multibyte conversion, with UTF-8 override.
  */
@@ -1430,3 +1857,306 @@ using_iconv(void)
     return false;
 #endif
 }
+
+#if defined(UNIT_TEST) /*[*/
+/*
+ * Check the reverse translation tables against a linear search of the
+ * forward tables, and the bulk string translations against translating one
+ * character at a time, for every code page, then time both.  Build from the
+ * top of a configured tree with something like:
+ *
+ *  cc -DUNIT_TEST -Is3270 -Iinclude -ICommon/s3270 Common/unicode.c \
+ *   obj/<host>/lib32xx/lib32xx.a
+ */
+#include <assert.h>
+#include <time.h>
+
+void *Malloc(size_t n) { return malloc(n); }
+void *Calloc(size_t n, size_t s) { return calloc(n, s); }
+void *Realloc(void *p, size_t n) { return realloc(p, n); }
+void Free(void *p) { free(p); }
+char *NewString(const char *s) { return strcpy(malloc(strlen(s) + 1), s); }
+void Error(const char *s) { fprintf(stderr, "%s\n", s); exit(1); }
+void vtrace(const char *fmt, ...) { }
+
+/* The original linear search, for reference. */
+static ebc_t
+unicode_to_ebcdic_linear(ucs4_t u)
+{
+    int i;
+
+    if (!u) {
+	return 0;
+    }
+    if (u == 0x0020) {
+	return 0x40;
+    }
+    for (i = 0; i < UT_SIZE; i++) {
+	if (cur_uni->code[i] == u) {
+	    return UT_OFFSET + i;
+	}
+    }
+    return unicode_to_ebcdic_dbcs(u);
+}
+
+/* The original linear search of the APL table, for reference. */
+static ebc_t
+apl_linear(ucs4_t u)
+{
+    ebc_t e;
+
+    for (e = 0x70; e <= 0xfe; e++) {
+	if ((ucs4_t)apl_to_unicode(e, EUO_NONE) == u) {
+	    return e;
+	}
+    }
+    return 0;
+}
+
+/* The original one-character-at-a-time EBCDIC string translation. */
+static size_t
+ebcdic_to_multibyte_string_ref(const unsigned char *ebc, size_t ebc_len,
+	char mb[], size_t mb_len)
+{
+    size_t nmb = 0;
+
+    while (ebc_len && mb_len) {
+	size_t xlen;
+
+	xlen = ebcdic_to_multibyte_x(*ebc, CS_BASE, mb, mb_len,
+		EUO_BLANK_UNDEF, NULL);
+	if (xlen) {
+	    mb += xlen - 1;
+	    mb_len -= (xlen - 1);
+	    nmb += xlen - 1;
+	}
+	ebc++;
+	ebc_len--;
+    }
+    return nmb;
+}
+
+/* The original one-character-at-a-time multi-byte string translation. */
+static int
+multibyte_to_ebcdic_string_ref(char *mb, size_t mb_len, unsigned char *ebc,
+	size_t ebc_len)
+{
+    int ne = 0;
+    enum me_fail error;
+
+    while (mb_len > 0 && ebc_len > 0) {
+	ebc_t e;
+	int consumed;
+
+	e = multibyte_to_ebcdic(mb, mb_len, &consumed, &error);
+	if (e == 0) {
+	    return -1;
+	}
+	if (e & 0xff00) {
+	    return -2;
+	}
+	*ebc++ = (unsigned char)e;
+	ebc_len--;
+	ne++;
+	mb += consumed;
+	mb_len -= consumed;
+    }
+    return ne;
+}
+
+/* Compare the bulk string translations for the current code page. */
+static void
+check_strings(void)
+{
+    static unsigned char ebc[512], ebc2[512], ebc_ref[512];
+    static char mb[2048], mb_ref[2048];
+    size_t off, len, nmb, nmb_ref;
+    int ne, ne_ref;
+    enum me_fail error;
+
+    for (off = 0; off < 256; off++) {
+	ebc[off] = (unsigned char)off;
+	ebc[256 + off] = (unsigned char)(0x40 + (off % 0x50));
+    }
+    for (off = 0; off < 512; off += 37) {
+	for (len = 0; len <= 512 - off; len += 13) {
+	    nmb = ebcdic_to_multibyte_string(ebc + off, len, mb, sizeof(mb));
+	    nmb_ref = ebcdic_to_multibyte_string_ref(ebc + off, len, mb_ref,
+		    sizeof(mb_ref));
+	    assert(nmb == nmb_ref && !memcmp(mb, mb_ref, nmb));
+
+	    /* Round trip, where the per-character version is SBCS. */
+	    ne_ref = multibyte_to_ebcdic_string_ref(mb, nmb, ebc_ref,
+		    sizeof(ebc_ref));
+	    if (ne_ref == -2) {
+		continue;
+	    }
+	    ne = multibyte_to_ebcdic_string(mb, nmb, ebc2, sizeof(ebc2),
+		    &error);
+	    assert(ne == ne_ref);
+	    assert(ne < 0 || !memcmp(ebc2, ebc_ref, ne));
+	}
+    }
+}
+
+/* Compare the single-byte translation tables with direct translation. */
+static void
+check_e2u(void)
+{
+    static struct ea ea[256];
+    ucs4_t uc[256];
+    unsigned flags;
+    unsigned cs;
+    int c;
+
+    for (flags = 0; flags < 0x40; flags++) {
+	for (cs = 0; cs < 8; cs++) {
+	    for (c = 0; c < 256; c++) {
+		ea[c].ec = c;
+		ea[c].cs = cs;
+		assert(ebcdic_to_unicode(c, cs, flags) ==
+			ebcdic_to_unicode_nocache(c, cs, flags));
+	    }
+	    ebcdic_to_unicode_row(ea, 256, flags, uc);
+	    for (c = 0; c < 256; c++) {
+		assert(uc[c] == ebcdic_to_unicode_nocache(c, cs, flags));
+	    }
+	}
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i;
+    ucs4_t u;
+    const char *host_codepage, *cgcsgid;
+    static ucs4_t text[4096];
+    static unsigned char ebc_text[4096];
+    static char mb_text[4096 * 3 + 1];
+    static struct ea screen[62 * 160];
+    static ucs4_t screen_uc[62 * 160];
+    size_t nmb;
+    enum me_fail error;
+    unsigned long n, iterations = 2000;
+    unsigned long sum = 0;
+    clock_t t;
+    double linear, table;
+
+    /* Compare every character in every code page. */
+    for (i = 0; uni[i].name != NULL; i++) {
+	if (!set_uni(uni[i].name, 0, &host_codepage, &cgcsgid, NULL, NULL)) {
+	    continue;
+	}
+	for (u = 0; u <= 0x10000; u++) {
+	    assert(unicode_to_ebcdic(u) == unicode_to_ebcdic_linear(u));
+	    assert(u2e_lookup(&u2e_apl, u) == apl_linear(u));
+	}
+	is_utf8 = true;
+	check_strings();
+	is_utf8 = false;
+	check_e2u();
+    }
+    printf("%d code pages match\n", i);
+
+    /* Time translating typical text: mostly ASCII, some Latin-1. */
+    if (!set_uni("cp037", 0, &host_codepage, &cgcsgid, NULL, NULL)) {
+	return 1;
+    }
+    for (n = 0; n < array_count(text); n++) {
+	text[n] = (n % 16)? (ucs4_t)(' ' + (n % 95)): (ucs4_t)(0xa0 + (n % 96));
+    }
+    t = clock();
+    for (n = 0; n < iterations; n++) {
+	for (i = 0; i < (int)array_count(text); i++) {
+	    sum += unicode_to_ebcdic_linear(text[i]);
+	}
+    }
+    linear = (double)(clock() - t) / CLOCKS_PER_SEC;
+    t = clock();
+    for (n = 0; n < iterations; n++) {
+	for (i = 0; i < (int)array_count(text); i++) {
+	    sum -= unicode_to_ebcdic(text[i]);
+	}
+    }
+    table = (double)(clock() - t) / CLOCKS_PER_SEC;
+    assert(sum == 0);
+    printf("linear: %.0f chars/s\n", iterations * array_count(text) / linear);
+    printf("table:  %.0f chars/s\n", iterations * array_count(text) / table);
+
+    /* Time EBCDIC-to-UTF-8 string translation, per character and bulk. */
+    is_utf8 = true;
+    for (n = 0; n < array_count(ebc_text); n++) {
+	ebc_text[n] = (unsigned char)unicode_to_ebcdic(text[n]);
+    }
+    t = clock();
+    for (n = 0; n < iterations; n++) {
+	sum += ebcdic_to_multibyte_string_ref(ebc_text, array_count(ebc_text),
+		mb_text, sizeof(mb_text));
+    }
+    linear = (double)(clock() - t) / CLOCKS_PER_SEC;
+    t = clock();
+    for (n = 0; n < iterations; n++) {
+	sum -= ebcdic_to_multibyte_string(ebc_text, array_count(ebc_text),
+		mb_text, sizeof(mb_text));
+    }
+    table = (double)(clock() - t) / CLOCKS_PER_SEC;
+    assert(sum == 0);
+    printf("EBCDIC to UTF-8 per character: %.0f chars/s\n",
+	    iterations * array_count(ebc_text) / linear);
+    printf("EBCDIC to UTF-8 bulk:          %.0f chars/s\n",
+	    iterations * array_count(ebc_text) / table);
+
+    /* And back again. */
+    nmb = ebcdic_to_multibyte_string(ebc_text, array_count(ebc_text),
+	    mb_text, sizeof(mb_text));
+    t = clock();
+    for (n = 0; n < iterations; n++) {
+	sum += multibyte_to_ebcdic_string_ref(mb_text, nmb, ebc_text,
+		sizeof(ebc_text));
+    }
+    linear = (double)(clock() - t) / CLOCKS_PER_SEC;
+    t = clock();
+    for (n = 0; n < iterations; n++) {
+	sum -= multibyte_to_ebcdic_string(mb_text, nmb, ebc_text,
+		sizeof(ebc_text), &error);
+    }
+    table = (double)(clock() - t) / CLOCKS_PER_SEC;
+    assert(sum == 0);
+    printf("UTF-8 to EBCDIC per character: %.0f chars/s\n",
+	    iterations * array_count(ebc_text) / linear);
+    printf("UTF-8 to EBCDIC bulk:          %.0f chars/s\n",
+	    iterations * array_count(ebc_text) / table);
+
+    /* Time rendering a 62x160 screen with a mix of base and APL text. */
+    for (n = 0; n < array_count(screen); n++) {
+	screen[n].ec = (unsigned char)(0x40 + (n % 0xbf));
+	screen[n].cs = (n % 3)? CS_BASE: CS_APL;
+    }
+    t = clock();
+    for (n = 0; n < iterations; n++) {
+	for (i = 0; i < (int)array_count(screen); i++) {
+	    sum += ebcdic_to_unicode_nocache(screen[i].ec, screen[i].cs,
+		    EUO_APL_CIRCLED);
+	}
+    }
+    linear = (double)(clock() - t) / CLOCKS_PER_SEC;
+    t = clock();
+    for (n = 0; n < iterations; n++) {
+	for (i = 0; i < 62; i++) {
+	    ebcdic_to_unicode_row(&screen[i * 160], 160, EUO_APL_CIRCLED,
+		    &screen_uc[i * 160]);
+	}
+	for (i = 0; i < (int)array_count(screen); i++) {
+	    sum -= screen_uc[i];
+	}
+    }
+    table = (double)(clock() - t) / CLOCKS_PER_SEC;
+    assert(sum == 0);
+    printf("62x160 screen per character: %.0f screens/s\n",
+	    iterations / linear);
+    printf("62x160 screen by row:        %.0f screens/s\n",
+	    iterations / table);
+    return 0;
+}
+#endif /*]*/
@@ -486,9 +486,18 @@ EBCDIC value, and will be displayed as 00.
 XX_TP(XX_FB(ReadBuffer)(XX_FB(unicode)))
 Equivalent to XX_FB(ReadBuffer)(XX_FB(ascii)), but with the data fields output
 as 4-digit hexadecimal Unicode values.
+XX_TP(XX_FB(ReadBuffer)(XX_FB(binary)))
+Dumps the raw contents of the screen buffer, one line per row, encoded in
+base64.
+Each buffer position is 12 bytes (16 base64 characters): the field attribute
+(zero if the position is not a start-of-field), the XX_SM(EBCDIC) code, the
+character set, the foreground color, the background color, the highlighting,
+the input control, the XX_SM(DBCS) state, and a 4-byte big-endian Unicode
+value for text written in NVT mode.
 XX_TP(XX_FB(ReadBuffer)(XX_FB(field)))
 Dumps information about the current field.
-XX_FB(ascii), XX_FB(ebcdic) and XX_FB(unicode) keywords are also accepted.
+XX_FB(ascii), XX_FB(ebcdic), XX_FB(unicode) and XX_FB(binary) keywords are also
+accepted.
 The output consists of keywords and parameters.
 Note that XX_DQUOTED(field start) is the location of the start-of-field
 character, which is displayed on the screen as a blank to the left of the
@@ -0,0 +1,85 @@
+#!/usr/bin/perl
+# Grab the DBCS part of a DBCS or MBCS ucm file and output compact DBCS
+# translation tables, for unicode_dbcs.c.
+#
+# usage: Idbcs_ucm.pl <ucm-file-basename> <table-name>
+#
+# Each direction is split into 512 rows of 128 characters. A row index gives
+# the offset of each row's data, and the first column and number of columns
+# present, with leading and trailing unmapped columns trimmed. Rows with no
+# mappings take no space at all. The tables contain no pointers, so they need
+# no relocation and are paged in only when a DBCS code page is selected.
+
+my $file = $ARGV[0];
+my $name = $ARGV[1];
+my $in = 0;
+my %d2u;
+my %u2d;
+open TABLE, "<". $file . ".ucm" or die "No table.";
+while (<TABLE>) {
+    chomp;
+    next if /^#/;
+    last if /^END CHARMAP/;
+    if (/^CHARMAP/) {
+	$in = 1;
+	next;
+    }
+    next if (! $in);
+    # <U0020> \x20 #|0 SPACE
+    if (/<U([0-9a-fA-F]+)> +\\x([0-9a-fA-F]+)\\x([0-9a-fA-F]+)/) {
+	my $u = hex($1);
+	my $d = hex($2 . $3);
+	$d2u{$d} = $u;
+	$u2d{$u} = $d;
+    } elsif (/<U([0-9a-fA-F]+)> +\\x([0-9a-fA-F]+)/) {
+    } else {
+	die "Eh?";
+    }
+}
+
+# Dump one direction.
+sub dump_table {
+    my ($map, $tname, $desc) = @_;
+    my @index;
+    my @data;
+    my $row;
+
+    foreach $row (0..511) {
+	my $first = -1;
+	my $last = -1;
+	my $col;
+
+	foreach $col (0..127) {
+	    if ($map->{($row * 128) + $col}) {
+		$first = $col if ($first < 0);
+		$last = $col;
+	    }
+	}
+	if ($first < 0) {
+	    push @index, sprintf("/* %04x */ { %5d,   0,   0 },", $row * 128,
+		0);
+	    next;
+	}
+	push @index, sprintf("/* %04x */ { %5d, %3d, %3d },", $row * 128,
+	    scalar(@data), $first, $last - $first + 1);
+	foreach $col ($first..$last) {
+	    push @data, $map->{($row * 128) + $col} || 0;
+	}
+    }
+    die "Table too big" if (@data > 65535);
+
+    print "/* $desc translation table for $file */\n";
+    print "static const dbcs_row_t ${name}_${tname}_index[512] = {\n";
+    $index[$#index] =~ s/,$//;
+    print join("\n", @index), "\n};\n";
+    print "static const unsigned short ${name}_${tname}[] = {\n";
+    while (@data) {
+	my @line = splice(@data, 0, 8);
+	print "    ", join(", ", map { sprintf("0x%04x", $_) } @line),
+	    (@data? ",": ""), "\n";
+    }
+    print "};\n";
+}
+
+dump_table(\%u2d, "u2ebc", "Unicode to EBCDIC DBCS");
+dump_table(\%d2u, "ebc2u", "EBCDIC DBCS to Unicode");
@@ -63,6 +63,7 @@ typedef struct {
     bool	 bind_unlock;
     char	*script_port;
     char	*httpd_port;
+    char	*screen_mirror;
     char	*dbcs_cgcsgid;
     char	*conf_dir;
     char	*model;
@@ -201,6 +202,13 @@ typedef struct {
 	char	*callback;
     } scripting;
 
+    /* b3270-specific fields. */
+    struct {
+	bool	 json;
+	int	 frame_interval;
+	bool	 frame_drop;
+    } b3270;
+
 } AppRes, *AppResptr;
 
 extern AppRes appres;
@@ -104,6 +104,8 @@
 #define AttrExtended	"extended"
 #define AttrFatal	"fatal"
 #define AttrField	"field"
+#define AttrFramesCoalesced "frames-coalesced"
+#define AttrFramesSent	"frames-sent"
 #define AttrHelpText	"help-text"
 #define AttrHelpParms	"help-parms"
 #define AttrHost	"host"
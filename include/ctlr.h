@@ -36,3 +36,4 @@ extern struct ea	*ea_buf;	/* 3270 device buffer */
 extern struct ea	*aea_buf;	/* alternate 3270 device buffer */
 extern bool		formatted;	/* contains at least one field? */
 extern bool		is_altbuffer;	/* in alternate-buffer mode? */
+extern unsigned long	screen_generation; /* buffer change counter */
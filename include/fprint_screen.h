@@ -38,6 +38,7 @@
 #define FPS_DIALOG_COMPLETE	0x20	/* Windows dialog is complete */
 
 typedef struct _fps *fps_t;
+struct varbuf;
 
 typedef enum {
 	FPS_STATUS_SUCCESS = 0,
@@ -50,6 +51,8 @@ typedef enum {
 
 fps_status_t fprint_screen(FILE *f, ptype_t ptype, unsigned opts,
 	const char *caption, const char *printer_name, void *wait_context);
+fps_status_t fprint_screen_vb(struct varbuf *vb, ptype_t ptype, unsigned opts,
+	const char *caption);
 fps_status_t fprint_screen_start(FILE *f, ptype_t ptype, unsigned opts,
 	const char *caption, const char *printer_name, fps_t *fps,
 	void *wait_context);
@@ -53,12 +53,16 @@ void ft_register(void);
 
 # if defined(_WIN32) /*[*/
 size_t ft_ebcdic_to_multibyte(ebc_t ebc, char mb[], size_t mb_len);
+size_t ft_ebcdic_to_multibyte_string(const unsigned char *ebc, size_t ebc_len,
+	char mb[], size_t mb_len);
 int ft_unicode_to_multibyte(ucs4_t ucs4, char *mb, size_t mb_len);
 ucs4_t ft_multibyte_to_unicode(const char *mb, size_t mb_len,
 	int *consumedp, enum me_fail *errorp);
 # else /*][*/
 #  define ft_ebcdic_to_multibyte(ebc, mb, mb_len) \
 	     ebcdic_to_multibyte(ebc, mb, mb_len)
+#  define ft_ebcdic_to_multibyte_string(ebc, ebc_len, mb, mb_len) \
+	     ebcdic_to_multibyte_string(ebc, ebc_len, mb, mb_len)
 #  define ft_unicode_to_multibyte(ucs4, mb, mb_len) \
 	     unicode_to_multibyte(ucs4, mb, mb_len)
 #  define ft_multibyte_to_unicode(mb, mb_len, consumedp, errorp) \
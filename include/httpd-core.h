@@ -41,12 +41,14 @@ typedef enum {
 #define HF_NONE		0x0
 #define HF_TRAILER	0x1	/* include standard trailer */
 #define HF_HIDDEN	0x2	/* do not include in directory listings */
+#define HF_POST		0x4	/* accepts POST requests only */
 
 typedef enum {
     HS_CONTINUE = 0,		/* incomplete request */
     HS_SUCCESS_OPEN = 1,	/* request succeeded, leave socket open */
     HS_ERROR_OPEN = 2,		/* request failed, leave socket open */
     HS_PENDING = 3,		/* request is pending (async) */
+    HS_STREAM = 4,		/* response is a stream, leave socket open */
     HS_ERROR_CLOSE = -1,	/* request failed, close socket */
     HS_SUCCESS_CLOSE = -2	/* request succeeded, close socket */
 } httpd_status_t;
@@ -67,18 +69,28 @@ void *httpd_register_dyn_nonterm(const char *path, const char *desc,
 	content_t content_type, const char *content_str, unsigned flags,
 	reg_dyn_t *dyn);
 void httpd_set_alias(void *nhandle, const char *text);
+typedef const char *reg_etag_t(const char *uri);
+void httpd_set_etag(void *nhandle, reg_etag_t *etag);
 
 /* Called from the main logic. */
 void *httpd_mhandle(void *dhandle);
 void *httpd_new(void *mhandle, const char *client_name);
 httpd_status_t httpd_input(void *dhandle, const char *data, size_t len);
+bool httpd_held(void *dhandle);
+httpd_status_t httpd_input_held(void *dhandle);
 void httpd_close(void *dhandle, const char *why);
 
 /* Callable from methods. */
 httpd_status_t httpd_dyn_complete(void *dhandle,
 	const char *format, ...);
+httpd_status_t httpd_dyn_complete_buf(void *dhandle, const char *buf,
+	size_t len);
 httpd_status_t httpd_dyn_error(void *dhandle, content_t content_type,
 	int status_code, const char *format, ...);
+httpd_status_t httpd_dyn_stream(void *dhandle);
+void httpd_stream_send(void *dhandle, const char *buf, size_t len);
 char *html_quote(const char *text);
+char *json_quote(const char *text);
 char *uri_quote(const char *text);
 const char *httpd_fetch_query(void *dhandle, const char *name);
+const char *httpd_fetch_body(void *dhandle, size_t *len);
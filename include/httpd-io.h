@@ -56,6 +56,12 @@ void hio_send(void *mhandle, const char *buf, size_t len);
 
 void hio_async_done(void *dhandle, httpd_status_t rv);
 
+typedef void hio_stream_closed_t(void *context);
+void hio_stream_start(void *dhandle, void *context,
+	hio_stream_closed_t *closed);
+void hio_stream_send(void *mhandle, const char *buf, size_t len);
+bool hio_stream_busy(void *dhandle);
+
 void hio_init(struct sockaddr *sa, socklen_t sa_len);
 hio_listener_t *hio_init_x(struct sockaddr *sa, socklen_t sa_len);
 void hio_stop(void);
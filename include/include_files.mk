@@ -1,12 +1,12 @@
 INCLUDE_HEADERS = 3270ds.h actions.h apl.h appres.h arpa_telnet.h asprintf.h \
 	b8.h bind-opt.h charset.h child.h child_popups.h ctlr.h ctlrc.h \
-	fallbacks.h fprint_screen.h ft.h ft_cut.h ft_cut_ds.h ft_dft.h \
+	fallbacks.h fprint_screen.h ft.h ft_conv.h ft_cut.h ft_cut_ds.h ft_dft.h \
 	ft_dft_ds.h ft_gui.h ft_private.h gdi_print.h globals.h glue.h \
 	glue_gui.h host.h host_gui.h httpd-core.h httpd-io.h httpd-nodes.h \
-	idle.h kybd.h latin1.h lazya.h linemode.h macros.h menubar.h nvt.h \
-	nvt_gui.h opts.h popups.h pr3287_session.h print_gui.h print_screen.h \
-	product.h proxy.h proxy_names.h readres.h resolver.h resources.h \
-	rpq.h save.h screen.h scroll.h see.h selectc.h sf.h status.h tables.h \
+	idle.h kybd.h latin1.h lazya.h linemode.h macros.h menubar.h metrics.h mirror.h \
+	mirror_shm.h nvt.h nvt_gui.h opts.h popups.h pr3287_session.h \
+	print_gui.h print_screen.h product.h proxy.h proxy_names.h readres.h \
+	resolver.h resources.h rpq.h save.h screen.h scroll.h see.h selectc.h sf.h status.h tables.h \
 	telnet.h telnet_core.h telnet_gui.h telnet_private.h tls_passwd_gui.h \
 	tn3270e.h toggles.h trace.h trace_gui.h unicode_dbcs.h unicodec.h \
 	utf8.h util.h varbuf.h w3misc.h wincmn.h windirs.h winprint.h \
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2020 Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	metrics.h
+ *		Global declarations for metrics.c.
+ */
+
+struct varbuf;
+
+/* Counters. These only ever go up. */
+typedef enum {
+    MC_BYTES_RECEIVED,		/* bytes received from the host */
+    MC_BYTES_SENT,		/* bytes sent to the host */
+    MC_RECORDS_RECEIVED,	/* records received from the host */
+    MC_RECORDS_SENT,		/* records sent to the host */
+    MC_CONNECT_ATTEMPTS,	/* connection attempts */
+    MC_RECONNECT_ATTEMPTS,	/* automatic reconnection attempts */
+    MC_CONNECTS,		/* successful connections */
+    MC_CONNECT_FAILURES,	/* connection attempts that failed */
+    MC_DISCONNECTS,		/* connections that ended */
+    MC_TRACE_BYTES,		/* bytes written to the trace file */
+    NUM_MC
+} metrics_counter_t;
+
+/* Histograms of durations. */
+typedef enum {
+    MH_HOST_RESPONSE,		/* AID to keyboard unlock */
+    MH_CONNECT,			/* start of connection to connected */
+    MH_CONNECTION,		/* lifetime of a connection */
+    MH_TLS_HANDSHAKE,		/* TLS negotiation */
+    MH_COMMAND,			/* script command execution */
+    MH_EVENT_LOOP,		/* busy time per event loop pass */
+    NUM_MH
+} metrics_histogram_t;
+
+extern unsigned long long metrics_counter[NUM_MC];
+#define metrics_count(c, n)	(metrics_counter[c] += (n))
+
+void metrics_observe(metrics_histogram_t h, struct timeval *t0,
+	struct timeval *t1);
+void metrics_start(metrics_histogram_t h);
+void metrics_stop(metrics_histogram_t h);
+void metrics_wait_start(void);
+void metrics_wait_stop(void);
+void metrics_cstate(enum cstate old_cstate, enum cstate new_cstate);
+void metrics_dump(struct varbuf *r);
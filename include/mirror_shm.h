@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020 Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	mirror_shm.h
+ *		Layout of the shared-memory screen mirror, and the reader API.
+ *
+ * The mirror is a file (normally in /dev/shm) that the emulator maps and
+ * keeps up to date with the screen buffer, cursor and OIA state. It starts
+ * with a mirror_header_t, followed by 'capacity' mirror_cell_t entries.
+ * Only the first rows * cols cells are meaningful.
+ *
+ * Updates are protected by a sequence lock: the writer makes 'seq' odd
+ * before changing anything and even again when it is done. A reader copies
+ * what it needs, then checks that 'seq' was even and unchanged across the
+ * copy; if not, it tries again. Readers never block the emulator.
+ *
+ * All fields are in native byte order.
+ */
+
+#define MIRROR_MAGIC	0x33323730	/* "3270" */
+#define MIRROR_VERSION	1
+
+/* Flags. */
+#define MF_FORMATTED	0x0001	/* screen contains fields */
+#define MF_3270		0x0002	/* in 3270 mode */
+#define MF_NVT		0x0004	/* in NVT mode */
+#define MF_SSCP		0x0008	/* in SSCP-LU mode */
+#define MF_CONNECTED	0x0010	/* connected to a host */
+#define MF_ALTBUFFER	0x0020	/* alternate buffer (EraseWriteAlternate) */
+#define MF_INSERT	0x0040	/* insert mode */
+
+typedef struct {
+    uint32_t magic;		/* MIRROR_MAGIC */
+    uint32_t version;		/* MIRROR_VERSION */
+    uint32_t seq;		/* sequence lock, odd while updating */
+    uint32_t header_size;	/* sizeof(mirror_header_t) */
+    uint64_t generation;	/* bumped on every published change */
+    uint32_t rows;		/* current screen size */
+    uint32_t cols;
+    uint32_t capacity;		/* number of cells allocated */
+    uint32_t cell_size;		/* sizeof(mirror_cell_t) */
+    int32_t cursor;		/* cursor buffer address */
+    uint32_t kybdlock;		/* keyboard lock bits, 0 if unlocked */
+    uint32_t cstate;		/* connection state (enum cstate) */
+    uint32_t flags;		/* MF_XXX */
+    uint32_t cells_offset;	/* offset of the first cell */
+    uint32_t pid;		/* emulator process ID */
+} mirror_header_t;
+
+/* One screen position. These are the fields of struct ea. */
+typedef struct {
+    uint8_t fa;			/* field attribute, nonzero if field */
+    uint8_t ec;			/* EBCDIC or ASCII character code */
+    uint8_t cs;			/* character set (CS_XXX) */
+    uint8_t fg;			/* foreground color */
+    uint8_t bg;			/* background color */
+    uint8_t gr;			/* ANSI graphics rendition bits */
+    uint8_t ic;			/* input control */
+    uint8_t db;			/* DBCS state */
+    uint32_t ucs4;		/* NVT-mode Unicode character */
+} mirror_cell_t;
+
+/* Reader API, in libmirror_read.a. */
+typedef struct mirror_reader mirror_reader_t;
+
+mirror_reader_t *mirror_reader_open(const char *path);
+int mirror_reader_snapshot(mirror_reader_t *r, mirror_header_t *header,
+	mirror_cell_t *cells, unsigned max_cells);
+uint64_t mirror_reader_generation(mirror_reader_t *r);
+void mirror_reader_close(mirror_reader_t *r);
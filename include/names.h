@@ -219,6 +219,7 @@
 #define KwAscii		"ascii"
 #define KwEbcdic	"ebcdic"
 #define KwUnicode	"unicode"
+#define KwBinary	"binary"
 #define KwField		"field"
 /*  Parameters to RequestInput(). */
 #define KwDashNoEcho	"-noecho"
@@ -99,6 +99,8 @@
 #define ResEof			"eof"
 #define ResErase		"erase"
 #define ResFixedSize		"fixedSize"
+#define ResFrameDrop		"frameDrop"
+#define ResFrameInterval	"frameInterval"
 #define ResFtAllocation		"ftAllocation"
 #define ResFtAvblock		"ftAvblock"
 #define ResFtBlksize		"ftBlksize"
@@ -137,6 +139,7 @@
 #define ResInsertMode		"insertMode"
 #define ResIntr			"intr"
 #define ResInvertKeypadShift	"invertKeypadShift"
+#define ResJson			"json"
 #define ResKeyFile		"keyFile"
 #define ResKeyFileType		"keyFileType"
 #define ResKeymap		"keymap"
@@ -197,6 +200,7 @@
 #define ResRprnt		"rprnt"
 #define ResSaveLines		"saveLines"
 #define ResSchemeList		"schemeList"
+#define ResScreenMirror		"screenMirror"
 #define ResScreenTrace		"screenTrace"
 #define ResScreenTraceFile	"screenTraceFile"
 #define ResScreenTraceTarget	"screenTraceTarget"
@@ -426,6 +430,7 @@
 #define ClsRprnt		"Rprnt"
 #define ClsSaveLines		"SaveLines"
 #define ClsSbcsCgcsgid		"SbcsSgcsgid"
+#define ClsScreenMirror		"ScreenMirror"
 #define ClsScreenTrace		"ScreenTrace"
 #define ClsScreenTraceFile	"ScreenTraceFile"
 #define ClsScreenTraceTarget	"ScreenTraceTarget"
@@ -495,6 +500,7 @@
 #define OptIconX		"-iconx"
 #define OptIconY		"-icony"
 #define OptInputMethod		"-im"
+#define OptJson			"-json"
 #define OptKeyFile		"-keyfile"
 #define OptKeyFileType		"-keyfiletype"
 #define OptKeymap		"-keymap"
@@ -52,10 +52,14 @@ void push_keymap_action(char *);
 void push_keypad_action(char *);
 void push_macro(char *);
 void push_stack_macro(char *);
+void task_cache_macro(const char *text);
+void task_flush_macro_cache(void);
 bool task_active(void);
 bool task_can_kbwait(void);
 void task_connect_wait(void);
 bool run_tasks(void);
+bool task_pending(void);
+void task_get_depth(unsigned *queues, unsigned *tasks);
 void task_error(const char *msg);
 void task_host_output(void);
 void task_info(const char *fmt, ...) printflike(1, 2);
@@ -113,6 +117,7 @@ typedef struct {
 #define CB_NEEDS_RUN	0x2	/* needs its run method called */
 #define CB_NEW_TASKQ	0x4	/* creates a new task queue */
 #define CB_PEER		0x8	/* peer script (don't abort) */
+#define CB_BULK		0x10	/* bulk script (lowest scheduling priority) */
 
 #define CBF_INTERACTIVE	0x1	/* settable: interactive (e.g., c3270 prompt) */
 #define CBF_CONNECT_NONBLOCK 0x2 /* do not block Connect()/Open() */
@@ -41,5 +41,6 @@ bool net_add_dummy_tn3270e(void);
 void net_add_eor(unsigned char *buf, size_t len);
 void net_disconnect(bool including_tls);
 void net_output(void);
+void net_output_buf(const unsigned char *buf, size_t len);
 void space3270out(size_t n);
 void trace_netdata(char direction, unsigned const char *buf, size_t len);
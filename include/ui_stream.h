@@ -38,3 +38,4 @@ void ui_pop(void);
 void ui_push(const char *name, const char *args[]);
 void ui_vleaf(const char *name, ...);
 void ui_vpush(const char *name, ...);
+bool ui_output_blocked(void);
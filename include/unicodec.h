@@ -45,6 +45,8 @@ extern bool dbcs_allowed;
 
 bool codepage_matches_alias(const char *alias, const char *canon);
 ucs4_t ebcdic_to_unicode(ebc_t e, unsigned char cs, unsigned flags);
+void ebcdic_to_unicode_row(const struct ea *ea, size_t len, unsigned flags,
+	ucs4_t *uc);
 ucs4_t ebcdic_base_to_unicode(ebc_t e, unsigned flags);
 ebc_t unicode_to_ebcdic(ucs4_t u);
 ebc_t unicode_to_ebcdic_ge(ucs4_t u, bool *ge, bool prefer_apl);
@@ -57,8 +59,10 @@ size_t ebcdic_to_multibyte_f(ebc_t ebc, char mb[], size_t mb_len, bool
 	force_utf8);
 size_t ebcdic_to_multibyte_fx(ebc_t ebc, unsigned char cs, char mb[],
 	size_t mb_len, unsigned flags, ucs4_t *ucp, bool force_utf8);
-size_t ebcdic_to_multibyte_string(unsigned char *ebc, size_t ebc_len,
+size_t ebcdic_to_multibyte_string(const unsigned char *ebc, size_t ebc_len,
 	char mb[], size_t mb_len);
+size_t ebcdic_to_multibyte_string_f(const unsigned char *ebc, size_t ebc_len,
+	char mb[], size_t mb_len, bool force_utf8);
 size_t ebcdic_to_multibyte_x(ebc_t ebc, unsigned char cs, char mb[],
 	size_t mb_len, unsigned flags, ucs4_t *uc);
 int mb_max_len(int len);
@@ -80,6 +84,8 @@ int multibyte_to_ebcdic_string(char *mb, size_t mb_len, unsigned char *ebc,
 int unicode_to_multibyte(ucs4_t ucs4, char *mb, size_t mb_len);
 int unicode_to_multibyte_f(ucs4_t ucs4, char *mb, size_t mb_len,
 	bool force_utf8);
+size_t unicode_to_multibyte_string(const ucs4_t *ucs4, size_t u_len,
+	char *mb, size_t mb_len);
 bool using_iconv(void);
 const char *canonical_codepage(const char *alias);
 typedef struct {
@@ -125,6 +125,7 @@ void register_schange_ordered(enum st tx, schange_callback_t *func,
 	unsigned short order);
 void register_schange(enum st tx, schange_callback_t *func);
 void st_changed(enum st tx, bool mode);
+extern unsigned long state_generation;
 #if !defined(PR3287) /*[*/
 void change_cstate(enum cstate cstate, const char *why);
 #endif /*]*/
@@ -30,7 +30,7 @@
  *              Header file for x3270 variable-length buffer library.
  */
 
-typedef struct {
+typedef struct varbuf {
     char *buf;
     size_t len;
     size_t alloc_len;
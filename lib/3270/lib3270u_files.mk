@@ -1,2 +1,6 @@
 # Unix-specific object files for lib3270.
 LIB3270U_OBJECTS = find_console.o print_command.o
+
+# Object files for the screen mirror reader library, which is linked into
+# programs that watch an emulator's screen, not into the emulators.
+MIRROR_READ_OBJECTS = mirror_read.o
@@ -90,6 +90,8 @@ XtResource resources[] = {
       offset(trace_file), XtRString, 0 },
     { ResTraceFileSize, ClsTraceFileSize, XtRString, sizeof(char *),
       offset(trace_file_size), XtRString, 0 },
+    { ResScreenMirror, ClsScreenMirror, XtRString, sizeof(char *),
+      offset(screen_mirror), XtRString, 0 },
     { ResScreenTraceFile, ClsScreenTraceFile, XtRString, sizeof(char *),
       offset(screentrace.file), XtRString, 0 },
     { ResScreenTraceTarget, ClsScreenTraceTarget, XtRString, sizeof(char *),
@@ -63,6 +63,7 @@
 #include "lazya.h"
 #include "login_macro.h"
 #include "min_version.h"
+#include "mirror.h"
 #include "model.h"
 #include "nvt.h"
 #include "opts.h"
@@ -494,6 +495,7 @@ main(int argc, char *argv[])
     x3270_register();
     xio_register();
     hio_register();
+    mirror_register();
     proxy_register();
     model_register();
     net_register();
@@ -861,7 +863,11 @@ main(int argc, char *argv[])
 	    XtAppProcessEvent(appcontext, XtIMXEvent | XtIMTimer);
 	}
 	screen_disp(false);
-	XtAppProcessEvent(appcontext, XtIMAll);
+	mirror_publish();
+	if (!task_pending() || XtAppPending(appcontext)) {
+	    /* Don't block if there are tasks waiting for another turn. */
+	    XtAppProcessEvent(appcontext, XtIMAll);
+	}
 
 	/* Poll for exited children. */
 	poll_children();